@@ -1,5 +1,44 @@
 #include "ChessBoard.h"
+#include "ChessPosition.h"
 #include <assert.h>
+#include <algorithm>
+
+namespace
+{
+	struct ZobristTable
+	{
+		// [type][isBlack][indexPosition], then the side to move and the pawns that used their double step.
+		uint64_t pieces[ChessPiece::KING + 1][2][ChessBoard::CELLS_COUNT];
+		uint64_t blackToMove;
+		uint64_t doubleStep[ChessBoard::CELLS_COUNT];
+
+		ZobristTable()
+		{
+			uint64_t seed = 0x9E3779B97F4A7C15ull;
+			auto next = [&seed]()
+			{
+				// SplitMix64, fixed seed so keys are stable across runs and processes (opening books rely on it).
+				uint64_t z = ( seed += 0x9E3779B97F4A7C15ull );
+				z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+				z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+				return z ^ ( z >> 31 );
+			};
+			for ( auto& byType : pieces )
+				for ( auto& byColor : byType )
+					for ( auto& key : byColor )
+						key = next();
+			blackToMove = next();
+			for ( auto& key : doubleStep )
+				key = next();
+		}
+	};
+
+	const ZobristTable& zobrist()
+	{
+		static const ZobristTable table;
+		return table;
+	}
+}
 
 ChessBoard::ChessBoard() :
 	idx_default_pawns( { 8, 9, 10, 11, 12, 13, 14, 15 } ),
@@ -7,7 +46,10 @@ ChessBoard::ChessBoard() :
 	idx_default_knight( { 1, 6 } ),
 	idx_default_bishops( { 2, 5 } ),
 	idx_default_queen( { 3 } ),
-	idx_default_king( { 4 } )
+	idx_default_king( { 4 } ),
+	m_hash( 0 ),
+	m_pawnHash( 0 ),
+	m_pawnsUsedDoubleStep( 0 )
 {
 	all_idxs.emplace( ChessPiece::TYPE::PAWN, idx_default_pawns );
 	all_idxs.emplace( ChessPiece::TYPE::ROOK, idx_default_rooks );
@@ -16,7 +58,10 @@ ChessBoard::ChessBoard() :
 	all_idxs.emplace( ChessPiece::TYPE::QUEEN, idx_default_queen );
 	all_idxs.emplace( ChessPiece::TYPE::KING, idx_default_king );
 
+	std::fill( &m_pieceMasks[0][0], &m_pieceMasks[0][0] + 2 * ( ChessPiece::KING + 1 ), 0 );
+	m_occupied[0] = m_occupied[1] = 0;
 	m_positions.resize( CELLS_COUNT, -1 );
+	m_freeNodes.reserve( PIECES_COUNT );
 	initInDefaultPositions();
 }
 
@@ -39,8 +84,17 @@ void ChessBoard::initInDefaultPositions()
 void ChessBoard::createPiece( const ChessPiece::TYPE type, const int indexPosition, const bool isBlack )
 {
 	int indexPiece = int( m_pieces.size() );
-	m_pieces.emplace( indexPiece, ChessPiece( indexPiece, type, isBlack, indexPosition / SIZE, indexPosition % SIZE ) );
+	assert( indexPiece < PIECES_COUNT );
+	insertPiece( indexPiece, ChessPiece( indexPiece, type, isBlack, indexPosition / SIZE, indexPosition % SIZE ) );
 	m_positions[indexPosition] = indexPiece;
+	m_hash ^= zobristKey( type, isBlack, indexPosition );
+	if ( type == ChessPiece::PAWN )
+	{
+		m_pawnHash ^= zobristKey( type, isBlack, indexPosition );
+	}
+	m_pieceMasks[isBlack][type] |= 1u << indexPiece;
+	m_pieceMasks[isBlack][ChessPiece::NONE] |= 1u << indexPiece;
+	m_occupied[isBlack] |= 1ull << indexPosition;
 }
 
 const bool ChessBoard::existsPieceAt( const int row, const int column ) const
@@ -63,16 +117,52 @@ void ChessBoard::removePiece( const int indexPiece )
 	const int indexPosition = ( m_pieces.at( indexPiece ).row() * SIZE ) + m_pieces.at( indexPiece ).column();
 	assert( m_positions[indexPosition] != -1 );
 	m_positions[indexPosition] = -1;
-	m_pieces.erase( indexPiece );
+	const auto& piece = m_pieces.at( indexPiece );
+	uint64_t key = zobristKey( piece.type(), piece.isBlack(), indexPosition );
+	if ( pawnUsedDoubleStep( indexPiece ) ) key ^= zobrist().doubleStep[indexPosition];
+	m_hash ^= key;
+	if ( piece.type() == ChessPiece::PAWN )
+	{
+		m_pawnHash ^= key;
+	}
+	m_pieceMasks[piece.isBlack()][piece.type()] &= ~( 1u << indexPiece );
+	m_pieceMasks[piece.isBlack()][ChessPiece::NONE] &= ~( 1u << indexPiece );
+	m_occupied[piece.isBlack()] &= ~( 1ull << indexPosition );
+	m_freeNodes.push_back( m_pieces.extract( indexPiece ) );
+}
+
+// Reuses the node of a removed piece when possible, so captures and resets do not allocate.
+void ChessBoard::insertPiece( const int indexPiece, const ChessPiece& piece )
+{
+	if ( m_freeNodes.empty() )
+	{
+		m_pieces.emplace( indexPiece, piece );
+		return;
+	}
+	auto node = std::move( m_freeNodes.back() );
+	m_freeNodes.pop_back();
+	node.key() = indexPiece;
+	node.mapped() = piece;
+	m_pieces.insert( std::move( node ) );
 }
 
 void ChessBoard::restorePiece( const int indexPiece, const bool isBlack, const ChessPiece::TYPE type, const int row, const int column )
 {
 	assert( m_pieces.find( indexPiece ) == m_pieces.end() );
-	m_pieces.emplace( indexPiece, ChessPiece( indexPiece, type, isBlack, row, column ) );
+	insertPiece( indexPiece, ChessPiece( indexPiece, type, isBlack, row, column ) );
 	const int newIndexPosition = ( row * SIZE ) + column;
 	assert( m_positions[newIndexPosition] == -1 );
 	m_positions[newIndexPosition] = indexPiece;
+	uint64_t key = zobristKey( type, isBlack, newIndexPosition );
+	if ( pawnUsedDoubleStep( indexPiece ) ) key ^= zobrist().doubleStep[newIndexPosition];
+	m_hash ^= key;
+	if ( type == ChessPiece::PAWN )
+	{
+		m_pawnHash ^= key;
+	}
+	m_pieceMasks[isBlack][type] |= 1u << indexPiece;
+	m_pieceMasks[isBlack][ChessPiece::NONE] |= 1u << indexPiece;
+	m_occupied[isBlack] |= 1ull << newIndexPosition;
 }
 
 void ChessBoard::movePieceTo( const int indexPiece, const int row, const int column )
@@ -85,11 +175,219 @@ void ChessBoard::movePieceTo( const int indexPiece, const int row, const int col
 	const int newIndexPosition = ( row * SIZE ) + column;
 	assert( m_positions[newIndexPosition] == -1 );
 	m_positions[newIndexPosition] = indexPiece;
+	const auto& piece = m_pieces.at( indexPiece );
+	m_occupied[piece.isBlack()] &= ~( 1ull << indexPosition );
+	m_occupied[piece.isBlack()] |= 1ull << newIndexPosition;
+	uint64_t key = zobristKey( piece.type(), piece.isBlack(), indexPosition ) ^ zobristKey( piece.type(), piece.isBlack(), newIndexPosition );
+	if ( pawnUsedDoubleStep( indexPiece ) ) key ^= zobrist().doubleStep[indexPosition] ^ zobrist().doubleStep[newIndexPosition];
+	m_hash ^= key;
+	if ( piece.type() == ChessPiece::PAWN )
+	{
+		m_pawnHash ^= key;
+	}
+}
+
+/**
+ Pawns can double step only once, the flag is part of the position (and of both keys).
+*/
+void ChessBoard::setPawnUsedDoubleStep( const int indexPiece )
+{
+	assert( existsPiece( indexPiece ) && m_pieces.at( indexPiece ).type() == ChessPiece::PAWN );
+	if ( pawnUsedDoubleStep( indexPiece ) )
+	{
+		return;
+	}
+	const auto& piece = m_pieces.at( indexPiece );
+	const uint64_t key = zobrist().doubleStep[piece.row() * SIZE + piece.column()];
+	m_hash ^= key;
+	m_pawnHash ^= key;
+	m_pawnsUsedDoubleStep |= 1u << indexPiece;
+}
+
+// Undoes setPawnUsedDoubleStep, the pawn must still be on the square it double stepped to.
+void ChessBoard::clearPawnUsedDoubleStep( const int indexPiece )
+{
+	assert( existsPiece( indexPiece ) && pawnUsedDoubleStep( indexPiece ) );
+	const auto& piece = m_pieces.at( indexPiece );
+	const uint64_t key = zobrist().doubleStep[piece.row() * SIZE + piece.column()];
+	m_hash ^= key;
+	m_pawnHash ^= key;
+	m_pawnsUsedDoubleStep &= ~( 1u << indexPiece );
 }
 
 void ChessBoard::clear()
 {
-	m_pieces.clear();
-	m_positions.clear();
-	m_positions.resize( CELLS_COUNT, -1 );
-}
\ No newline at end of file
+	while ( !m_pieces.empty() )
+	{
+		m_freeNodes.push_back( m_pieces.extract( m_pieces.begin() ) );
+	}
+	std::fill( m_positions.begin(), m_positions.end(), -1 );
+	m_hash = 0;
+	m_pawnHash = 0;
+	m_pawnsUsedDoubleStep = 0;
+	std::fill( &m_pieceMasks[0][0], &m_pieceMasks[0][0] + 2 * ( ChessPiece::KING + 1 ), 0 );
+	m_occupied[0] = m_occupied[1] = 0;
+}
+
+const uint64_t ChessBoard::zobristKey( const ChessPiece::TYPE type, const bool isBlack, const int indexPosition )
+{
+	return zobrist().pieces[type][isBlack][indexPosition];
+}
+
+const uint64_t ChessBoard::zobristBlackToMove()
+{
+	return zobrist().blackToMove;
+}
+
+const uint64_t ChessBoard::zobristDoubleStep( const int indexPosition )
+{
+	return zobrist().doubleStep[indexPosition];
+}
+
+void ChessBoard::getPosition( ChessPosition& position, const bool blackToMove ) const
+{
+	position.clear();
+	position.pawnsUsedDoubleStep = m_pawnsUsedDoubleStep;
+	for ( const auto&[indexPiece, piece] : m_pieces )
+	{
+		position.addPiece( indexPiece, piece.type(), piece.isBlack(), piece.row() * SIZE + piece.column() );
+	}
+	position.blackToMove = blackToMove;
+	assert( position.hash == m_hash && position.pawnHash == m_pawnHash );
+}
+
+/**
+ Rebuilds the pieces of a position keeping their indices.
+*/
+void ChessBoard::setPosition( const ChessPosition& position )
+{
+	clear();
+	m_pawnsUsedDoubleStep = position.pawnsUsedDoubleStep;
+	for ( int indexPosition = 0; indexPosition < CELLS_COUNT; indexPosition++ )
+	{
+		const int indexPiece = position.cells[indexPosition];
+		if ( indexPiece != ChessPosition::NO_PIECE )
+		{
+			restorePiece( indexPiece, position.isBlack( indexPiece ), position.type( indexPiece ), indexPosition / SIZE, indexPosition % SIZE );
+		}
+	}
+	assert( m_hash == position.hash && m_pawnHash == position.pawnHash );
+}
+
+/**
+ Builds the board directly from the piece placement field of a FEN string (rank 8 first).
+ Rows grow from white's side, so rank 1 is row 0. The board is left untouched if the field is malformed
+ or has more than PIECES_COUNT / 2 pieces of a color.
+*/
+const bool ChessBoard::loadPlacementFEN( const std::string& placement )
+{
+	std::vector< std::pair< ChessPiece::TYPE, bool > > cells( CELLS_COUNT, { ChessPiece::NONE, false } );
+	int row = SIZE - 1;
+	int column = 0;
+	int kings[2] = { 0, 0 };
+	int pieces[2] = { 0, 0 }; // By color, at most PIECES_COUNT / 2 (piece masks and evaluation tables).
+	for ( const char symbol : placement )
+	{
+		if ( symbol == '/' )
+		{
+			if ( column != SIZE || row == 0 ) return false;
+			row--;
+			column = 0;
+		}
+		else if ( symbol >= '1' && symbol <= '8' )
+		{
+			column += symbol - '0';
+			if ( column > SIZE ) return false;
+		}
+		else
+		{
+			bool isBlack = false;
+			const ChessPiece::TYPE type = pieceType( symbol, isBlack );
+			if ( type == ChessPiece::NONE || column >= SIZE ) return false;
+			if ( type == ChessPiece::KING ) kings[isBlack]++;
+			if ( ++pieces[isBlack] > PIECES_COUNT / 2 ) return false;
+			cells[row * SIZE + column] = { type, isBlack };
+			column++;
+		}
+	}
+	if ( row != 0 || column != SIZE || kings[0] != 1 || kings[1] != 1 )
+	{
+		return false;
+	}
+
+	clear();
+	for ( int indexPosition = 0; indexPosition < CELLS_COUNT; indexPosition++ )
+	{
+		if ( cells[indexPosition].first != ChessPiece::NONE )
+		{
+			createPiece( cells[indexPosition].first, indexPosition, cells[indexPosition].second );
+		}
+	}
+	return true;
+}
+
+std::string ChessBoard::getPlacementFEN() const
+{
+	std::string placement;
+	placement.reserve( 72 );
+	for ( int row = SIZE - 1; row >= 0; row-- )
+	{
+		int emptyCells = 0;
+		for ( int column = 0; column < SIZE; column++ )
+		{
+			const int indexPiece = m_positions[row * SIZE + column];
+			if ( indexPiece < 0 )
+			{
+				emptyCells++;
+				continue;
+			}
+			if ( emptyCells > 0 )
+			{
+				placement.push_back( char( '0' + emptyCells ) );
+				emptyCells = 0;
+			}
+			const auto& piece = m_pieces.at( indexPiece );
+			placement.push_back( pieceSymbol( piece.type(), piece.isBlack() ) );
+		}
+		if ( emptyCells > 0 )
+		{
+			placement.push_back( char( '0' + emptyCells ) );
+		}
+		if ( row > 0 )
+		{
+			placement.push_back( '/' );
+		}
+	}
+	return placement;
+}
+
+const char ChessBoard::pieceSymbol( const ChessPiece::TYPE type, const bool isBlack )
+{
+	char symbol = '?';
+	switch ( type )
+	{
+		case ChessPiece::PAWN: symbol = 'P'; break;
+		case ChessPiece::ROOK: symbol = 'R'; break;
+		case ChessPiece::BISHOP: symbol = 'B'; break;
+		case ChessPiece::KNIGHT: symbol = 'N'; break;
+		case ChessPiece::QUEEN: symbol = 'Q'; break;
+		case ChessPiece::KING: symbol = 'K'; break;
+		default: break;
+	}
+	return isBlack ? char( symbol - 'A' + 'a' ) : symbol;
+}
+
+const ChessPiece::TYPE ChessBoard::pieceType( const char symbol, bool& isBlack )
+{
+	isBlack = ( symbol >= 'a' && symbol <= 'z' );
+	switch ( isBlack ? char( symbol - 'a' + 'A' ) : symbol )
+	{
+		case 'P': return ChessPiece::PAWN;
+		case 'R': return ChessPiece::ROOK;
+		case 'B': return ChessPiece::BISHOP;
+		case 'N': return ChessPiece::KNIGHT;
+		case 'Q': return ChessPiece::QUEEN;
+		case 'K': return ChessPiece::KING;
+		default: return ChessPiece::NONE;
+	}
+}
@@ -2,9 +2,15 @@
 #include "ChessPiece.h"
 #include <vector>
 #include <map>
+#include <string>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 class ChessPlayer;
 class ChessGame;
+struct ChessPosition;
 
 class ChessBoard
 {
@@ -31,8 +37,26 @@ public:
 	const ChessPiece& piece( const int indexPiece ) const;
 	const bool existsPiece( const int indexPiece ) const;
 	const bool existsPieceAt( const int row, const int column ) const;
+	const int indexAt( const int indexPosition ) const;
+	const int kingIndex( const bool isBlack ) const;
+	const uint32_t piecesMask( const bool isBlack ) const;
+	const uint32_t piecesMask( const bool isBlack, const ChessPiece::TYPE type ) const;
+	const uint64_t occupied() const;
+	const uint64_t occupied( const bool isBlack ) const;
+	static const int popFirstIndex( uint32_t& mask );
+	static const int countIndices( uint32_t mask );
 	const bool isDarkCell( const int row, const int column ) const;
 	const std::map< int, ChessPiece >& getPieces() const;
+	std::string getPlacementFEN() const;
+	const uint64_t hash() const;
+	const uint64_t pawnHash() const;
+	const bool pawnUsedDoubleStep( const int indexPiece ) const;
+	static const uint64_t zobristKey( const ChessPiece::TYPE type, const bool isBlack, const int indexPosition );
+	static const uint64_t zobristBlackToMove();
+	static const uint64_t zobristDoubleStep( const int indexPosition );
+	void getPosition( ChessPosition& position, const bool blackToMove ) const;
+	static const char pieceSymbol( const ChessPiece::TYPE type, const bool isBlack );
+	static const ChessPiece::TYPE pieceType( const char symbol, bool& isBlack );
 protected:
 	void clear();
 	void removePiece( const int indexPiece );
@@ -40,9 +64,21 @@ protected:
 	void movePieceTo( const int indexPiece, const int row, const int column );
 	void initInDefaultPositions();
 	void createPiece( const ChessPiece::TYPE type, const int indexPosition, const bool isBlack );
+	const bool loadPlacementFEN( const std::string& placement );
+	void setPawnUsedDoubleStep( const int indexPiece );
+	void clearPawnUsedDoubleStep( const int indexPiece );
+	void setPosition( const ChessPosition& position );
+private:
+	void insertPiece( const int indexPiece, const ChessPiece& piece );
 private:
 	std::map< int, ChessPiece > m_pieces;
+	std::vector< std::map< int, ChessPiece >::node_type > m_freeNodes; // Nodes of removed pieces, reused on insertion.
 	std::vector< int > m_positions;
+	uint64_t m_hash; // Zobrist key of the pieces placement, updated on every board mutation.
+	uint64_t m_pawnHash; // Same for the pawns only (used by the pawn structure cache).
+	uint32_t m_pawnsUsedDoubleStep; // Bit per piece index, kept when the piece is removed so it can be restored.
+	uint32_t m_pieceMasks[2][ChessPiece::KING + 1]; // Bit per piece index, by color and type (NONE holds every piece of the color).
+	uint64_t m_occupied[2]; // Bit per cell ( row * SIZE + column ), by color.
 };
 
 inline const bool ChessBoard::isDarkCell( const int row, const int column ) const
@@ -64,6 +100,62 @@ inline const ChessPiece& ChessBoard::pieceAt( const int row, const int column )
 	return m_pieces.at( m_positions.at( row * SIZE + column ) );
 }
 
+// Piece index at the cell (row * SIZE + column), -1 if empty.
+inline const int ChessBoard::indexAt( const int indexPosition ) const
+{
+	return m_positions[indexPosition];
+}
+
+// -1 once captured.
+inline const int ChessBoard::kingIndex( const bool isBlack ) const
+{
+	uint32_t mask = m_pieceMasks[isBlack][ChessPiece::KING];
+	return mask != 0 ? popFirstIndex( mask ) : -1;
+}
+
+inline const uint32_t ChessBoard::piecesMask( const bool isBlack ) const
+{
+	return m_pieceMasks[isBlack][ChessPiece::NONE];
+}
+
+inline const uint32_t ChessBoard::piecesMask( const bool isBlack, const ChessPiece::TYPE type ) const
+{
+	return m_pieceMasks[isBlack][type];
+}
+
+inline const uint64_t ChessBoard::occupied() const
+{
+	return m_occupied[0] | m_occupied[1];
+}
+
+inline const uint64_t ChessBoard::occupied( const bool isBlack ) const
+{
+	return m_occupied[isBlack];
+}
+
+/**
+ Removes the lowest piece index from a non empty mask and returns it.
+ Popping until the mask is empty visits the pieces in the same order as getPieces().
+*/
+inline const int ChessBoard::popFirstIndex( uint32_t& mask )
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward( &index, mask );
+#else
+	const int index = __builtin_ctz( mask );
+#endif
+	mask &= mask - 1;
+	return int( index );
+}
+
+inline const int ChessBoard::countIndices( uint32_t mask )
+{
+	int count = 0;
+	for ( ; mask != 0; mask &= mask - 1 ) count++;
+	return count;
+}
+
 inline const ChessPiece& ChessBoard::piece( const int indexPiece ) const
 {
 	return m_pieces.at( indexPiece );
@@ -72,4 +164,19 @@ inline const ChessPiece& ChessBoard::piece( const int indexPiece ) const
 inline const std::map< int, ChessPiece >& ChessBoard::getPieces() const
 {
 	return m_pieces;
+}
+
+inline const uint64_t ChessBoard::hash() const
+{
+	return m_hash;
+}
+
+inline const uint64_t ChessBoard::pawnHash() const
+{
+	return m_pawnHash;
+}
+
+inline const bool ChessBoard::pawnUsedDoubleStep( const int indexPiece ) const
+{
+	return ( m_pawnsUsedDoubleStep >> indexPiece ) & 1;
 }
\ No newline at end of file
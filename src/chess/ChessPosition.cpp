@@ -0,0 +1,110 @@
+#include "ChessPosition.h"
+#include <assert.h>
+#include <cstring>
+
+void ChessPosition::clear()
+{
+	std::memset( this, 0, sizeof( ChessPosition ) );
+	std::memset( cells, NO_PIECE, sizeof( cells ) );
+	kingSquare[0] = kingSquare[1] = -1;
+}
+
+// Scans the cells, kept out of the hot paths (kings are tracked in kingSquare).
+const int ChessPosition::square( const int indexPiece ) const
+{
+	for ( int i = 0; i < ChessBoard::CELLS_COUNT; i++ )
+	{
+		if ( cells[i] == indexPiece ) return i;
+	}
+	return -1;
+}
+
+// Kings included.
+const int ChessPosition::piecesCount() const
+{
+	int count = 0;
+	for ( int i = 0; i < ChessBoard::PIECES_COUNT; i++ )
+	{
+		count += pieces[i] != 0 ? 1 : 0;
+	}
+	return count;
+}
+
+void ChessPosition::addPiece( const int indexPiece, const ChessPiece::TYPE type, const bool isBlack, const int square )
+{
+	assert( cells[square] == NO_PIECE && !exists( indexPiece ) );
+	cells[square] = int8_t( indexPiece );
+	pieces[indexPiece] = pieceCode( type, isBlack );
+	uint64_t key = ChessBoard::zobristKey( type, isBlack, square );
+	if ( pawnUsedDoubleStep( indexPiece ) ) key ^= ChessBoard::zobristDoubleStep( square );
+	hash ^= key;
+	if ( type == ChessPiece::PAWN ) pawnHash ^= key;
+	if ( type == ChessPiece::KING ) kingSquare[isBlack] = int8_t( square );
+}
+
+// The piece code is cleared, the double step flag stays with the index like on the board.
+void ChessPosition::removePiece( const int square )
+{
+	const int indexPiece = cells[square];
+	assert( indexPiece != NO_PIECE );
+	const ChessPiece::TYPE pieceType = type( indexPiece );
+	const bool pieceIsBlack = isBlack( indexPiece );
+	uint64_t key = ChessBoard::zobristKey( pieceType, pieceIsBlack, square );
+	if ( pawnUsedDoubleStep( indexPiece ) ) key ^= ChessBoard::zobristDoubleStep( square );
+	hash ^= key;
+	if ( pieceType == ChessPiece::PAWN ) pawnHash ^= key;
+	if ( pieceType == ChessPiece::KING ) kingSquare[pieceIsBlack] = -1;
+	cells[square] = NO_PIECE;
+	pieces[indexPiece] = 0;
+}
+
+void ChessPosition::movePiece( const int from, const int to )
+{
+	const int indexPiece = cells[from];
+	assert( indexPiece != NO_PIECE && cells[to] == NO_PIECE );
+	const ChessPiece::TYPE pieceType = type( indexPiece );
+	const bool pieceIsBlack = isBlack( indexPiece );
+	uint64_t key = ChessBoard::zobristKey( pieceType, pieceIsBlack, from ) ^ ChessBoard::zobristKey( pieceType, pieceIsBlack, to );
+	if ( pawnUsedDoubleStep( indexPiece ) ) key ^= ChessBoard::zobristDoubleStep( from ) ^ ChessBoard::zobristDoubleStep( to );
+	hash ^= key;
+	if ( pieceType == ChessPiece::PAWN ) pawnHash ^= key;
+	if ( pieceType == ChessPiece::KING ) kingSquare[pieceIsBlack] = int8_t( to );
+	cells[from] = NO_PIECE;
+	cells[to] = int8_t( indexPiece );
+}
+
+void ChessPosition::setPawnUsedDoubleStep( const int square )
+{
+	const int indexPiece = cells[square];
+	assert( indexPiece != NO_PIECE && type( indexPiece ) == ChessPiece::PAWN );
+	if ( pawnUsedDoubleStep( indexPiece ) )
+	{
+		return;
+	}
+	const uint64_t key = ChessBoard::zobristDoubleStep( square );
+	hash ^= key;
+	pawnHash ^= key;
+	pawnsUsedDoubleStep |= 1u << indexPiece;
+}
+
+/**
+ Same effects as ChessGame::makeMove (capture and double step bookkeeping) and passes the turn.
+ Returns the index of the captured piece, NO_PIECE if the destination was empty.
+*/
+const int ChessPosition::makeMove( const int from, const int to )
+{
+	const int captured = cells[to];
+	if ( captured != NO_PIECE )
+	{
+		assert( isBlack( captured ) != isBlack( cells[from] ) );
+		removePiece( to );
+	}
+	movePiece( from, to );
+	const int rows = to / ChessBoard::SIZE - from / ChessBoard::SIZE;
+	if ( type( cells[to] ) == ChessPiece::PAWN && ( rows == 2 || rows == -2 ) )
+	{
+		setPawnUsedDoubleStep( to );
+	}
+	blackToMove = !blackToMove;
+	return captured;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include "ChessPiece.h"
+#include "ChessBoard.h"
+
+/**
+ Self-contained game state that can be copied with a memcpy, so search threads and snapshots can
+ clone positions without touching the allocator. Squares are row * 8 + column and pieces keep the
+ indices they have on the board they were taken from (see ChessBoard::getPosition).
+*/
+struct ChessPosition
+{
+	static const int8_t NO_PIECE = -1;
+
+	void clear();
+	static const uint8_t pieceCode( const ChessPiece::TYPE type, const bool isBlack );
+	const ChessPiece::TYPE type( const int indexPiece ) const;
+	const bool isBlack( const int indexPiece ) const;
+	const bool exists( const int indexPiece ) const;
+	const int square( const int indexPiece ) const;
+	const bool pawnUsedDoubleStep( const int indexPiece ) const;
+	const uint64_t key() const;
+	const int piecesCount() const;
+
+	// Mutations, both keys are updated like ChessBoard does.
+	void addPiece( const int indexPiece, const ChessPiece::TYPE type, const bool isBlack, const int square );
+	void removePiece( const int square );
+	void movePiece( const int from, const int to );
+	void setPawnUsedDoubleStep( const int square );
+	const int makeMove( const int from, const int to );
+
+	uint64_t hash; // Same value as ChessBoard::hash().
+	uint64_t pawnHash; // Same value as ChessBoard::pawnHash().
+	uint32_t pawnsUsedDoubleStep; // Bit per piece index.
+	int8_t cells[ChessBoard::CELLS_COUNT]; // Piece index by square.
+	uint8_t pieces[ChessBoard::PIECES_COUNT]; // Piece code by index: type | black << 3, 0 when captured.
+	int8_t kingSquare[2]; // By color, -1 once captured.
+	bool blackToMove;
+};
+
+static_assert( std::is_trivially_copyable< ChessPosition >::value, "ChessPosition must be copyable with memcpy" );
+static_assert( sizeof( ChessPosition ) <= 128, "ChessPosition must fit in two cache lines" );
+
+inline const uint8_t ChessPosition::pieceCode( const ChessPiece::TYPE type, const bool isBlack )
+{
+	return uint8_t( type | ( isBlack ? 8 : 0 ) );
+}
+
+inline const ChessPiece::TYPE ChessPosition::type( const int indexPiece ) const
+{
+	return ChessPiece::TYPE( pieces[indexPiece] & 7 );
+}
+
+inline const bool ChessPosition::isBlack( const int indexPiece ) const
+{
+	return ( pieces[indexPiece] & 8 ) != 0;
+}
+
+inline const bool ChessPosition::exists( const int indexPiece ) const
+{
+	return pieces[indexPiece] != 0;
+}
+
+inline const bool ChessPosition::pawnUsedDoubleStep( const int indexPiece ) const
+{
+	return ( pawnsUsedDoubleStep >> indexPiece ) & 1;
+}
+
+// Includes the side to move, like ChessGame::positionHash.
+inline const uint64_t ChessPosition::key() const
+{
+	return blackToMove ? hash ^ ChessBoard::zobristBlackToMove() : hash;
+}
@@ -0,0 +1,226 @@
+#include "ChessEvaluation.h"
+#include "../chess/ChessBoard.h"
+#include "../chess/ChessPosition.h"
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+	const int PASSED_BONUS[ChessBoard::SIZE] = { 0, 5, 10, 20, 35, 60, 100, 100 }; // By rows advanced.
+	const int ISOLATED_PENALTY = 12;
+	const int DOUBLED_PENALTY = 10;
+	const int SHIELD_BONUS = 8;
+
+	struct PawnTable
+	{
+		// Zeroed entries are valid: key 0 is the position without pawns.
+		std::vector< ChessPawnEntry > entries;
+
+		PawnTable() :
+			entries( size_t( 1 ) << ChessEvaluation::PAWN_TABLE_BITS, ChessPawnEntry() )
+		{}
+	};
+
+	inline const uint64_t squareBit( const int row, const int column )
+	{
+		return 1ull << ( row * ChessBoard::SIZE + column );
+	}
+
+	// Squares ahead of the pawn on its file and the adjacent ones.
+	const uint64_t frontSpan( const int row, const int column, const bool isBlack )
+	{
+		uint64_t span = 0;
+		const int direction = isBlack ? -1 : 1;
+		for ( int r = row + direction; r >= 0 && r < ChessBoard::SIZE; r += direction )
+		{
+			for ( int c = std::max( column - 1, 0 ); c <= std::min( column + 1, ChessBoard::SIZE - 1 ); c++ )
+			{
+				span |= squareBit( r, c );
+			}
+		}
+		return span;
+	}
+}
+
+const int ChessEvaluation::pieceValue( const ChessPiece::TYPE type )
+{
+	switch ( type )
+	{
+		case ChessPiece::PAWN: return 100;
+		case ChessPiece::KNIGHT: return 320;
+		case ChessPiece::BISHOP: return 330;
+		case ChessPiece::ROOK: return 500;
+		case ChessPiece::QUEEN: return 900;
+		default: return 0;
+	}
+}
+
+/**
+ Score of the position for the given side (centipawns).
+*/
+const int ChessEvaluation::evaluate( const ChessBoard& board, const bool isBlack )
+{
+	int material[2] = { 0, 0 };
+	int kingSquare[2] = { -1, -1 };
+	for ( int color = 0; color < 2; color++ )
+	{
+		for ( int type = ChessPiece::PAWN; type <= ChessPiece::KING; type++ )
+		{
+			material[color] += ChessBoard::countIndices( board.piecesMask( color == 1, ChessPiece::TYPE( type ) ) ) * pieceValue( ChessPiece::TYPE( type ) );
+		}
+		const int indexKing = board.kingIndex( color == 1 );
+		if ( indexKing != -1 )
+		{
+			const auto& king = board.piece( indexKing );
+			kingSquare[color] = king.row() * ChessBoard::SIZE + king.column();
+		}
+	}
+	return combine( material, kingSquare, pawnEntry( board ), isBlack );
+}
+
+// Same score as the board version, for the search.
+const int ChessEvaluation::evaluate( const ChessPosition& position, const bool isBlack )
+{
+	int material[2] = { 0, 0 };
+	for ( int indexPiece = 0; indexPiece < ChessBoard::PIECES_COUNT; indexPiece++ )
+	{
+		if ( position.exists( indexPiece ) )
+		{
+			material[position.isBlack( indexPiece )] += pieceValue( position.type( indexPiece ) );
+		}
+	}
+	const int kingSquare[2] = { position.kingSquare[0], position.kingSquare[1] };
+	return combine( material, kingSquare, pawnEntry( position ), isBlack );
+}
+
+const int ChessEvaluation::combine( const int material[2], const int kingSquare[2], const ChessPawnEntry& pawns, const bool isBlack )
+{
+	int score[2] = { material[0], material[1] };
+	for ( int color = 0; color < 2; color++ )
+	{
+		score[color] += pawns.score[color];
+		if ( kingSquare[color] != -1 )
+		{
+			score[color] += pawnShield( pawns.pawns[color], kingSquare[color], color == 1 );
+		}
+	}
+	return score[isBlack] - score[!isBlack];
+}
+
+ChessPawnEntry& ChessEvaluation::pawnSlot( const uint64_t key )
+{
+	static thread_local PawnTable table;
+	return table.entries[key & ( ( uint64_t( 1 ) << PAWN_TABLE_BITS ) - 1 )];
+}
+
+const ChessPawnEntry& ChessEvaluation::pawnEntry( const ChessBoard& board )
+{
+	const uint64_t key = board.pawnHash();
+	ChessPawnEntry& entry = pawnSlot( key );
+	if ( entry.key != key )
+	{
+		entry.pawns[0] = entry.pawns[1] = 0;
+		for ( int color = 0; color < 2; color++ )
+		{
+			for ( uint32_t mask = board.piecesMask( color == 1, ChessPiece::PAWN ); mask != 0; )
+			{
+				const auto& piece = board.piece( ChessBoard::popFirstIndex( mask ) );
+				entry.pawns[color] |= squareBit( piece.row(), piece.column() );
+			}
+		}
+		evaluatePawns( entry );
+		entry.key = key;
+	}
+	return entry;
+}
+
+const ChessPawnEntry& ChessEvaluation::pawnEntry( const ChessPosition& position )
+{
+	const uint64_t key = position.pawnHash;
+	ChessPawnEntry& entry = pawnSlot( key );
+	if ( entry.key != key )
+	{
+		entry.pawns[0] = entry.pawns[1] = 0;
+		for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+		{
+			const int indexPiece = position.cells[square];
+			if ( indexPiece != ChessPosition::NO_PIECE && position.type( indexPiece ) == ChessPiece::PAWN )
+			{
+				entry.pawns[position.isBlack( indexPiece )] |= 1ull << square;
+			}
+		}
+		evaluatePawns( entry );
+		entry.key = key;
+	}
+	return entry;
+}
+
+// Fills the scores of an entry from its pawn bitboards.
+void ChessEvaluation::evaluatePawns( ChessPawnEntry& entry )
+{
+	int squares[2][ChessBoard::PIECES_COUNT / 2];
+	int counts[2] = { 0, 0 };
+	int files[2][ChessBoard::SIZE] = {};
+	for ( int color = 0; color < 2; color++ )
+	{
+		for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+		{
+			if ( ( entry.pawns[color] >> square ) & 1 )
+			{
+				squares[color][counts[color]++] = square;
+				files[color][square % ChessBoard::SIZE]++;
+			}
+		}
+	}
+
+	for ( int color = 0; color < 2; color++ )
+	{
+		const bool isBlack = ( color == 1 );
+		int score = 0;
+		entry.passed[color] = 0;
+		for ( int i = 0; i < counts[color]; i++ )
+		{
+			const int row = squares[color][i] / ChessBoard::SIZE;
+			const int column = squares[color][i] % ChessBoard::SIZE;
+			const bool hasLeft = column > 0 && files[color][column - 1] > 0;
+			const bool hasRight = column < ChessBoard::SIZE - 1 && files[color][column + 1] > 0;
+			if ( !hasLeft && !hasRight )
+			{
+				score -= ISOLATED_PENALTY;
+			}
+			if ( ( entry.pawns[!color] & frontSpan( row, column, isBlack ) ) == 0 )
+			{
+				entry.passed[color] |= squareBit( row, column );
+				const int advanced = isBlack ? ChessBoard::SIZE - 2 - row : row - 1;
+				score += PASSED_BONUS[std::max( advanced, 0 )];
+			}
+		}
+		for ( int column = 0; column < ChessBoard::SIZE; column++ )
+		{
+			if ( files[color][column] > 1 )
+			{
+				score -= DOUBLED_PENALTY * ( files[color][column] - 1 );
+			}
+		}
+		entry.score[color] = score;
+	}
+}
+
+// Own pawns on the three squares in front of the king (full bonus) or the row after (half bonus).
+const int ChessEvaluation::pawnShield( const uint64_t pawns, const int kingSquare, const bool isBlack )
+{
+	const int direction = isBlack ? -1 : 1;
+	const int row = kingSquare / ChessBoard::SIZE;
+	const int column = kingSquare % ChessBoard::SIZE;
+	int bonus = 0;
+	for ( int distance = 1; distance <= 2; distance++ )
+	{
+		const int r = row + direction * distance;
+		if ( r < 0 || r >= ChessBoard::SIZE ) break;
+		for ( int c = std::max( column - 1, 0 ); c <= std::min( column + 1, ChessBoard::SIZE - 1 ); c++ )
+		{
+			if ( pawns & squareBit( r, c ) ) bonus += SHIELD_BONUS / distance;
+		}
+	}
+	return bonus;
+}
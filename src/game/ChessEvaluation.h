@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include "../chess/ChessPiece.h"
+
+class ChessBoard;
+struct ChessPosition;
+
+/**
+ Pawn structure of a position, cached by pawn key (see ChessBoard::pawnHash).
+ Bitboards use bit ( row * 8 + column ).
+*/
+struct ChessPawnEntry
+{
+	uint64_t key;
+	uint64_t pawns[2]; // By color.
+	uint64_t passed[2];
+	int score[2]; // Passed, isolated and doubled pawns.
+};
+
+/**
+ Static evaluation: material, pawn structure and pawn shield of the kings.
+ Pawn structures change rarely, so they are cached in a table owned by the calling thread (no locking).
+*/
+class ChessEvaluation
+{
+public:
+	static const int PAWN_TABLE_BITS = 14;
+public:
+	static const int evaluate( const ChessBoard& board, const bool isBlack );
+	static const int evaluate( const ChessPosition& position, const bool isBlack );
+	static const int pieceValue( const ChessPiece::TYPE type );
+
+	// The entry belongs to the thread table, it is valid until the next probe of the same thread.
+	static const ChessPawnEntry& pawnEntry( const ChessBoard& board );
+	static const ChessPawnEntry& pawnEntry( const ChessPosition& position );
+private:
+	static ChessPawnEntry& pawnSlot( const uint64_t key );
+	static void evaluatePawns( ChessPawnEntry& entry );
+	static const int combine( const int material[2], const int kingSquare[2], const ChessPawnEntry& pawns, const bool isBlack );
+	static const int pawnShield( const uint64_t pawns, const int kingSquare, const bool isBlack );
+};
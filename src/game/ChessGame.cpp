@@ -2,19 +2,87 @@
 #include "ChessPlayer.h"
 #include <assert.h>
 #include <iostream>
-#include <ctime>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
+#include "ChessOpeningBook.h"
+#include "ChessSearch.h"
+#include "ChessProfiler.h"
+#include "ChessTracer.h"
 #include "../chess/ChessBoard.h"
+#include "../chess/ChessPosition.h"
+
+namespace
+{
+	/**
+	 Reverse lookup tables built from the rules paths: the squares a knight or a king could come
+	 from, and the squares seen from a square in each sliding direction (nearest first).
+	*/
+	struct AttackTables
+	{
+		static const int DIRECTIONS = 8; // Orthogonal ones first.
+		int leaps[ChessPiece::KING + 1][ChessBoard::CELLS_COUNT][8];
+		int leapsCount[ChessPiece::KING + 1][ChessBoard::CELLS_COUNT];
+		int rays[DIRECTIONS][ChessBoard::CELLS_COUNT][ChessBoard::SIZE];
+		int raysCount[DIRECTIONS][ChessBoard::CELLS_COUNT];
+
+		AttackTables()
+		{
+			const auto& rules = ChessRules::instance();
+			for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+			{
+				for ( const ChessPiece::TYPE type : { ChessPiece::KNIGHT, ChessPiece::KING } )
+				{
+					leapsCount[type][square] = 0;
+					for ( const auto& cp : rules.getPaths( type ) )
+					{
+						const CellNode& node = cp.getNode( cp.totalSteps() );
+						const int r = square / ChessBoard::SIZE + node.r;
+						const int c = square % ChessBoard::SIZE + node.c;
+						if ( r < 0 || r >= ChessBoard::SIZE || c < 0 || c >= ChessBoard::SIZE ) continue;
+						leaps[type][square][leapsCount[type][square]++] = r * ChessBoard::SIZE + c;
+					}
+				}
+				// The queen paths are the rook directions followed by the bishop ones.
+				int direction = 0;
+				for ( const auto& cp : rules.getPaths( ChessPiece::QUEEN ) )
+				{
+					raysCount[direction][square] = 0;
+					for ( int i = 1; i <= cp.totalSteps(); i++ )
+					{
+						const int r = square / ChessBoard::SIZE + cp.getNode( i ).r;
+						const int c = square % ChessBoard::SIZE + cp.getNode( i ).c;
+						if ( r < 0 || r >= ChessBoard::SIZE || c < 0 || c >= ChessBoard::SIZE ) break;
+						rays[direction][square][raysCount[direction][square]++] = r * ChessBoard::SIZE + c;
+					}
+					direction++;
+				}
+			}
+		}
+	};
+
+	const AttackTables& attackTables()
+	{
+		static const AttackTables tables;
+		return tables;
+	}
+}
 
 ChessGame::ChessGame( const ChessGameSettings& config ) :
 	m_board( nullptr ),
 	m_rules( nullptr ),
+	m_openingBook( nullptr ),
+	m_tablebase( nullptr ),
+	m_recordStream( nullptr ),
+	m_statsStream( nullptr ),
+	m_statsDumpTurns( 0 ),
 	m_playerW( nullptr ),
 	m_playerB( nullptr ),
 	m_activePlayer( nullptr ),
 	m_finished( false ),
 	m_inInBlackTurn( false ),
 	m_settings( config ),
+	m_pieceMoves( ChessBoard::PIECES_COUNT ),
 	m_turnCounter( 0 )
 {
 	createGame();
@@ -27,10 +95,13 @@ ChessGame::~ChessGame()
 
 void ChessGame::clear()
 {
+	writeRecord();
+	m_record.clear();
+	m_finished = false;
+
 	delete m_board;
 	delete m_playerW;
 	delete m_playerB;
-	delete m_rules;
 	m_board = nullptr;
 	m_rules = nullptr;
 	m_playerW = nullptr;
@@ -45,19 +116,129 @@ void ChessGame::createGame()
 	m_board = new ChessBoard();
 	m_playerW = new ChessPlayer( m_board, this, false );
 	m_playerB = new ChessPlayer( m_board, this, true );
-	m_rules = new ChessRules();
+	m_rules = &ChessRules::instance();
 
 	togglePlayerInTurn();
 
-	std::srand( int( std::time( nullptr ) ) );
+	seedRandom( m_settings.seed() != 0 ? m_settings.seed() : ChessRandom::entropySeed() );
 
 	std::cout << "-------------ChessGame::createGame---------------" << std::endl;
 }
 
+/**
+ Starts a new game in place: the board, the players and their containers are reused, nothing is freed.
+*/
 void ChessGame::resetGame()
 {
-	clear();
-	createGame();
+	writeRecord();
+	resetPosition();
+	seedRandom( m_random.next() );
+}
+
+/**
+ Restarts the random decisions from a seed, kept in the game record so the game can be
+ replayed. The next games (resetGame) and loaded positions take their seed from this one.
+*/
+void ChessGame::seedRandom( const uint64_t seed )
+{
+	m_random.seed( seed );
+	m_record.seed = seed;
+	m_playerW->clearSearch();
+	m_playerB->clearSearch();
+}
+
+/**
+ Both players search with these (not owned) until lendSearches( nullptr, nullptr ), so a process
+ hosting many games can keep one search per thread instead of one per game. The search table is
+ cleared first: the decisions do not depend on the games that used it before.
+*/
+void ChessGame::lendSearches( ChessSearch* search, ChessMCTS* mcts )
+{
+	if ( search != nullptr )
+	{
+		search->clear();
+	}
+	m_playerW->lendSearches( search, mcts );
+	m_playerB->lendSearches( search, mcts );
+}
+
+/**
+ Plays a recorded game again through the decisions of the players, without the state machine
+ ticks and without output: from the start position and seed of the record, each decision must
+ be the recorded move. Returns the moves reproduced (all of them if the game is the same); the
+ game stays in the position before the first different move, divergentMove gets the move
+ decided there (0 if none).
+*/
+const size_t ChessGame::replay( const ChessGameRecord& record, uint16_t* divergentMove )
+{
+	if ( !loadStart( record ) )
+	{
+		return 0;
+	}
+	seedRandom( record.seed );
+
+	for ( size_t i = 0; i < record.moves.size(); i++ )
+	{
+		CellNode from, to;
+		uint16_t move = 0;
+		if ( !m_finished )
+		{
+			m_activePlayer->generateDecision();
+			move = m_activePlayer->decision( from, to ) ? ChessOpeningBook::encodeMove( from, to ) : 0;
+		}
+		if ( move != record.moves[i] )
+		{
+			if ( divergentMove != nullptr ) *divergentMove = move;
+			return i;
+		}
+		makeMove( m_board->indexAt( from.r * ChessBoard::SIZE + from.c ), to );
+		togglePlayerInTurn();
+	}
+	return record.moves.size();
+}
+
+/**
+ Sets up the start position of a record: the default one, its FEN, or the exact position when
+ the game was started with loadPosition (the FEN is loaded first for the turn counter).
+*/
+const bool ChessGame::loadStart( const ChessGameRecord& record )
+{
+	if ( record.startFEN.empty() && !record.hasStartPosition )
+	{
+		resetPosition();
+		return true;
+	}
+	if ( !record.startFEN.empty() && !loadFEN( record.startFEN ) )
+	{
+		return false;
+	}
+	return !record.hasStartPosition || loadPosition( record.startPosition );
+}
+
+/**
+ Puts the pieces back in their default positions without recreating the game objects.
+*/
+void ChessGame::resetPosition()
+{
+	m_board->clear();
+	m_board->initInDefaultPositions();
+	clearPieceMoves();
+	m_playerW->reset();
+	m_playerB->reset();
+	m_record.clear();
+	m_finished = false;
+	m_inInBlackTurn = false;
+	m_turnCounter = 0;
+	togglePlayerInTurn();
+}
+
+// Appends the finished game to the record stream, if any.
+void ChessGame::writeRecord()
+{
+	if ( m_recordStream != nullptr && m_finished )
+	{
+		m_record.write( *m_recordStream );
+	}
 }
 
 void ChessGame::togglePlayerInTurn()
@@ -73,10 +254,16 @@ void ChessGame::togglePlayerInTurn()
 	}
 	m_activePlayer->startTurn();
 	m_turnCounter++;
+	ChessTracer::instant( "turn", "game", "turn", m_turnCounter );
+	if ( m_statsStream != nullptr && m_statsDumpTurns > 0 && m_turnCounter % m_statsDumpTurns == 0 )
+	{
+		ChessProfiler::dump( *m_statsStream );
+	}
 }
 
 void ChessGame::update( const int dt )
 {
+	CHESS_TRACE_SCOPE( "update", "game" );
 	m_activePlayer->update( dt );
 
 	if ( m_activePlayer->getState() == ChessPlayer::ST_END_TURN )
@@ -89,7 +276,12 @@ void ChessGame::update( const int dt )
 	}
 }
 
-const std::vector< ChessPath* >& ChessGame::getPotentialPaths( const ChessPiece::TYPE type ) const
+const uint64_t ChessGame::positionHash() const
+{
+	return m_board->hash() ^ ( m_inInBlackTurn ? ChessBoard::zobristBlackToMove() : 0 );
+}
+
+const ChessPathRange ChessGame::getPotentialPaths( const ChessPiece::TYPE type ) const
 {
 	return m_rules->getPaths( type );
 }
@@ -108,33 +300,491 @@ const char* ChessGame::namePiece( const ChessPiece::TYPE type )
 	}
 }
 
-// Helper methods.
+// Moves.
 
-void ChessGame::getPossibleAssassinsOf( const int indexPieceVictim, std::vector< int >& assassins ) const
+/**
+ Applies a move on the board: capture, double step bookkeeping and game record.
+ Returns the type of the captured piece (NONE if the destination was empty). undo, if given,
+ gets what unmakeMove needs to take the move back. The turn does not change.
+*/
+const ChessPiece::TYPE ChessGame::makeMove( const int indexPiece, const CellNode& node, ChessMoveUndo* undo )
 {
-	assert( m_board->existsPiece( indexPieceVictim ) );
-	const auto& victimPiece = m_board->piece( indexPieceVictim );
-	std::map< int, std::vector< CellNode > > possiblePositions;
-	getPossiblePositions( possiblePositions, !victimPiece.isBlack(), true, false );
-	if ( !possiblePositions.empty() )
+	assert( m_board->existsPiece( indexPiece ) );
+	const auto& piece = m_board->piece( indexPiece );
+	const bool isBlack = piece.isBlack();
+	const CellNode from( piece.row(), piece.column() );
+	if ( undo != nullptr )
 	{
-		for ( const auto&[indexPiece, positions] : possiblePositions )
+		*undo = { indexPiece, from.r, from.c, -1, ChessPiece::NONE, false, m_record.result, m_finished };
+	}
+
+	ChessPiece::TYPE capturedType = ChessPiece::NONE;
+	if ( m_board->existsPieceAt( node.r, node.c ) )
+	{
+		const auto& victim = m_board->pieceAt( node.r, node.c );
+		assert( victim.isBlack() != isBlack );
+		capturedType = victim.type();
+		if ( undo != nullptr )
 		{
-			for ( const auto& position : positions )
+			undo->indexCaptured = victim.index();
+			undo->capturedType = capturedType;
+		}
+		m_board->removePiece( victim.index() );
+	}
+
+	m_board->movePieceTo( indexPiece, node.r, node.c );
+	clearFilteredMoves();
+
+	// Save double step if pawn.
+	if ( piece.type() == ChessPiece::PAWN && std::abs( node.r - from.r ) == 2 && !m_board->pawnUsedDoubleStep( indexPiece ) )
+	{
+		m_board->setPawnUsedDoubleStep( indexPiece );
+		if ( undo != nullptr ) undo->doubleStep = true;
+	}
+
+	m_record.moves.push_back( ChessOpeningBook::encodeMove( from, node ) );
+	if ( capturedType == ChessPiece::KING )
+	{
+		m_record.result = isBlack ? ChessGameRecord::BLACK_WINS : ChessGameRecord::WHITE_WINS;
+		m_finished = true;
+	}
+	return capturedType;
+}
+
+/**
+ Takes back the last makeMove, much cheaper than loadPosition for walking a tree of moves (the
+ lists of pieceMoves stay valid for the pieces the move did not touch).
+*/
+void ChessGame::unmakeMove( const ChessMoveUndo& undo )
+{
+	const auto& piece = m_board->piece( undo.indexPiece );
+	const int row = piece.row();
+	const int column = piece.column();
+	if ( undo.doubleStep )
+	{
+		m_board->clearPawnUsedDoubleStep( undo.indexPiece );
+	}
+	m_board->movePieceTo( undo.indexPiece, undo.fromRow, undo.fromColumn );
+	if ( undo.indexCaptured != -1 )
+	{
+		m_board->restorePiece( undo.indexCaptured, !piece.isBlack(), undo.capturedType, row, column );
+	}
+	clearFilteredMoves();
+	m_record.moves.pop_back();
+	m_record.result = undo.result;
+	m_finished = undo.finished;
+}
+
+/**
+ Plays a move for the side in turn outside of the players state machine (replays, imports...).
+ Returns false if the move is not possible in the current position.
+*/
+const bool ChessGame::playMove( const CellNode& from, const CellNode& to )
+{
+	if ( m_finished || !m_board->existsPieceAt( from.r, from.c ) )
+	{
+		return false;
+	}
+	const auto& piece = m_board->pieceAt( from.r, from.c );
+	if ( piece.isBlack() != m_inInBlackTurn )
+	{
+		return false;
+	}
+	const int indexPiece = piece.index();
+	const auto& positions = getPossiblePositionsByPiece( indexPiece, false, false );
+	if ( std::find( positions.begin(), positions.end(), to ) == positions.end() )
+	{
+		return false;
+	}
+	makeMove( indexPiece, to );
+	if ( !m_finished )
+	{
+		togglePlayerInTurn();
+	}
+	return true;
+}
+
+/**
+ Parses a move given in coordinates ("e2e4") or in standard algebraic notation ("Nf3", "exd5")
+ for the side in turn. Castling and promotions do not exist in this ruleset.
+*/
+const bool ChessGame::parseMove( const std::string& text, CellNode& from, CellNode& to ) const
+{
+	std::string move;
+	for ( const char c : text )
+	{
+		if ( c != 'x' && c != '-' && c != '+' && c != '#' && c != '!' && c != '?' ) move.push_back( c );
+	}
+	auto isFile = []( const char c ) { return c >= 'a' && c <= 'h'; };
+	auto isRank = []( const char c ) { return c >= '1' && c <= '8'; };
+
+	if ( move.size() == 4 && isFile( move[0] ) && isRank( move[1] ) && isFile( move[2] ) && isRank( move[3] ) )
+	{
+		from = CellNode( move[1] - '1', move[0] - 'a' );
+		to = CellNode( move[3] - '1', move[2] - 'a' );
+		return true;
+	}
+
+	if ( move.size() < 2 || !isFile( move[move.size() - 2] ) || !isRank( move.back() ) )
+	{
+		return false;
+	}
+	bool isBlack = false;
+	ChessPiece::TYPE type = ChessPiece::PAWN;
+	size_t begin = 0;
+	if ( move[0] >= 'A' && move[0] <= 'Z' )
+	{
+		type = ChessBoard::pieceType( move[0], isBlack );
+		if ( type == ChessPiece::NONE || type == ChessPiece::PAWN ) return false;
+		begin = 1;
+	}
+	to = CellNode( move.back() - '1', move[move.size() - 2] - 'a' );
+	int fromRow = -1, fromColumn = -1;
+	for ( size_t i = begin; i + 2 < move.size(); i++ )
+	{
+		if ( isFile( move[i] ) ) fromColumn = move[i] - 'a';
+		else if ( isRank( move[i] ) ) fromRow = move[i] - '1';
+		else return false;
+	}
+
+	int candidates = 0;
+	for ( uint32_t mask = m_board->piecesMask( m_inInBlackTurn, type ); mask != 0; )
+	{
+		const int indexPiece = ChessBoard::popFirstIndex( mask );
+		const auto& piece = m_board->piece( indexPiece );
+		if ( ( fromRow != -1 && piece.row() != fromRow ) || ( fromColumn != -1 && piece.column() != fromColumn ) ) continue;
+		const auto& positions = getPossiblePositionsByPiece( indexPiece, false, false );
+		if ( std::find( positions.begin(), positions.end(), to ) != positions.end() )
+		{
+			from = CellNode( piece.row(), piece.column() );
+			candidates++;
+		}
+	}
+	return candidates == 1;
+}
+
+std::string ChessGame::moveToString( const CellNode& from, const CellNode& to )
+{
+	std::string text( 4, ' ' );
+	text[0] = char( 'a' + from.c );
+	text[1] = char( '1' + from.r );
+	text[2] = char( 'a' + to.c );
+	text[3] = char( '1' + to.r );
+	return text;
+}
+
+// Position import / export.
+
+/**
+ Loads a position given in Forsyth-Edwards Notation without replaying any move.
+ Castling and en passant fields are accepted but ignored since this ruleset has neither.
+ Pawns outside of their initial row are considered to have used their double step.
+*/
+const bool ChessGame::loadFEN( const std::string& fen )
+{
+	std::istringstream stream( fen );
+	std::string placement, side = "w", castling = "-", enPassant = "-";
+	int halfMoves = 0, fullMoves = 1;
+	stream >> placement >> side >> castling >> enPassant >> halfMoves >> fullMoves;
+
+	if ( side != "w" && side != "b" )
+	{
+		return false;
+	}
+	if ( !m_board->loadPlacementFEN( placement ) )
+	{
+		return false;
+	}
+	clearPieceMoves();
+
+	for ( const bool isBlack : { false, true } )
+	{
+		const int initialRow = isBlack ? ChessBoard::SIZE - 2 : 1;
+		for ( uint32_t mask = m_board->piecesMask( isBlack, ChessPiece::PAWN ); mask != 0; )
+		{
+			const int indexPiece = ChessBoard::popFirstIndex( mask );
+			if ( m_board->piece( indexPiece ).row() != initialRow )
 			{
-				CellNode node( victimPiece.row(), victimPiece.column() );
-				if ( node == position )
-				{
-					assassins.push_back( indexPiece );
-					break;
-				}
+				m_board->setPawnUsedDoubleStep( indexPiece );
 			}
 		}
 	}
+
+	// Black always opens the game here, so each full move starts with black.
+	const bool isBlack = ( side == "b" );
+	fullMoves = std::max( fullMoves, 1 );
+	m_turnCounter = 2 * ( fullMoves - 1 ) + ( isBlack ? 0 : 1 );
+	m_inInBlackTurn = !isBlack;
+	m_finished = false;
+	m_record.clear();
+	seedRandom( m_random.next() );
+	togglePlayerInTurn();
+	m_record.startFEN = getFEN();
+	return true;
+}
+
+std::string ChessGame::getFEN() const
+{
+	std::string fen = m_board->getPlacementFEN();
+	fen.append( m_inInBlackTurn ? " b" : " w" );
+	fen.append( " - - 0 " );
+	fen.append( std::to_string( std::max( ( m_turnCounter + 1 ) / 2, 1 ) ) );
+	return fen;
+}
+
+void ChessGame::getPosition( ChessPosition& position ) const
+{
+	m_board->getPosition( position, m_inInBlackTurn );
+}
+
+/**
+ Restores a snapshot taken with getPosition. The game record restarts from it.
+*/
+const bool ChessGame::loadPosition( const ChessPosition& position )
+{
+	if ( position.kingSquare[0] == -1 || position.kingSquare[1] == -1 )
+	{
+		return false;
+	}
+	m_board->setPosition( position );
+	clearPieceMoves();
+	m_inInBlackTurn = !position.blackToMove;
+	m_turnCounter--; // Kept, togglePlayerInTurn counts the turn again.
+	m_finished = false;
+	togglePlayerInTurn();
+	m_record.clear();
+	m_record.startFEN = getFEN();
+	m_record.hasStartPosition = true;
+	m_record.startPosition = position;
+	seedRandom( m_random.next() );
+	return true;
+}
+
+/**
+ Reads a whole EPD suite in one pass. Each entry keeps a FEN built from the first four
+ fields (plus hmvc / fmvn when given) so it can be fed straight into loadFEN.
+*/
+const bool ChessGame::loadEPDSuite( const std::string& path, std::vector< ChessEPDEntry >& entries )
+{
+	std::ifstream file( path, std::ios::binary );
+	if ( !file )
+	{
+		return false;
+	}
+	std::string content;
+	file.seekg( 0, std::ios::end );
+	content.resize( size_t( file.tellg() ) );
+	file.seekg( 0, std::ios::beg );
+	file.read( &content[0], std::streamsize( content.size() ) );
+
+	size_t lineBegin = 0;
+	while ( lineBegin < content.size() )
+	{
+		size_t lineEnd = content.find( '\n', lineBegin );
+		if ( lineEnd == std::string::npos ) lineEnd = content.size();
+		std::string line = content.substr( lineBegin, lineEnd - lineBegin );
+		lineBegin = lineEnd + 1;
+
+		if ( !line.empty() && line.back() == '\r' ) line.pop_back();
+		if ( line.empty() || line[0] == '#' ) continue;
+
+		std::istringstream stream( line );
+		std::string fields[4];
+		if ( !( stream >> fields[0] >> fields[1] >> fields[2] >> fields[3] ) )
+		{
+			continue;
+		}
+
+		ChessEPDEntry entry;
+		std::string halfMoves = "0", fullMoves = "1";
+		std::string operation;
+		while ( std::getline( stream, operation, ';' ) )
+		{
+			const size_t opBegin = operation.find_first_not_of( " \t" );
+			if ( opBegin == std::string::npos ) continue;
+			const size_t opEnd = operation.find_first_of( " \t", opBegin );
+			std::string opcode = operation.substr( opBegin, opEnd - opBegin );
+			std::string operands;
+			if ( opEnd != std::string::npos )
+			{
+				const size_t argBegin = operation.find_first_not_of( " \t", opEnd );
+				if ( argBegin != std::string::npos ) operands = operation.substr( argBegin );
+			}
+			if ( operands.size() >= 2 && operands.front() == '"' && operands.back() == '"' )
+			{
+				operands = operands.substr( 1, operands.size() - 2 );
+			}
+			if ( opcode == "hmvc" ) halfMoves = operands;
+			if ( opcode == "fmvn" ) fullMoves = operands;
+			entry.operations.emplace_back( std::move( opcode ), std::move( operands ) );
+		}
+		entry.fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " " + halfMoves + " " + fullMoves;
+		entries.push_back( std::move( entry ) );
+	}
+	return true;
+}
+
+/**
+ Replays one PGN game (tags and movetext) on this game and fills its record.
+ Games starting from a [FEN] tag keep it in the record. Replay stops at the first move
+ that cannot be resolved, the moves before it are kept.
+*/
+const bool ChessGame::loadPGN( const std::string& text, ChessGameRecord& record )
+{
+	std::string result, fen, movetext;
+	std::istringstream lines( text );
+	std::string line;
+	while ( std::getline( lines, line ) )
+	{
+		if ( !line.empty() && line.back() == '\r' ) line.pop_back();
+		if ( !line.empty() && line[0] == '[' )
+		{
+			const size_t nameEnd = line.find( ' ' );
+			const size_t valueBegin = line.find( '"' );
+			const size_t valueEnd = line.rfind( '"' );
+			if ( nameEnd == std::string::npos || valueBegin == std::string::npos || valueEnd <= valueBegin ) continue;
+			const std::string name = line.substr( 1, nameEnd - 1 );
+			const std::string value = line.substr( valueBegin + 1, valueEnd - valueBegin - 1 );
+			if ( name == "Result" ) result = value;
+			if ( name == "FEN" ) fen = value;
+			continue;
+		}
+		movetext.append( line.substr( 0, line.find( ';' ) ) );
+		movetext.push_back( ' ' );
+	}
+
+	if ( fen.empty() )
+	{
+		resetPosition();
+	}
+	else if ( !loadFEN( fen ) )
+	{
+		return false;
+	}
+
+	// Drop comments, variations and NAGs, then play every move token.
+	std::string tokens;
+	int commentDepth = 0, variationDepth = 0;
+	for ( const char c : movetext )
+	{
+		if ( c == '{' ) commentDepth++;
+		else if ( c == '}' ) commentDepth = std::max( commentDepth - 1, 0 );
+		else if ( commentDepth > 0 ) continue;
+		else if ( c == '(' ) variationDepth++;
+		else if ( c == ')' ) variationDepth = std::max( variationDepth - 1, 0 );
+		else if ( variationDepth == 0 ) tokens.push_back( c );
+	}
+	std::istringstream stream( tokens );
+	std::string token;
+	bool valid = true;
+	while ( valid && stream >> token )
+	{
+		if ( token[0] == '$' ) continue;
+		if ( token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*" )
+		{
+			result = token;
+			break;
+		}
+		const size_t moveBegin = token.find_first_not_of( "0123456789." );
+		if ( moveBegin == std::string::npos ) continue;
+		CellNode from, to;
+		valid = parseMove( token.substr( moveBegin ), from, to ) && playMove( from, to );
+	}
+
+	record = m_record;
+	if ( record.result == ChessGameRecord::UNKNOWN )
+	{
+		record.result = ChessGameRecord::resultFromString( result );
+	}
+	return !record.moves.empty();
+}
+
+// Attacks.
+
+/**
+ Pieces of the given color that could capture a piece standing on the node, sorted by index.
+ Computed outward from the node, without generating any move.
+*/
+void ChessGame::attackersTo( const CellNode& node, const bool isBlack, std::vector< int >& attackers ) const
+{
+	CHESS_PROFILE_SCOPE( ATTACKERS_TO );
+	const size_t first = attackers.size();
+	scanAttackers( node.r * ChessBoard::SIZE + node.c, isBlack, &attackers );
+	std::sort( attackers.begin() + first, attackers.end() );
+}
+
+const bool ChessGame::isAttacked( const CellNode& node, const bool isBlack ) const
+{
+	CHESS_PROFILE_SCOPE( IS_ATTACKED );
+	return scanAttackers( node.r * ChessBoard::SIZE + node.c, isBlack, nullptr ) > 0;
+}
+
+// Stops at the first attacker when no output vector is given.
+const int ChessGame::scanAttackers( const int indexPosition, const bool isBlack, std::vector< int >* attackers ) const
+{
+	const auto& tables = attackTables();
+	int count = 0;
+	auto found = [&]( const int indexPiece )
+	{
+		count++;
+		if ( attackers != nullptr ) attackers->push_back( indexPiece );
+		return attackers == nullptr;
+	};
+	auto isEnemyOf = [&]( const int indexPiece, const ChessPiece::TYPE type )
+	{
+		if ( indexPiece == -1 ) return false;
+		const auto& piece = m_board->piece( indexPiece );
+		return piece.isBlack() == isBlack && piece.type() == type;
+	};
+
+	// Pawns capture one row forward; pawns that used their double step cannot move anymore (see MoveGenerator< ChessPiece::PAWN >).
+	const int row = indexPosition / ChessBoard::SIZE + ( isBlack ? 1 : -1 );
+	const int column = indexPosition % ChessBoard::SIZE;
+	if ( row >= 0 && row < ChessBoard::SIZE )
+	{
+		for ( const int c : { column - 1, column + 1 } )
+		{
+			if ( c < 0 || c >= ChessBoard::SIZE ) continue;
+			const int indexPiece = m_board->indexAt( row * ChessBoard::SIZE + c );
+			if ( isEnemyOf( indexPiece, ChessPiece::PAWN ) && !m_board->pawnUsedDoubleStep( indexPiece ) && found( indexPiece ) ) return count;
+		}
+	}
+
+	for ( const ChessPiece::TYPE type : { ChessPiece::KNIGHT, ChessPiece::KING } )
+	{
+		for ( int i = 0; i < tables.leapsCount[type][indexPosition]; i++ )
+		{
+			const int indexPiece = m_board->indexAt( tables.leaps[type][indexPosition][i] );
+			if ( isEnemyOf( indexPiece, type ) && found( indexPiece ) ) return count;
+		}
+	}
+
+	for ( int direction = 0; direction < AttackTables::DIRECTIONS; direction++ )
+	{
+		const ChessPiece::TYPE slider = direction < AttackTables::DIRECTIONS / 2 ? ChessPiece::ROOK : ChessPiece::BISHOP;
+		for ( int i = 0; i < tables.raysCount[direction][indexPosition]; i++ )
+		{
+			const int indexPiece = m_board->indexAt( tables.rays[direction][indexPosition][i] );
+			if ( indexPiece == -1 ) continue;
+			if ( ( isEnemyOf( indexPiece, slider ) || isEnemyOf( indexPiece, ChessPiece::QUEEN ) ) && found( indexPiece ) ) return count;
+			break;
+		}
+	}
+	return count;
+}
+
+// Helper methods.
+
+void ChessGame::getPossibleAssassinsOf( const int indexPieceVictim, std::vector< int >& assassins ) const
+{
+	assert( m_board->existsPiece( indexPieceVictim ) );
+	const auto& victimPiece = m_board->piece( indexPieceVictim );
+	attackersTo( CellNode( victimPiece.row(), victimPiece.column() ), !victimPiece.isBlack(), assassins );
 }
 
 void ChessGame::getPossibleVictims( std::vector< int >& victims, const bool isBlack, const bool onlySafe ) const
 {
+	CHESS_PROFILE_SCOPE( GET_POSSIBLE_VICTIMS );
 	std::map< int, std::vector< CellNode > > possiblePositions;
 	getPossiblePositions( possiblePositions, isBlack, true, onlySafe );
 	for ( const auto&[indexPiece, positions] : possiblePositions )
@@ -152,8 +802,10 @@ void ChessGame::getPossibleVictims( std::vector< int >& victims, const bool isBl
 	}
 }
 
+// Plays the move temporarily and checks the moved piece is not attacked.
 const bool ChessGame::isSafeToMoveTo( const int indexPiece, const CellNode& node ) const
 {
+	CHESS_PROFILE_SCOPE( IS_SAFE_TO_MOVE_TO );
 	assert( m_board->existsPiece( indexPiece ) );
 	const auto& piece = m_board->piece( indexPiece );
 	CellNode currentPosition( piece.row(), piece.column() );
@@ -176,27 +828,7 @@ const bool ChessGame::isSafeToMoveTo( const int indexPiece, const CellNode& node
 	// Moving temporally.
 	m_board->movePieceTo( indexPiece, node.r, node.c );
 
-	bool isSafe = true;
-	std::map< int, std::vector< CellNode > > possiblePositions;
-	getPossiblePositions( possiblePositions, !piece.isBlack(), false, false );
-	if ( !possiblePositions.empty() )
-	{
-		for ( const auto&[indexPiece, positions] : possiblePositions )
-		{
-			if ( !isSafe )
-			{
-				break;
-			}
-			for ( const auto& position : positions )
-			{
-				if ( node == position )
-				{
-					isSafe = false;
-					break;
-				}
-			}
-		}
-	}
+	const bool isSafe = !isAttacked( node, !piece.isBlack() );
 
 	// Restoring everything.
 	m_board->movePieceTo( indexPiece, currentPosition.r, currentPosition.c );
@@ -210,273 +842,268 @@ const bool ChessGame::isSafeToMoveTo( const int indexPiece, const CellNode& node
 
 /**
  This method give us a map { indexPiece, [vector of absolute final positions] }
+ Results are appended to the given map, piece by piece (see getPossiblePositionsByPiece).
 */
 void ChessGame::getPossiblePositions( std::map< int, std::vector< CellNode > >& possiblePositions, const bool isBlack, const bool onlyEat, const bool onlySafe ) const
 {
-	const auto& pieces = m_board->getPieces();
-	for ( const auto&[indexPiece, piece] : pieces )
+	CHESS_PROFILE_SCOPE( GET_POSSIBLE_POSITIONS );
+	for ( uint32_t mask = m_board->piecesMask( isBlack ); mask != 0; )
 	{
-		assert( piece.index() == indexPiece );
-		if ( ( piece.isBlack() && isBlack ) || ( !piece.isBlack() && !isBlack ) )
-		{
-			std::vector< CellNode > v = getPossiblePositionsByPiece( piece.index(), onlyEat, onlySafe );
-			if ( v.empty() ) continue;
-			possiblePositions[piece.index()].insert( possiblePositions[piece.index()].end(), v.begin(), v.end() );
-		}
+		const int indexPiece = ChessBoard::popFirstIndex( mask );
+		const std::vector< CellNode > v = getPossiblePositionsByPiece( indexPiece, onlyEat, onlySafe );
+		if ( v.empty() ) continue;
+		possiblePositions[indexPiece].insert( possiblePositions[indexPiece].end(), v.begin(), v.end() );
 	}
 }
 
+/**
+ All the moves come from the cached list of the piece (see pieceMoves). Filtered ones come from the
+ generator of the flags and are memoized by position hash until the next move, since a decision
+ asks for the same ones several times (the safe filter plays every move temporarily).
+*/
 std::vector< CellNode > ChessGame::getPossiblePositionsByPiece( const int indexPiece, const bool onlyEat, const bool onlySafe ) const
 {
-	std::vector< CellNode > ans;
-	const auto& piece = m_board->piece( indexPiece );
-	switch ( piece.type() )
+	if ( !onlyEat && !onlySafe )
 	{
-		case ChessPiece::TYPE::PAWN:
-			ans = getPawnPosiblePositions( indexPiece, onlyEat, onlySafe );
-			break;
-		case ChessPiece::TYPE::KNIGHT:
-			ans = getKnightPossiblePositions( indexPiece, onlyEat, onlySafe );
-			break;
-		case ChessPiece::TYPE::ROOK:
-		case ChessPiece::TYPE::BISHOP:
-		case ChessPiece::TYPE::QUEEN:
-		case ChessPiece::TYPE::KING:
-			ans = getGenericPossiblePositions( indexPiece, onlyEat, onlySafe, piece.type() );
-			break;
+		return pieceMoves( indexPiece );
 	}
-	return std::move( ans );
-}
-
-std::vector< CellNode > ChessGame::getPawnPosiblePositions( const int indexPiece, const bool onlyEat, const bool onlySafe ) const
-{
-	/*
-	if ( use-only-final-position )
-	{ 1 y 2 -> add }
-	else
+	const uint64_t hash = positionHash();
+	const int flags = ( onlyEat ? 1 : 0 ) | ( onlySafe ? 2 : 0 );
+	auto& entry = m_pieceMoves[indexPiece];
+	for ( const auto& filtered : entry.filtered )
 	{
-		for (fp = next node in path)
+		if ( filtered.flags == flags && filtered.hash == hash )
 		{
-			1 y 2 -> add
+			return filtered.moves;
 		}
 	}
-	1- fp exists inside of map?
-	2- fp has no friendly piece
-	*/
 
-	const auto& piece = m_board->piece( indexPiece );
+	CHESS_PROFILE_COUNT( FILTERED_MOVES_GENERATED );
+	auto& filtered = entry.filtered[entry.nextFiltered];
+	entry.nextFiltered = ( entry.nextFiltered + 1 ) % FILTERED_MOVES_SIZE;
+	filtered.moves.clear();
+	generateMoves( indexPiece, onlyEat ? CAPTURES : ALL, onlySafe, filtered.moves );
+	filtered.hash = hash;
+	filtered.flags = flags;
+	return filtered.moves;
+}
 
-	std::vector< CellNode > ans;
+//====== Move generators ======
 
-	const auto& potentialPaths = getPotentialPaths( ChessPiece::PAWN );
+// Paths are relative to the side of the piece, so black pieces walk them mirrored.
+// The color, the generation type and the safe filter are template parameters: the loops below have no runtime flag.
 
-	const auto& p = player( piece.isBlack() );
+namespace
+{
+	inline const bool isInside( const CellNode& node )
+	{
+		return node.r >= 0 && node.r < ChessBoard::SIZE && node.c >= 0 && node.c < ChessBoard::SIZE;
+	}
+
+	template< ChessGame::GENERATION GEN, bool ONLY_SAFE >
+	inline void addMove( const ChessGame& game, const ChessPiece& piece, const CellNode& node, std::vector< CellNode >& moves )
+	{
+		if ( ONLY_SAFE && !game.isSafeToMoveTo( piece.index(), node ) ) return;
+		moves.push_back( node );
+	}
+}
 
-	for ( const auto& cp : potentialPaths )
+template< ChessPiece::TYPE TYPE >
+struct ChessGame::MoveGenerator
+{
+	// Rooks, bishops, queens and the king: straight paths stopped by the first piece found.
+	template< bool IS_BLACK, ChessGame::GENERATION GEN, bool ONLY_SAFE >
+	static void generate( const ChessGame& game, const ChessPiece& piece, std::vector< CellNode >& moves, uint64_t& scanned )
 	{
-		bool isDiagonal = true;
-		const int steps = cp->totalSteps();
-		if ( steps == 2 )
+		const int direction = IS_BLACK ? -1 : 1;
+		const uint32_t friends = game.m_board->piecesMask( IS_BLACK );
+		for ( const auto& cp : game.getPotentialPaths( TYPE ) )
 		{
-			if ( std::find( p->pawnsUsedDoubleStep().begin(), p->pawnsUsedDoubleStep().end(), indexPiece ) != p->pawnsUsedDoubleStep().end() )
+			const int steps = cp.totalSteps();
+			for ( int i = 1; i <= steps; i++ )
 			{
-				break;
+				const CellNode node( piece.row() + direction * cp.getNode( i ).r, piece.column() + direction * cp.getNode( i ).c );
+				if ( !isInside( node ) ) break;
+				const int target = game.m_board->indexAt( node.r * ChessBoard::SIZE + node.c );
+				scanned |= 1ull << ( node.r * ChessBoard::SIZE + node.c );
+				if ( target != -1 && ( ( friends >> target ) & 1 ) ) break;
+				if ( target != -1 || GEN != CAPTURES )
+				{
+					addMove< GEN, ONLY_SAFE >( game, piece, node, moves );
+				}
+				if ( target != -1 ) break;
 			}
-			isDiagonal = false;
 		}
+	}
+};
 
-		for ( int i = 1; i <= steps; i++ )
+template<>
+struct ChessGame::MoveGenerator< ChessPiece::PAWN >
+{
+	// The forward path (single and double step) comes first, then the diagonal captures.
+	template< bool IS_BLACK, ChessGame::GENERATION GEN, bool ONLY_SAFE >
+	static void generate( const ChessGame& game, const ChessPiece& piece, std::vector< CellNode >& moves, uint64_t& scanned )
+	{
+		// Once the double step is used the pawn cannot move anymore.
+		if ( game.m_board->pawnUsedDoubleStep( piece.index() ) ) return;
+		const int direction = IS_BLACK ? -1 : 1;
+		const uint32_t enemies = game.m_board->piecesMask( !IS_BLACK );
+		for ( const auto& cp : game.getPotentialPaths( ChessPiece::PAWN ) )
 		{
-			const auto& node = cp->getNode( i );
-			int rr = piece.relRow() + node.r;
-			int rc = piece.relColumn() + node.c;
-
-			bool isInside = false, isBlack = false, isEmpty = false;
-
-			// Check if cell is inside the board.
-			int ar = piece.isBlack() ? ChessBoard::SIZE - rr - 1 : rr;
-			int ac = piece.isBlack() ? ChessBoard::SIZE - rc - 1 : rc;
-			isInside = ( ar >= 0 && ar < ChessBoard::SIZE && ac >= 0 && ac < ChessBoard::SIZE );
-
-			// Check if piece is friend.
-			if ( isInside )
+			const int steps = cp.totalSteps();
+			const bool isDiagonal = ( steps != 2 );
+			if ( !isDiagonal && GEN == CAPTURES ) continue;
+			for ( int i = 1; i <= steps; i++ )
 			{
-				CellNode node( ar, ac );
-				bool validNode = false;
-				getCellState( node, isEmpty, isBlack );
-				if ( onlyEat )
+				const CellNode node( piece.row() + direction * cp.getNode( i ).r, piece.column() + direction * cp.getNode( i ).c );
+				if ( !isInside( node ) ) continue;
+				const int target = game.m_board->indexAt( node.r * ChessBoard::SIZE + node.c );
+				scanned |= 1ull << ( node.r * ChessBoard::SIZE + node.c );
+				if ( isDiagonal )
 				{
-					if ( isDiagonal )
+					if ( target != -1 && ( ( enemies >> target ) & 1 ) )
 					{
-						if ( !isEmpty && ( isBlack != piece.isBlack() ) )
-						{
-							validNode = true;
-						}
+						addMove< GEN, ONLY_SAFE >( game, piece, node, moves );
 					}
 				}
 				else
 				{
-					if ( isDiagonal )
-					{
-						if ( !isEmpty && ( isBlack != piece.isBlack() ) )
-						{
-							validNode = true;
-						}
-					}
-					else
-					{
-						if ( !isEmpty )
-						{
-							break;
-						}
-						validNode = true;
-					}
-				}
-				if ( validNode )
-				{
-					if ( onlySafe )
-					{
-						if ( isSafeToMoveTo( piece.index(), node ) ) ans.push_back( node );
-					}
-					else
-					{
-						ans.push_back( node );
-					}
+					if ( target != -1 ) break;
+					addMove< GEN, ONLY_SAFE >( game, piece, node, moves );
 				}
 			}
 		}
 	}
-	return ans;
-}
+};
 
-std::vector< CellNode > ChessGame::getKnightPossiblePositions( const int indexPiece, const bool onlyEat, const bool onlySafe ) const
+template<>
+struct ChessGame::MoveGenerator< ChessPiece::KNIGHT >
 {
-	const auto& piece = m_board->piece( indexPiece );
-
-	std::vector< CellNode > ans;
-
-	const auto& potentialPaths = getPotentialPaths( ChessPiece::KNIGHT );
-
-	for ( const auto& cp : potentialPaths )
+	// Only the final node of each path matters, knights jump.
+	template< bool IS_BLACK, ChessGame::GENERATION GEN, bool ONLY_SAFE >
+	static void generate( const ChessGame& game, const ChessPiece& piece, std::vector< CellNode >& moves, uint64_t& scanned )
 	{
-		const int steps = cp->totalSteps();
-		const auto& node = cp->getNode( steps );
-
-		int rr = piece.relRow() + node.r;
-		int rc = piece.relColumn() + node.c;
-
-		bool isInside = false, isBlack = false, isEmpty = false;
-
-		// Check if cell is inside the board.
-		int ar = piece.isBlack() ? ChessBoard::SIZE - rr - 1 : rr;
-		int ac = piece.isBlack() ? ChessBoard::SIZE - rc - 1 : rc;
-		isInside = ( ar >= 0 && ar < ChessBoard::SIZE && ac >= 0 && ac < ChessBoard::SIZE );
-
-		// Check if piece is friend.
-		if ( isInside )
+		const int direction = IS_BLACK ? -1 : 1;
+		const uint32_t friends = game.m_board->piecesMask( IS_BLACK );
+		for ( const auto& cp : game.getPotentialPaths( ChessPiece::KNIGHT ) )
 		{
-			CellNode node( ar, ac );
-			getCellState( node, isEmpty, isBlack );
-			bool validNode = false;
-			if ( onlyEat )
+			const auto& step = cp.getNode( cp.totalSteps() );
+			const CellNode node( piece.row() + direction * step.r, piece.column() + direction * step.c );
+			if ( !isInside( node ) ) continue;
+			const int target = game.m_board->indexAt( node.r * ChessBoard::SIZE + node.c );
+			scanned |= 1ull << ( node.r * ChessBoard::SIZE + node.c );
+			if ( target != -1 && ( ( friends >> target ) & 1 ) ) continue;
+			if ( target != -1 || GEN != CAPTURES )
 			{
-				if ( !isEmpty && ( isBlack != piece.isBlack() ) )
-				{
-					validNode = true;
-				}
-			}
-			else
-			{
-				if ( ( !isEmpty && ( isBlack != piece.isBlack() ) ) || ( isEmpty ) )
-				{
-					validNode = true;
-				}
-			}
-			if ( validNode )
-			{
-				if ( onlySafe )
-				{
-					if ( isSafeToMoveTo( piece.index(), node ) ) ans.push_back( node );
-				}
-				else
-				{
-					ans.push_back( node );
-				}
+				addMove< GEN, ONLY_SAFE >( game, piece, node, moves );
 			}
 		}
 	}
-	return ans;
-}
+};
 
-std::vector< CellNode > ChessGame::getGenericPossiblePositions( const int indexPiece, const bool onlyEat, const bool onlySafe, const ChessPiece::TYPE type ) const
+/**
+ Every instantiation of the generators, by color, generation type, safe filter and piece type.
+*/
+struct ChessGame::MoveGeneratorTable
 {
-	const auto& piece = m_board->piece( indexPiece );
-
-	std::vector< CellNode > ans;
+	typedef void ( *Function )( const ChessGame&, const ChessPiece&, std::vector< CellNode >&, uint64_t& );
+	Function functions[2][ALL + 1][2][ChessPiece::KING + 1];
 
-	const auto& potentialPaths = getPotentialPaths( type );
+	MoveGeneratorTable()
+	{
+		fill< 0 >();
+	}
 
-	for ( const auto& cp : potentialPaths )
+	template< int COMBINATION >
+	void fill()
 	{
-		const int steps = cp->totalSteps();
-		for ( int i = 1; i <= steps; i++ )
+		const bool IS_BLACK = ( COMBINATION & 1 ) != 0;
+		const GENERATION GEN = GENERATION( ( COMBINATION >> 1 ) % ( ALL + 1 ) );
+		const bool ONLY_SAFE = ( COMBINATION >> 1 ) / ( ALL + 1 ) != 0;
+		Function* f = functions[IS_BLACK][GEN][ONLY_SAFE];
+		f[ChessPiece::NONE] = nullptr;
+		f[ChessPiece::PAWN] = &MoveGenerator< ChessPiece::PAWN >::generate< IS_BLACK, GEN, ONLY_SAFE >;
+		f[ChessPiece::ROOK] = &MoveGenerator< ChessPiece::ROOK >::generate< IS_BLACK, GEN, ONLY_SAFE >;
+		f[ChessPiece::BISHOP] = &MoveGenerator< ChessPiece::BISHOP >::generate< IS_BLACK, GEN, ONLY_SAFE >;
+		f[ChessPiece::KNIGHT] = &MoveGenerator< ChessPiece::KNIGHT >::generate< IS_BLACK, GEN, ONLY_SAFE >;
+		f[ChessPiece::QUEEN] = &MoveGenerator< ChessPiece::QUEEN >::generate< IS_BLACK, GEN, ONLY_SAFE >;
+		f[ChessPiece::KING] = &MoveGenerator< ChessPiece::KING >::generate< IS_BLACK, GEN, ONLY_SAFE >;
+		if constexpr ( COMBINATION + 1 < 2 * ( ALL + 1 ) * 2 )
 		{
-			const auto& node = cp->getNode( i );
-			int rr = piece.relRow() + node.r;
-			int rc = piece.relColumn() + node.c;
-
-			bool isInside = false, isBlack = false, isEmpty = false;
+			fill< COMBINATION + 1 >();
+		}
+	}
+};
 
-			// Check if cell is inside the board.
-			int ar = piece.isBlack() ? ChessBoard::SIZE - rr - 1 : rr;
-			int ac = piece.isBlack() ? ChessBoard::SIZE - rc - 1 : rc;
-			isInside = ( ar >= 0 && ar < ChessBoard::SIZE && ac >= 0 && ac < ChessBoard::SIZE );
+/**
+ Appends the moves of a piece: one table lookup, then a generator without runtime flags.
+ The cells the generator looked at are added to scanned when given.
+*/
+void ChessGame::generateMoves( const int indexPiece, const GENERATION generation, const bool onlySafe, std::vector< CellNode >& moves, uint64_t* scanned ) const
+{
+	CHESS_PROFILE_SCOPE( GENERATE_MOVES );
+	static const MoveGeneratorTable table;
+	const auto& piece = m_board->piece( indexPiece );
+	uint64_t cells = 0;
+	table.functions[piece.isBlack()][generation][onlySafe][piece.type()]( *this, piece, moves, cells );
+	if ( scanned != nullptr )
+	{
+		*scanned |= cells;
+	}
+}
 
-			// Check if piece is friend.
-			if ( isInside )
-			{
-				CellNode node( ar, ac );
-				getCellState( node, isEmpty, isBlack );
+/**
+ All the moves of a piece (no filter), kept between turns.
+ A list only depends on the cells its generator scanned, so it is regenerated only when the piece
+ moved or one of those cells changed since: the moved and captured pieces, and the pieces whose
+ paths cross the from or to cells. The check is lazy, so temporary moves on the board are fine too.
+*/
+const std::vector< CellNode >& ChessGame::pieceMoves( const int indexPiece ) const
+{
+	assert( m_board->existsPiece( indexPiece ) );
+	const auto& piece = m_board->piece( indexPiece );
+	const int indexPosition = piece.row() * ChessBoard::SIZE + piece.column();
+	const uint64_t occupied = m_board->occupied();
+	const uint64_t black = m_board->occupied( true );
+	auto& entry = m_pieceMoves[indexPiece];
+	if ( entry.indexPosition != indexPosition || entry.type != piece.type() || entry.isBlack != piece.isBlack() ||
+		 entry.pawnUsedDoubleStep != m_board->pawnUsedDoubleStep( indexPiece ) ||
+		 ( occupied & entry.scanned ) != entry.occupied || ( black & entry.scanned ) != entry.black )
+	{
+		CHESS_PROFILE_COUNT( PIECE_MOVES_GENERATED );
+		entry.moves.clear();
+		entry.scanned = 0;
+		generateMoves( indexPiece, ALL, false, entry.moves, &entry.scanned );
+		entry.indexPosition = indexPosition;
+		entry.type = piece.type();
+		entry.isBlack = piece.isBlack();
+		entry.pawnUsedDoubleStep = m_board->pawnUsedDoubleStep( indexPiece );
+		entry.occupied = occupied & entry.scanned;
+		entry.black = black & entry.scanned;
+	}
+	return entry.moves;
+}
 
-				if ( !isEmpty && ( isBlack == piece.isBlack() ) )
-				{
-					break;
-				}
+// Needed when the pieces are created again (indices are reused).
+void ChessGame::clearPieceMoves()
+{
+	for ( auto& entry : m_pieceMoves )
+	{
+		entry.indexPosition = -1;
+	}
+	clearFilteredMoves();
+}
 
-				if ( onlyEat )
-				{
-					if ( !isEmpty )
-					{
-						if ( onlySafe )
-						{
-							if ( isSafeToMoveTo( piece.index(), node ) ) ans.push_back( node );
-						}
-						else
-						{
-							ans.push_back( node );
-						}
-						break;
-					}
-				}
-				else
-				{
-					if ( onlySafe )
-					{
-						if ( isSafeToMoveTo( piece.index(), node ) ) ans.push_back( node );
-					}
-					else
-					{
-						ans.push_back( node );
-					}
-					if ( !isEmpty  )
-					{
-						break;
-					}
-				}
-			}
+// The filtered lists are keyed by hash, clearing them on every move only keeps the memo small.
+void ChessGame::clearFilteredMoves()
+{
+	for ( auto& entry : m_pieceMoves )
+	{
+		for ( auto& filtered : entry.filtered )
+		{
+			filtered.flags = 0;
 		}
 	}
-	return ans;
 }
 
 std::pair< int, CellNode > ChessGame::getBlockingFriend( const int indexFriend, const int indexEnemy )
@@ -556,19 +1183,7 @@ void ChessGame::getFriendsThatCanReach( std::vector< int >& friends, const CellN
 
 const int ChessGame::getIndexKing( const bool isBlack ) const
 {
-	int indexKing = -1;
-	const auto& pieces = m_board->getPieces();
-	for ( const auto&[indexPiece, piece] : pieces )
-	{
-		assert( m_board->existsPiece( indexPiece ) );
-		const auto& piece = m_board->piece( indexPiece );
-		if ( ( piece.isBlack() == isBlack ) && ( piece.type() == ChessPiece::KING ) )
-		{
-			indexKing = indexPiece;
-			break;
-		}
-	}
-	return indexKing;
+	return m_board->kingIndex( isBlack );
 }
 
 void ChessGame::getCellState( const CellNode& node, bool& isEmpy, bool& isBlack ) const
@@ -587,77 +1202,88 @@ void ChessGame::getCellState( const CellNode& node, bool& isEmpy, bool& isBlack
 
 const bool ChessGame::isInJake( const bool isBlack ) const
 {
+	CHESS_PROFILE_SCOPE( IS_IN_JAKE );
 	const int indexKing = getIndexKing( isBlack );
-	std::vector< int > possibleAssassinsOfKing;
-	getPossibleAssassinsOf( indexKing, possibleAssassinsOfKing );
-	return ( !possibleAssassinsOfKing.empty() );
+	assert( indexKing != -1 );
+	if ( indexKing == -1 )
+	{
+		return false;
+	}
+	const auto& king = m_board->piece( indexKing );
+	return isAttacked( CellNode( king.row(), king.column() ), !isBlack );
 }
 
 //============================== ChessRules ===================================
 
-ChessRules::ChessRules()
-{
-	addChessPath( ChessPiece::PAWN )->addPath( 0, 1, 2 );
-	addChessPath( ChessPiece::PAWN )->addPath( -1, 1, 1 );
-	addChessPath( ChessPiece::PAWN )->addPath( 1, 1, 1 );
-
-	addChessPath( ChessPiece::ROOK )->addPath( -1, 0, 8 );
-	addChessPath( ChessPiece::ROOK )->addPath( 1, 0, 8 );
-	addChessPath( ChessPiece::ROOK )->addPath( 0, 1, 8 );
-	addChessPath( ChessPiece::ROOK )->addPath( 0, -1, 8 );
-
-	addChessPath( ChessPiece::BISHOP )->addPath( -1, 1, 8 );
-	addChessPath( ChessPiece::BISHOP )->addPath( 1, -1, 8 );
-	addChessPath( ChessPiece::BISHOP )->addPath( -1, -1, 8 );
-	addChessPath( ChessPiece::BISHOP )->addPath( 1, 1, 8 );
-
-	addChessPath( ChessPiece::KNIGHT )->addPath( -1, 0, 1 )->addPath( 0, 1, 2 );
-	addChessPath( ChessPiece::KNIGHT )->addPath( -1, 0, 1 )->addPath( 0, -1, 2 );
-	addChessPath( ChessPiece::KNIGHT )->addPath( 1, 0, 1 )->addPath( 0, 1, 2 );
-	addChessPath( ChessPiece::KNIGHT )->addPath( 1, 0, 1 )->addPath( 0, -1, 2 );
-	addChessPath( ChessPiece::KNIGHT )->addPath( -1, 0, 2 )->addPath( 0, 1, 1 );
-	addChessPath( ChessPiece::KNIGHT )->addPath( -1, 0, 2 )->addPath( 0, -1, 1 );
-	addChessPath( ChessPiece::KNIGHT )->addPath( 1, 0, 2 )->addPath( 0, 1, 1 );
-	addChessPath( ChessPiece::KNIGHT )->addPath( 1, 0, 2 )->addPath( 0, -1, 1 );
-
-	addChessPath( ChessPiece::QUEEN )->addPath( -1, 0, 8 );
-	addChessPath( ChessPiece::QUEEN )->addPath( 1, 0, 8 );
-	addChessPath( ChessPiece::QUEEN )->addPath( 0, 1, 8 );
-	addChessPath( ChessPiece::QUEEN )->addPath( 0, -1, 8 );
-	addChessPath( ChessPiece::QUEEN )->addPath( -1, 1, 8 );
-	addChessPath( ChessPiece::QUEEN )->addPath( 1, -1, 8 );
-	addChessPath( ChessPiece::QUEEN )->addPath( -1, -1, 8 );
-	addChessPath( ChessPiece::QUEEN )->addPath( 1, 1, 8 );
-
-	addChessPath( ChessPiece::KING )->addPath( -1, 0, 1 );
-	addChessPath( ChessPiece::KING )->addPath( 1, 0, 1 );
-	addChessPath( ChessPiece::KING )->addPath( 0, 1, 1 );
-	addChessPath( ChessPiece::KING )->addPath( 0, -1, 1 );
-	addChessPath( ChessPiece::KING )->addPath( -1, 1, 1 );
-	addChessPath( ChessPiece::KING )->addPath( 1, -1, 1 );
-	addChessPath( ChessPiece::KING )->addPath( -1, -1, 1 );
-	addChessPath( ChessPiece::KING )->addPath( 1, 1, 1 );
-}
-
-ChessRules::~ChessRules()
-{
-	for ( auto movementsByType : m_chessPaths )
-	{
-		for ( auto movement : movementsByType.second )
-		{
-			delete movement;
-			movement = nullptr;
-		}
-		movementsByType.second.clear();
+const ChessRules& ChessRules::instance()
+{
+	static const ChessRules rules;
+	return rules;
+}
+
+ChessRules::ChessRules() :
+	m_pathsCount( 0 ),
+	m_lastType( ChessPiece::NONE )
+{
+	m_firstPath[ChessPiece::NONE] = 0;
+
+	addChessPath( ChessPiece::PAWN ).addPath( 0, 1, 2 );
+	addChessPath( ChessPiece::PAWN ).addPath( -1, 1, 1 );
+	addChessPath( ChessPiece::PAWN ).addPath( 1, 1, 1 );
+
+	addChessPath( ChessPiece::ROOK ).addPath( -1, 0, 8 );
+	addChessPath( ChessPiece::ROOK ).addPath( 1, 0, 8 );
+	addChessPath( ChessPiece::ROOK ).addPath( 0, 1, 8 );
+	addChessPath( ChessPiece::ROOK ).addPath( 0, -1, 8 );
+
+	addChessPath( ChessPiece::BISHOP ).addPath( -1, 1, 8 );
+	addChessPath( ChessPiece::BISHOP ).addPath( 1, -1, 8 );
+	addChessPath( ChessPiece::BISHOP ).addPath( -1, -1, 8 );
+	addChessPath( ChessPiece::BISHOP ).addPath( 1, 1, 8 );
+
+	addChessPath( ChessPiece::KNIGHT ).addPath( -1, 0, 1 ).addPath( 0, 1, 2 );
+	addChessPath( ChessPiece::KNIGHT ).addPath( -1, 0, 1 ).addPath( 0, -1, 2 );
+	addChessPath( ChessPiece::KNIGHT ).addPath( 1, 0, 1 ).addPath( 0, 1, 2 );
+	addChessPath( ChessPiece::KNIGHT ).addPath( 1, 0, 1 ).addPath( 0, -1, 2 );
+	addChessPath( ChessPiece::KNIGHT ).addPath( -1, 0, 2 ).addPath( 0, 1, 1 );
+	addChessPath( ChessPiece::KNIGHT ).addPath( -1, 0, 2 ).addPath( 0, -1, 1 );
+	addChessPath( ChessPiece::KNIGHT ).addPath( 1, 0, 2 ).addPath( 0, 1, 1 );
+	addChessPath( ChessPiece::KNIGHT ).addPath( 1, 0, 2 ).addPath( 0, -1, 1 );
+
+	addChessPath( ChessPiece::QUEEN ).addPath( -1, 0, 8 );
+	addChessPath( ChessPiece::QUEEN ).addPath( 1, 0, 8 );
+	addChessPath( ChessPiece::QUEEN ).addPath( 0, 1, 8 );
+	addChessPath( ChessPiece::QUEEN ).addPath( 0, -1, 8 );
+	addChessPath( ChessPiece::QUEEN ).addPath( -1, 1, 8 );
+	addChessPath( ChessPiece::QUEEN ).addPath( 1, -1, 8 );
+	addChessPath( ChessPiece::QUEEN ).addPath( -1, -1, 8 );
+	addChessPath( ChessPiece::QUEEN ).addPath( 1, 1, 8 );
+
+	addChessPath( ChessPiece::KING ).addPath( -1, 0, 1 );
+	addChessPath( ChessPiece::KING ).addPath( 1, 0, 1 );
+	addChessPath( ChessPiece::KING ).addPath( 0, 1, 1 );
+	addChessPath( ChessPiece::KING ).addPath( 0, -1, 1 );
+	addChessPath( ChessPiece::KING ).addPath( -1, 1, 1 );
+	addChessPath( ChessPiece::KING ).addPath( 1, -1, 1 );
+	addChessPath( ChessPiece::KING ).addPath( -1, -1, 1 );
+	addChessPath( ChessPiece::KING ).addPath( 1, 1, 1 );
+
+	assert( m_pathsCount == PATHS_COUNT );
+	while ( m_lastType <= ChessPiece::KING )
+	{
+		m_firstPath[++m_lastType] = m_pathsCount;
 	}
-	m_chessPaths.clear();
 }
 
-ChessPath* ChessRules::addChessPath( const ChessPiece::TYPE type )
+// Types must be added in increasing order so the paths of each type stay contiguous.
+ChessPath& ChessRules::addChessPath( const ChessPiece::TYPE type )
 {
-	ChessPath* cp = new ChessPath();
-	m_chessPaths[type].push_back( cp );
-	return cp;
+	assert( m_pathsCount < PATHS_COUNT && type >= m_lastType );
+	while ( m_lastType < type )
+	{
+		m_firstPath[++m_lastType] = m_pathsCount;
+	}
+	return m_paths[m_pathsCount++];
 }
 
 const int ChessRules::getImportance( const ChessPiece::TYPE type ) const
@@ -671,51 +1297,21 @@ const int ChessRules::getImportance( const ChessPiece::TYPE type ) const
 		case ChessPiece::ROOK: importance = 1; break;
 		case ChessPiece::KNIGHT: importance = 1; break;
 		case ChessPiece::PAWN: importance = 0; break;
+		default: break;
 	}
 	return importance;
 }
 
 //============================== ChessPath ====================================
 
-ChessPath::~ChessPath()
+ChessPath& ChessPath::addPath( const int _relUX, const int _relUY, const int _steps )
 {
-	for ( auto path : m_paths )
+	assert( m_totalSteps + _steps <= MAX_STEPS );
+	const CellNode start = m_nodes[m_totalSteps];
+	for ( int i = 1; i <= _steps; i++ )
 	{
-		delete path;
-		path = nullptr;
+		m_nodes[m_totalSteps + i] = start + CellNode( _relUY * i, _relUX * i );
 	}
-	m_paths.clear();
-}
-
-ChessPath* ChessPath::addPath( const int _relUX, const int _relUY, const int _steps )
-{
-	m_paths.push_back( new LinearPath( _relUX, _relUY, _steps ) );
 	m_totalSteps += _steps;
-	return this;
-}
-
-CellNode ChessPath::getNode( const int indexNode )
-{
-	int offset = 0;
-	CellNode ans;
-	for ( const auto path : m_paths )
-	{
-		if ( indexNode < path->steps + offset )
-		{
-			CellNode currentNode = path->getNode( indexNode - offset );
-			ans = ans + currentNode;
-			break;
-		}
-		offset += path->steps;
-		CellNode lastNode = path->getNode( path->steps );
-		ans = ans + lastNode;
-	}
-	return ans;
-}
-
-//============================== LinearPath ===================================
-
-CellNode LinearPath::getNode( const int indexNode )
-{
-	return CellNode( relUY * indexNode, relUX * indexNode );
+	return *this;
 }
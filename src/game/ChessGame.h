@@ -1,11 +1,21 @@
 #pragma once
 #include <vector>
 #include <map>
+#include <string>
+#include <cstdint>
 #include "../chess/ChessPiece.h"
+#include "ChessGameRecord.h"
+#include "ChessProfiler.h"
+#include "ChessRandom.h"
 
 class ChessBoard;
 class ChessGame;
 class ChessPlayer;
+class ChessOpeningBook;
+class ChessTablebase;
+class ChessSearch;
+class ChessMCTS;
+struct ChessPosition;
 
 struct ChessGameSettings
 {
@@ -13,12 +23,16 @@ struct ChessGameSettings
 					   const unsigned int movementTime = 100,
 					   const unsigned int humanPlayers = 0,
 					   const unsigned int levelAI = 4,
-					   const int decisionTimeAI = 0 ):
+					   const int decisionTimeAI = 0,
+					   const uint64_t seed = 0,
+					   const unsigned int searchSliceTime = 0 ):
 		_infiniteLoop( infiniteLoop ),
 		_movementTime( movementTime ),
 		_humanPlayers( humanPlayers ),
 		_levelAI( levelAI ),
-		_decisionTimeAI( decisionTimeAI )
+		_decisionTimeAI( decisionTimeAI ),
+		_seed( seed ),
+		_searchSliceTime( searchSliceTime )
 	{};
 private:
 	bool _infiniteLoop;
@@ -30,15 +44,21 @@ private:
 	2: eats (if possible) random only safe
 	3: eats (if possible) by importance only safe
 	4: intelligent
+	5: alpha-beta search
+	6: Monte Carlo tree search (decisionTimeAI in milliseconds, 0: fixed playouts)
 	------------------*/
 	unsigned int _levelAI;
 	unsigned int _decisionTimeAI;
+	uint64_t _seed; // Of the random decisions of the first game, 0: from ChessRandom::entropySeed.
+	unsigned int _searchSliceTime; // Milliseconds of alpha-beta search per update (level 5), 0: the whole search at once.
 public:
 	const unsigned int humanPlayers() const;
 	const bool infiniteLoop() const;
 	const unsigned int movementTime() const;
 	const unsigned int decisionTimeAI() const;
 	const unsigned int levelAI() const;
+	const uint64_t seed() const;
+	const unsigned int searchSliceTime() const;
 };
 
 inline const unsigned int ChessGameSettings::humanPlayers() const
@@ -66,6 +86,35 @@ inline const unsigned int ChessGameSettings::levelAI() const
 	return _levelAI;
 }
 
+inline const uint64_t ChessGameSettings::seed() const
+{
+	return _seed;
+}
+
+inline const unsigned int ChessGameSettings::searchSliceTime() const
+{
+	return _searchSliceTime;
+}
+
+struct ChessEPDEntry
+{
+	std::string fen;
+	std::vector< std::pair< std::string, std::string > > operations; // { opcode, operands }
+};
+
+// What ChessGame::makeMove changed, so unmakeMove can take it back.
+struct ChessMoveUndo
+{
+	int indexPiece;
+	int fromRow;
+	int fromColumn;
+	int indexCaptured; // -1 if the destination was empty.
+	ChessPiece::TYPE capturedType;
+	bool doubleStep; // The move set the double step flag of the pawn.
+	ChessGameRecord::RESULT result;
+	bool finished;
+};
+
 struct CellNode
 {
 	int r;
@@ -93,90 +142,196 @@ struct CellNode
 	}
 };
 
-class LinearPath
-{
-public:
-	LinearPath( const int _relUX, const int _relUY, const int _steps ) :
-		relUX( _relUX ), relUY( _relUY ), steps( _steps )
-	{};
-	CellNode getNode( const int indexNode );
-	int relUX;
-	int relUY;
-	int steps;
-};
-
+/**
+ Movement path of a piece, relative to the piece and seen from its own side.
+ Nodes are precomputed, node i (1..totalSteps) is the cell reached after i steps.
+*/
 class ChessPath
 {
+friend class ChessRules;
+public:
+	static const int MAX_STEPS = 8;
 public:
 	ChessPath() : m_totalSteps( 0 ) {};
-	~ChessPath();
-	ChessPath* addPath( const int _relUX, const int _relUY, const int _steps );
-	CellNode getNode( const int indexNode );
+	const CellNode& getNode( const int indexNode ) const;
 	const int totalSteps() const;
+private:
+	ChessPath& addPath( const int _relUX, const int _relUY, const int _steps );
+private:
 	int m_totalSteps;
-	std::vector< LinearPath* > m_paths;
+	CellNode m_nodes[MAX_STEPS + 1]; // m_nodes[0] is the piece cell.
 };
 
+inline const CellNode& ChessPath::getNode( const int indexNode ) const
+{
+	return m_nodes[indexNode];
+}
+
 inline const int ChessPath::totalSteps() const
 {
 	return m_totalSteps;
 }
 
+// Contiguous paths of a piece type inside the rules table.
+struct ChessPathRange
+{
+	const ChessPath* first;
+	const ChessPath* last;
+	const ChessPath* begin() const { return first; }
+	const ChessPath* end() const { return last; }
+	const size_t size() const { return size_t( last - first ); }
+};
+
+/**
+ Movement definitions of every piece type, built once in a flat read-only table shared by all games.
+*/
 class ChessRules
 {
 public:
-	ChessRules();
-	~ChessRules();
-	const std::vector< ChessPath* >& getPaths( const ChessPiece::TYPE type ) const;
+	static const int PATHS_COUNT = 35;
+public:
+	static const ChessRules& instance();
+	const ChessPathRange getPaths( const ChessPiece::TYPE type ) const;
 	const int getImportance( const ChessPiece::TYPE type ) const;
 private:
-	ChessPath* addChessPath( const ChessPiece::TYPE type );
+	ChessRules();
+	ChessRules( const ChessRules& ) = delete;
+	ChessRules& operator=( const ChessRules& ) = delete;
+	ChessPath& addChessPath( const ChessPiece::TYPE type );
 private:
-	std::map< ChessPiece::TYPE, std::vector< ChessPath* > > m_chessPaths;
+	ChessPath m_paths[PATHS_COUNT]; // Grouped by type.
+	int m_firstPath[ChessPiece::KING + 2]; // Paths of a type are [ m_firstPath[type], m_firstPath[type + 1] ).
+	int m_pathsCount;
+	int m_lastType; // Only used while building.
 };
 
-inline const std::vector< ChessPath* >& ChessRules::getPaths( const ChessPiece::TYPE type ) const
+inline const ChessPathRange ChessRules::getPaths( const ChessPiece::TYPE type ) const
 {
-	return m_chessPaths.at( type );
+	return { m_paths + m_firstPath[type], m_paths + m_firstPath[type + 1] };
 }
 
 class ChessGame
 {
+public:
+	enum GENERATION
+	{
+		CAPTURES = 0,
+		ALL = 1
+	};
 public:
 	ChessGame( const ChessGameSettings& settings );
 	~ChessGame();
 	void update( const int dt );
 	void togglePlayerInTurn();
+	void writeRecord();
 	void clear();
 	void createGame();
 	void resetGame();
-	const std::vector< ChessPath* >& getPotentialPaths( const ChessPiece::TYPE ) const;
+	void resetPosition();
+	const ChessPathRange getPotentialPaths( const ChessPiece::TYPE ) const;
 	const ChessGameSettings& settings() const;
 	const ChessRules* rules() const;
 	static const char* namePiece( const ChessPiece::TYPE );
 	const ChessPlayer* const player( const bool isBlack ) const;
+	ChessPlayer* const activePlayer();
+	const bool isBlackTurn() const;
+	const uint64_t positionHash() const;
+	void setOpeningBook( const ChessOpeningBook* openingBook );
+	const ChessOpeningBook* openingBook() const;
+	void setTablebase( const ChessTablebase* tablebase );
+	const ChessTablebase* tablebase() const;
+	void lendSearches( ChessSearch* search, ChessMCTS* mcts );
+	const bool isFinished() const;
+	ChessRandom& random();
+	void seedRandom( const uint64_t seed );
+	const bool loadStart( const ChessGameRecord& record );
+	const size_t replay( const ChessGameRecord& record, uint16_t* divergentMove = nullptr );
+
+	// Moves.
+	const ChessPiece::TYPE makeMove( const int indexPiece, const CellNode& node, ChessMoveUndo* undo = nullptr );
+	void unmakeMove( const ChessMoveUndo& undo );
+	const bool playMove( const CellNode& from, const CellNode& to );
+	const bool parseMove( const std::string& text, CellNode& from, CellNode& to ) const;
+	static std::string moveToString( const CellNode& from, const CellNode& to );
+
+	// Game records.
+	const ChessGameRecord& record() const;
+	void setRecordStream( std::ostream* stream );
+
+	// Profiling (only filled when built with CHESS_PROFILING, see ChessProfiler).
+	void getStats( ChessProfiler::Stats& stats ) const;
+	void setStatsDump( std::ostream* stream, const int turns );
+
+	// Position import / export.
+	const bool loadFEN( const std::string& fen );
+	std::string getFEN() const;
+	static const bool loadEPDSuite( const std::string& path, std::vector< ChessEPDEntry >& entries );
+	const bool loadPGN( const std::string& text, ChessGameRecord& record );
+	void getPosition( ChessPosition& position ) const;
+	const bool loadPosition( const ChessPosition& position );
+
+	// Attacks.
+	void attackersTo( const CellNode& node, const bool isBlack, std::vector< int >& attackers ) const;
+	const bool isAttacked( const CellNode& node, const bool isBlack ) const;
 
 	// Helper methods.
 	void getPossibleAssassinsOf( const int indexPiece, std::vector< int >& assassins ) const;
 	void getPossibleVictims( std::vector< int >& victims, const bool isBlack, const bool onlySafe ) const;
 	const bool isSafeToMoveTo( const int indexPiece, const CellNode& node ) const;
 	void getPossiblePositions( std::map< int, std::vector< CellNode > >& possiblePositions, const bool isBlack, const bool onlyEat, const bool onlySafe ) const;
+	const int scanAttackers( const int indexPosition, const bool isBlack, std::vector< int >* attackers ) const;
 	std::vector< CellNode > getPossiblePositionsByPiece( const int indexPiece, const bool onlyEat, const bool onlySafe ) const;
-	std::vector< CellNode > getPawnPosiblePositions( const int indexPiece, const bool onlyEat, const bool onlySafe ) const;
-	std::vector< CellNode > getKnightPossiblePositions( const int indexPiece, const bool onlyEat, const bool onlySafe ) const;
-	std::vector< CellNode > getGenericPossiblePositions( const int indexPiece, const bool onlyEat, const bool onlySafe, const ChessPiece::TYPE type ) const;
+	void generateMoves( const int indexPiece, const GENERATION generation, const bool onlySafe, std::vector< CellNode >& moves, uint64_t* scanned = nullptr ) const;
+	const std::vector< CellNode >& pieceMoves( const int indexPiece ) const;
+	void clearPieceMoves();
 	std::pair< int, CellNode > getBlockingFriend( const int indexFriend, const int indexEnemy );
 	void getFriendsThatCanReach( std::vector< int >& friends, const CellNode& node, const bool isBlack );
 	const int getIndexKing( const bool isBlack ) const;
 	void getCellState( const CellNode& node, bool& isEmpy, bool& isBlack ) const;
 	const bool isInJake( const bool isBlack ) const;
+private:
+	template< ChessPiece::TYPE TYPE > struct MoveGenerator;
+	struct MoveGeneratorTable;
+	void clearFilteredMoves();
 private:
 	ChessGameSettings m_settings;
 	ChessBoard* m_board;
 	ChessPlayer* m_playerW;
 	ChessPlayer* m_playerB;
 	ChessPlayer* m_activePlayer;
-	ChessRules* m_rules;
+	const ChessRules* m_rules; // Shared by every game (ChessRules::instance).
+	const ChessOpeningBook* m_openingBook; // Not owned, usually shared by every game of the process.
+	const ChessTablebase* m_tablebase; // Not owned, like the opening book.
+	ChessGameRecord m_record;
+	std::ostream* m_recordStream; // Not owned, finished games are appended to it.
+	std::ostream* m_statsStream; // Not owned, the profiler stats are written to it every m_statsDumpTurns turns.
+	int m_statsDumpTurns;
+	ChessRandom m_random; // Random decisions of both players, seeded per game (see seedRandom).
+	// Filtered moves (onlyEat / onlySafe) of a piece for one position.
+	struct FilteredMoves
+	{
+		FilteredMoves() : hash( 0 ), flags( 0 ) {};
+		uint64_t hash; // positionHash at generation time.
+		int flags; // onlyEat | onlySafe << 1, 0 while unused.
+		std::vector< CellNode > moves;
+	};
+	static const int FILTERED_MOVES_SIZE = 4; // Per piece, the oldest one is replaced.
+	// Moves of each piece by index, with the cells (bit row * 8 + column) their generation depended on.
+	struct PieceMoves
+	{
+		PieceMoves() : indexPosition( -1 ), type( ChessPiece::NONE ), isBlack( false ), pawnUsedDoubleStep( false ), scanned( 0 ), occupied( 0 ), black( 0 ), nextFiltered( 0 ) {};
+		int indexPosition; // -1 until generated.
+		ChessPiece::TYPE type;
+		bool isBlack;
+		bool pawnUsedDoubleStep;
+		uint64_t scanned;
+		uint64_t occupied; // Occupied scanned cells at generation time.
+		uint64_t black; // Same for the black pieces.
+		std::vector< CellNode > moves;
+		FilteredMoves filtered[FILTERED_MOVES_SIZE];
+		int nextFiltered;
+	};
+	mutable std::vector< PieceMoves > m_pieceMoves;
 	bool m_finished;
 	bool m_inInBlackTurn;
 	int m_turnCounter;
@@ -195,4 +350,67 @@ inline const ChessRules* ChessGame::rules() const
 inline const ChessPlayer* const ChessGame::player( const bool isBlack ) const
 {
 	return isBlack ? m_playerB : m_playerW;
+}
+
+inline ChessPlayer* const ChessGame::activePlayer()
+{
+	return m_activePlayer;
+}
+
+inline const bool ChessGame::isBlackTurn() const
+{
+	return m_inInBlackTurn;
+}
+
+inline void ChessGame::setOpeningBook( const ChessOpeningBook* openingBook )
+{
+	m_openingBook = openingBook;
+}
+
+inline const ChessOpeningBook* ChessGame::openingBook() const
+{
+	return m_openingBook;
+}
+
+inline void ChessGame::setTablebase( const ChessTablebase* tablebase )
+{
+	m_tablebase = tablebase;
+}
+
+inline const ChessTablebase* ChessGame::tablebase() const
+{
+	return m_tablebase;
+}
+
+inline const bool ChessGame::isFinished() const
+{
+	return m_finished;
+}
+
+inline ChessRandom& ChessGame::random()
+{
+	return m_random;
+}
+
+inline const ChessGameRecord& ChessGame::record() const
+{
+	return m_record;
+}
+
+inline void ChessGame::setRecordStream( std::ostream* stream )
+{
+	m_recordStream = stream;
+}
+
+// The counters are shared by every game of the process.
+inline void ChessGame::getStats( ChessProfiler::Stats& stats ) const
+{
+	ChessProfiler::snapshot( stats );
+}
+
+// A turns value of 0 stops the dump.
+inline void ChessGame::setStatsDump( std::ostream* stream, const int turns )
+{
+	m_statsStream = stream;
+	m_statsDumpTurns = turns;
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "ChessGamePool.h"
+
+ChessGamePool::ChessGamePool( const ChessGameSettings& settings, const size_t reserved ) :
+	m_settings( settings )
+{
+	m_games.reserve( reserved );
+	for ( size_t i = 0; i < reserved; i++ )
+	{
+		m_games.push_back( new ChessGame( m_settings ) );
+	}
+}
+
+ChessGamePool::~ChessGamePool()
+{
+	for ( auto game : m_games )
+	{
+		delete game;
+	}
+	m_games.clear();
+}
+
+/**
+ Returns a game in its initial position, only allocating when the pool is empty.
+*/
+ChessGame* ChessGamePool::acquire()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		if ( !m_games.empty() )
+		{
+			ChessGame* game = m_games.back();
+			m_games.pop_back();
+			return game;
+		}
+	}
+	return new ChessGame( m_settings );
+}
+
+/**
+ The game is reset before going back to the pool (a finished game is written to its record stream).
+*/
+void ChessGamePool::release( ChessGame* game )
+{
+	if ( game == nullptr )
+	{
+		return;
+	}
+	game->resetGame();
+	std::lock_guard< std::mutex > lock( m_mutex );
+	m_games.push_back( game );
+}
+
+const size_t ChessGamePool::available() const
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	return m_games.size();
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include "ChessGame.h"
+
+/**
+ Recycles games so a long running process keeps a steady memory footprint: released games are
+ reset in place (see ChessGame::resetGame) and handed out again by acquire.
+*/
+class ChessGamePool
+{
+public:
+	ChessGamePool( const ChessGameSettings& settings, const size_t reserved = 0 );
+	~ChessGamePool();
+	ChessGame* acquire();
+	void release( ChessGame* game );
+	const size_t available() const;
+private:
+	ChessGamePool( const ChessGamePool& ) = delete;
+	ChessGamePool& operator=( const ChessGamePool& ) = delete;
+private:
+	ChessGameSettings m_settings;
+	std::vector< ChessGame* > m_games; // Ready to be acquired.
+	mutable std::mutex m_mutex;
+};
@@ -0,0 +1,137 @@
+#include "ChessGameReader.h"
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+ChessGameReader::ChessGameReader( const std::vector< std::string >& paths ) :
+	m_paths( paths ),
+	m_finished( false ),
+	m_gamesCount( 0 )
+{}
+
+/**
+ Calls consume for every game of the inputs, on threadsCount threads (indexThread in
+ [0, threadsCount)). Unreadable inputs are skipped. Returns the number of games read.
+*/
+const size_t ChessGameReader::process( const int threadsCount, const Consumer& consume )
+{
+	m_batches.clear();
+	m_finished = false;
+	m_gamesCount = 0;
+	std::vector< std::thread > workers;
+	for ( int i = 0; i < std::max( threadsCount, 1 ); i++ )
+	{
+		workers.emplace_back( [this, i, &consume]()
+		{
+			std::vector< ChessGameInput > batch;
+			while ( pop( batch ) )
+			{
+				for ( ChessGameInput& input : batch )
+				{
+					consume( i, input );
+				}
+			}
+		} );
+	}
+	read();
+	for ( auto& worker : workers )
+	{
+		worker.join();
+	}
+	return m_gamesCount;
+}
+
+const bool ChessGameReader::isPGN( const std::string& path )
+{
+	return path.size() > 4 && path.compare( path.size() - 4, 4, ".pgn" ) == 0;
+}
+
+// Text of the next game of a PGN stream: its tag pairs and its movetext.
+const bool ChessGameReader::readPGNGame( std::istream& stream, std::string& text )
+{
+	text.clear();
+	std::string line;
+	bool inMovetext = false;
+	while ( true )
+	{
+		const std::streampos lineBegin = stream.tellg();
+		if ( !std::getline( stream, line ) ) break;
+		if ( !line.empty() && line[0] == '[' && inMovetext )
+		{
+			stream.seekg( lineBegin );
+			break;
+		}
+		if ( !line.empty() && line[0] != '[' && line != "\r" ) inMovetext = true;
+		text.append( line );
+		text.push_back( '\n' );
+	}
+	return !text.empty();
+}
+
+void ChessGameReader::read()
+{
+	std::vector< ChessGameInput > batch;
+	ChessGameInput input;
+	input.index = 0;
+	for ( const auto& path : m_paths )
+	{
+		std::ifstream stream( path, std::ios::binary );
+		if ( !stream )
+		{
+			continue;
+		}
+		if ( isPGN( path ) )
+		{
+			input.record.clear();
+			while ( readPGNGame( stream, input.pgn ) )
+			{
+				batch.push_back( input );
+				input.index++;
+				if ( batch.size() == BATCH_SIZE ) push( batch );
+			}
+		}
+		else if ( const int version = ChessGameRecord::readHeader( stream ) )
+		{
+			input.pgn.clear();
+			while ( input.record.read( stream, version ) )
+			{
+				batch.push_back( input );
+				input.index++;
+				if ( batch.size() == BATCH_SIZE ) push( batch );
+			}
+		}
+	}
+	push( batch );
+	std::lock_guard< std::mutex > lock( m_mutex );
+	m_gamesCount = input.index;
+	m_finished = true;
+	m_notEmpty.notify_all();
+}
+
+void ChessGameReader::push( std::vector< ChessGameInput >& batch )
+{
+	if ( batch.empty() )
+	{
+		return;
+	}
+	std::unique_lock< std::mutex > lock( m_mutex );
+	m_notFull.wait( lock, [this]() { return m_batches.size() < MAX_BATCHES; } );
+	m_batches.push_back( std::move( batch ) );
+	batch.clear();
+	m_notEmpty.notify_one();
+}
+
+// Next batch for a consumer, false once every batch was taken.
+const bool ChessGameReader::pop( std::vector< ChessGameInput >& batch )
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+	m_notEmpty.wait( lock, [this]() { return m_finished || !m_batches.empty(); } );
+	if ( m_batches.empty() )
+	{
+		return false;
+	}
+	batch = std::move( m_batches.front() );
+	m_batches.pop_front();
+	m_notFull.notify_one();
+	return true;
+}
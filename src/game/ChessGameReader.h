@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include "ChessGameRecord.h"
+
+/**
+ A game read from an input file: decoded for record files (.cgr), as text for PGN files (parsed
+ by the consumer with ChessGame::loadPGN, which needs a game).
+*/
+struct ChessGameInput
+{
+	size_t index; // In the order of the inputs.
+	ChessGameRecord record;
+	std::string pgn; // Empty for a record.
+};
+
+/**
+ Reads game files once, on the thread calling process, and hands the games in batches to
+ consumer threads through a bounded queue, so reading costs the same with any number of threads
+ and the memory stays bounded whatever the size of the inputs.
+*/
+class ChessGameReader
+{
+public:
+	static const size_t BATCH_SIZE = 64;
+	static const size_t MAX_BATCHES = 64; // Queued, the reader waits for the consumers beyond.
+	typedef std::function< void( const int indexThread, ChessGameInput& input ) > Consumer;
+public:
+	explicit ChessGameReader( const std::vector< std::string >& paths );
+	const size_t process( const int threadsCount, const Consumer& consume );
+	static const bool isPGN( const std::string& path );
+	static const bool readPGNGame( std::istream& stream, std::string& text );
+private:
+	void read();
+	void push( std::vector< ChessGameInput >& batch );
+	const bool pop( std::vector< ChessGameInput >& batch );
+private:
+	std::vector< std::string > m_paths;
+	std::deque< std::vector< ChessGameInput > > m_batches;
+	std::mutex m_mutex;
+	std::condition_variable m_notEmpty;
+	std::condition_variable m_notFull;
+	bool m_finished; // No more batches will be pushed.
+	size_t m_gamesCount;
+};
@@ -0,0 +1,160 @@
+#include "ChessGameRecord.h"
+#include <algorithm>
+
+namespace
+{
+	const char RECORD_MAGIC[3] = { 'C', 'G', 'R' };
+}
+
+void ChessGameRecord::writeHeader( std::ostream& stream )
+{
+	stream.write( RECORD_MAGIC, sizeof( RECORD_MAGIC ) );
+	stream.put( char( '0' + VERSION ) );
+}
+
+const int ChessGameRecord::readHeader( std::istream& stream )
+{
+	char magic[4];
+	if ( !stream.read( magic, sizeof( magic ) ) || !std::equal( RECORD_MAGIC, RECORD_MAGIC + 3, magic ) )
+	{
+		return 0;
+	}
+	const int version = magic[3] - '0';
+	return version >= 1 && version <= VERSION ? version : 0;
+}
+
+void ChessGameRecord::write( std::ostream& stream ) const
+{
+	const uint32_t count = uint32_t( moves.size() );
+	const size_t fenSize = std::min< size_t >( startFEN.size(), 0xFF );
+	const size_t movesOffset = 15 + fenSize + ( hasStartPosition ? POSITION_SIZE : 0 );
+	std::vector< unsigned char > buffer( movesOffset + 2 * moves.size() );
+	for ( int i = 0; i < 4; i++ ) buffer[i] = static_cast< unsigned char >( count >> ( 8 * i ) );
+	buffer[4] = static_cast< unsigned char >( result );
+	for ( int i = 0; i < 8; i++ ) buffer[5 + i] = static_cast< unsigned char >( seed >> ( 8 * i ) );
+	buffer[13] = static_cast< unsigned char >( fenSize );
+	std::copy( startFEN.begin(), startFEN.begin() + fenSize, buffer.begin() + 14 );
+	buffer[14 + fenSize] = hasStartPosition ? 1 : 0;
+	if ( hasStartPosition )
+	{
+		writePosition( buffer.data() + 15 + fenSize );
+	}
+	for ( size_t i = 0; i < moves.size(); i++ )
+	{
+		buffer[movesOffset + 2 * i] = static_cast< unsigned char >( moves[i] );
+		buffer[movesOffset + 2 * i + 1] = static_cast< unsigned char >( moves[i] >> 8 );
+	}
+	stream.write( reinterpret_cast< const char* >( buffer.data() ), std::streamsize( buffer.size() ) );
+}
+
+const bool ChessGameRecord::read( std::istream& stream, const int version )
+{
+	unsigned char header[13];
+	const std::streamsize headerSize = version >= 2 ? 13 : 5;
+	if ( !stream.read( reinterpret_cast< char* >( header ), headerSize ) )
+	{
+		return false;
+	}
+	const uint32_t count = header[0] | ( header[1] << 8 ) | ( header[2] << 16 ) | ( uint32_t( header[3] ) << 24 );
+	result = header[4] <= DRAW ? RESULT( header[4] ) : UNKNOWN;
+	seed = 0;
+	for ( int i = 0; i < 8 && version >= 2; i++ ) seed |= uint64_t( header[5 + i] ) << ( 8 * i );
+
+	startFEN.clear();
+	hasStartPosition = false;
+	if ( version >= 3 )
+	{
+		const int fenSize = stream.get();
+		if ( fenSize == std::char_traits< char >::eof() )
+		{
+			return false;
+		}
+		startFEN.resize( size_t( fenSize ) );
+		if ( fenSize > 0 && !stream.read( &startFEN[0], fenSize ) )
+		{
+			return false;
+		}
+		const int flag = stream.get();
+		if ( flag == std::char_traits< char >::eof() )
+		{
+			return false;
+		}
+		unsigned char position[POSITION_SIZE];
+		if ( flag != 0 && ( !stream.read( reinterpret_cast< char* >( position ), POSITION_SIZE ) || !readPosition( position ) ) )
+		{
+			return false;
+		}
+	}
+
+	std::vector< unsigned char > buffer( 2 * size_t( count ) );
+	if ( count > 0 && !stream.read( reinterpret_cast< char* >( buffer.data() ), std::streamsize( buffer.size() ) ) )
+	{
+		return false;
+	}
+	moves.resize( count );
+	for ( uint32_t i = 0; i < count; i++ )
+	{
+		moves[i] = uint16_t( buffer[2 * i] | ( buffer[2 * i + 1] << 8 ) );
+	}
+	return true;
+}
+
+// Pieces by index, so loadPosition gives back the indices the players decided with.
+void ChessGameRecord::writePosition( unsigned char* buffer ) const
+{
+	for ( int i = 0; i < ChessBoard::PIECES_COUNT; i++ )
+	{
+		const bool exists = startPosition.exists( i );
+		buffer[2 * i] = exists ? startPosition.pieces[i] : 0;
+		buffer[2 * i + 1] = static_cast< unsigned char >( exists ? startPosition.square( i ) : 0 );
+	}
+	unsigned char* const tail = buffer + 2 * ChessBoard::PIECES_COUNT;
+	for ( int i = 0; i < 4; i++ ) tail[i] = static_cast< unsigned char >( startPosition.pawnsUsedDoubleStep >> ( 8 * i ) );
+	tail[4] = startPosition.blackToMove ? 1 : 0;
+}
+
+// False for a position ChessBoard::setPosition could not take (overlapping or unknown pieces).
+const bool ChessGameRecord::readPosition( const unsigned char* buffer )
+{
+	const unsigned char* const tail = buffer + 2 * ChessBoard::PIECES_COUNT;
+	startPosition.clear();
+	startPosition.pawnsUsedDoubleStep = tail[0] | ( tail[1] << 8 ) | ( tail[2] << 16 ) | ( uint32_t( tail[3] ) << 24 );
+	startPosition.blackToMove = tail[4] != 0;
+	for ( int i = 0; i < ChessBoard::PIECES_COUNT; i++ )
+	{
+		const unsigned char code = buffer[2 * i];
+		const int square = buffer[2 * i + 1];
+		if ( code == 0 )
+		{
+			continue;
+		}
+		const ChessPiece::TYPE type = ChessPiece::TYPE( code & 7 );
+		if ( type == ChessPiece::NONE || type > ChessPiece::KING || square >= ChessBoard::CELLS_COUNT
+			 || startPosition.cells[square] != ChessPosition::NO_PIECE )
+		{
+			return false;
+		}
+		startPosition.addPiece( i, type, ( code & 8 ) != 0, square );
+	}
+	hasStartPosition = true;
+	return true;
+}
+
+const ChessGameRecord::RESULT ChessGameRecord::resultFromString( const std::string& text )
+{
+	if ( text == "1-0" ) return WHITE_WINS;
+	if ( text == "0-1" ) return BLACK_WINS;
+	if ( text == "1/2-1/2" ) return DRAW;
+	return UNKNOWN;
+}
+
+const char* ChessGameRecord::resultToString( const RESULT result )
+{
+	switch ( result )
+	{
+		case WHITE_WINS: return "1-0";
+		case BLACK_WINS: return "0-1";
+		case DRAW: return "1/2-1/2";
+		default: return "*";
+	}
+}
\ No newline at end of file
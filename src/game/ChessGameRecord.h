@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include "../chess/ChessPosition.h"
+
+/**
+ Moves of a played game, encoded like the opening book moves (see ChessOpeningBook::encodeMove).
+ Records are streamed back to back in a binary file:
+ header "CGR3", then per game: moves count (u32), result (u8), seed (u64), start FEN length (u8) and
+ text, start position flag (u8) and position (per piece index: code and square (u8 each), double
+ step mask (u32), black to move (u8)), moves (u16 each), little-endian. Files with the "CGR2"
+ header (no start) or "CGR1" header (no seed either) are still read, from the default position.
+*/
+struct ChessGameRecord
+{
+	enum RESULT
+	{
+		UNKNOWN = 0,
+		WHITE_WINS = 1,
+		BLACK_WINS = 2,
+		DRAW = 3
+	};
+
+	static const int VERSION = 3;
+
+	ChessGameRecord() : result( UNKNOWN ), seed( 0 ), hasStartPosition( false ) {};
+	void clear();
+
+	static void writeHeader( std::ostream& stream );
+	static const int readHeader( std::istream& stream ); // Version of the file, 0 if not a record file.
+	void write( std::ostream& stream ) const;
+	const bool read( std::istream& stream, const int version = VERSION );
+
+	static const RESULT resultFromString( const std::string& text );
+	static const char* resultToString( const RESULT result ); // PGN result, "*" if unknown.
+
+	std::string startFEN; // Empty for the default position (see ChessGame::loadStart).
+	std::vector< uint16_t > moves;
+	RESULT result;
+	uint64_t seed; // Of the game random decisions (see ChessGame::seedRandom).
+	bool hasStartPosition; // Started with ChessGame::loadPosition, which keeps the piece indices.
+	ChessPosition startPosition;
+private:
+	static const size_t POSITION_SIZE = 2 * ChessBoard::PIECES_COUNT + 5;
+	void writePosition( unsigned char* buffer ) const;
+	const bool readPosition( const unsigned char* buffer );
+};
+
+inline void ChessGameRecord::clear()
+{
+	startFEN.clear();
+	moves.clear();
+	result = UNKNOWN;
+	seed = 0;
+	hasStartPosition = false;
+}
@@ -0,0 +1,302 @@
+#include "ChessMCTS.h"
+#include "ChessEvaluation.h"
+#include "ChessPlayout.h"
+#include "ChessRandom.h"
+#include "ChessTablebase.h"
+#include "ChessTracer.h"
+#include "../chess/ChessPosition.h"
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const double EXPLORATION = 1.0; // UCT constant, results are in [0, 1].
+	const double CAPTURE_PROBABILITY = 0.5;
+	const double EVALUATION_SCALE = 400.0; // Centipawns for a result of 1 / ( 1 + e^-1 ).
+
+	inline const int64_t now()
+	{
+		return std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+}
+
+ChessMCTS::ChessMCTS( const int threadsCount ) :
+	m_threadsCount( threadsCount > 0 ? threadsCount : std::max( int( std::thread::hardware_concurrency() ), 1 ) ),
+	m_tablebase( nullptr ),
+	m_nodes( new Node[MAX_NODES] ),
+	m_nodesCount( 0 ),
+	m_playouts( 0 ),
+	m_playoutsBudget( 0 )
+{}
+
+ChessMCTS::~ChessMCTS()
+{}
+
+/**
+ Most visited move of the side to move, NO_MOVE if it has none. The search stops after
+ 'playouts' playouts (one thread) or, if milliseconds > 0, when the time is over (every thread),
+ and in both cases as soon as the stop flag is set by another thread. The tree is rebuilt on each
+ call.
+*/
+const ChessMove ChessMCTS::search( const ChessPosition& position, const int playouts, const int milliseconds, const uint64_t seed, const std::atomic< bool >* stop )
+{
+	m_nodesCount.store( 1 );
+	m_playouts.store( 0 );
+	resetNode( 0, ChessMovePicker::NO_MOVE );
+	if ( position.kingSquare[position.blackToMove] == -1 || !expand( 0, position ) )
+	{
+		return ChessMovePicker::NO_MOVE;
+	}
+	const Node& root = m_nodes[0];
+	if ( root.childrenCount <= 1 )
+	{
+		return root.childrenCount == 1 ? m_nodes[root.firstChild].move : ChessMovePicker::NO_MOVE;
+	}
+
+	const int64_t deadline = milliseconds > 0 ? now() + int64_t( milliseconds ) * 1000 : 0;
+	m_playoutsBudget = milliseconds > 0 ? std::numeric_limits< int64_t >::max() : int64_t( std::max( playouts, 1 ) );
+	ChessRandom random( seed );
+	const int threadsCount = milliseconds > 0 ? m_threadsCount : 1;
+	std::vector< std::thread > workers;
+	for ( int i = 1; i < threadsCount; i++ )
+	{
+		workers.emplace_back( [this, &position, i, seed = random.next(), deadline, stop]()
+		{
+			if ( ChessTracer::enabled() )
+			{
+				ChessTracer::setThreadName( "mcts " + std::to_string( i ) );
+			}
+			work( position, seed, deadline, stop );
+		} );
+	}
+	work( position, random.next(), deadline, stop );
+	for ( auto& worker : workers )
+	{
+		worker.join();
+	}
+
+	ChessMove bestMove = ChessMovePicker::NO_MOVE;
+	int32_t bestVisits = -1;
+	for ( int32_t i = root.firstChild; i < root.firstChild + root.childrenCount; i++ )
+	{
+		const int32_t visits = m_nodes[i].visits.load( std::memory_order_relaxed );
+		if ( visits > bestVisits )
+		{
+			bestVisits = visits;
+			bestMove = m_nodes[i].move;
+		}
+	}
+	return bestMove;
+}
+
+/**
+ Playout loop of one thread: selection down to a leaf (expanded on the way if the arena has room),
+ playout, then the result is added to the scores of the path, alternating the point of view.
+*/
+void ChessMCTS::work( const ChessPosition& root, const uint64_t seed, const int64_t deadline, const std::atomic< bool >* stop )
+{
+	CHESS_TRACE_SCOPE( "mctsWorker", "search" );
+	ChessRandom random( seed );
+	const int rootPiecesCount = root.piecesCount();
+	int32_t path[MAX_DEPTH];
+	for ( ;; )
+	{
+		if ( ( deadline != 0 && now() >= deadline ) || ( stop != nullptr && stop->load( std::memory_order_relaxed ) ) )
+		{
+			break;
+		}
+		// Counted only if within the budget, so playouts() is exactly the budget once it is spent.
+		int64_t started = m_playouts.load( std::memory_order_relaxed );
+		do
+		{
+			if ( started >= m_playoutsBudget ) return;
+		}
+		while ( !m_playouts.compare_exchange_weak( started, started + 1, std::memory_order_relaxed ) );
+
+		ChessPosition position = root;
+		int depth = 0;
+		int32_t indexNode = 0;
+		path[depth++] = indexNode;
+		m_nodes[indexNode].visits.fetch_add( 1, std::memory_order_relaxed );
+		int piecesCount = rootPiecesCount;
+		int result = 0;
+		bool known = false; // Result given by the tablebase.
+		while ( depth < MAX_DEPTH && position.kingSquare[position.blackToMove] != -1 )
+		{
+			const Node& node = m_nodes[indexNode];
+			if ( node.state.load( std::memory_order_acquire ) != EXPANDED && !expand( indexNode, position ) )
+			{
+				break;
+			}
+			if ( node.childrenCount == 0 )
+			{
+				break;
+			}
+			indexNode = select( indexNode );
+			const ChessMove move = m_nodes[indexNode].move;
+			if ( position.makeMove( ChessMovePicker::from( move ), ChessMovePicker::to( move ) ) != ChessPosition::NO_PIECE )
+			{
+				piecesCount--;
+			}
+			path[depth++] = indexNode;
+			// Virtual loss: the visit counts now, the result when it is known.
+			const bool firstVisit = m_nodes[indexNode].visits.fetch_add( 1, std::memory_order_relaxed ) == 0;
+			// Covered nodes are not expanded (the root is left to the caller, which needs a move).
+			if ( probe( position, piecesCount, result ) )
+			{
+				known = true;
+				break;
+			}
+			if ( firstVisit )
+			{
+				break;
+			}
+		}
+
+		// Result for the side to move at the last node, the node score is for the other side.
+		if ( !known )
+		{
+			result = playout( position, piecesCount, random );
+		}
+		for ( int i = depth - 1; i >= 0; i-- )
+		{
+			result = RESULT_SCALE - result;
+			m_nodes[path[i]].score.fetch_add( result, std::memory_order_relaxed );
+		}
+	}
+}
+
+/**
+ Creates the children of a leaf. False if another thread is expanding it, if the position has no
+ moves or if the arena is full: the caller plays out from the leaf.
+*/
+const bool ChessMCTS::expand( const int32_t indexNode, const ChessPosition& position )
+{
+	Node& node = m_nodes[indexNode];
+	uint8_t expected = LEAF;
+	if ( !node.state.compare_exchange_strong( expected, EXPANDING, std::memory_order_acq_rel ) )
+	{
+		return expected == EXPANDED;
+	}
+
+	ChessMove moves[2 * ChessMovePicker::MAX_MOVES];
+	int count = 0;
+	ChessMovePicker::generate( position, true, moves, count );
+	ChessMovePicker::generate( position, false, moves, count );
+	// The check before the reservation keeps the count bounded once the arena is full.
+	const bool fits = count > 0 && m_nodesCount.load( std::memory_order_relaxed ) + count <= MAX_NODES;
+	const int32_t first = fits ? m_nodesCount.fetch_add( count, std::memory_order_relaxed ) : 0;
+	if ( !fits || first + count > MAX_NODES )
+	{
+		node.state.store( LEAF, std::memory_order_release );
+		return false;
+	}
+	for ( int i = 0; i < count; i++ )
+	{
+		resetNode( first + i, moves[i] );
+	}
+	node.firstChild = first;
+	node.childrenCount = uint16_t( count );
+	node.state.store( EXPANDED, std::memory_order_release );
+	return true;
+}
+
+// UCT, the first child without visits if any.
+const int32_t ChessMCTS::select( const int32_t indexNode ) const
+{
+	const Node& node = m_nodes[indexNode];
+	const double logVisits = std::log( double( std::max( node.visits.load( std::memory_order_relaxed ), 1 ) ) );
+	int32_t bestChild = node.firstChild;
+	double bestValue = -1.0;
+	for ( int32_t i = node.firstChild; i < node.firstChild + node.childrenCount; i++ )
+	{
+		const Node& child = m_nodes[i];
+		const int32_t visits = child.visits.load( std::memory_order_relaxed );
+		if ( visits == 0 )
+		{
+			return i;
+		}
+		const double mean = double( child.score.load( std::memory_order_relaxed ) ) / ( double( visits ) * RESULT_SCALE );
+		const double value = mean + EXPLORATION * std::sqrt( logVisits / visits );
+		if ( value > bestValue )
+		{
+			bestValue = value;
+			bestChild = i;
+		}
+	}
+	return bestChild;
+}
+
+/**
+ Result of a playout for the side to move, 0 to RESULT_SCALE. The moves come from ChessPlayout: a
+ king capture is always played and ends it, captures are preferred with CAPTURE_PROBABILITY; a
+ position without moves is a draw; after PLAYOUT_PLIES the evaluation is mapped to a result with a
+ logistic curve. piecesCount is the count of the position, for the tablebase probes.
+*/
+const int ChessMCTS::playout( const ChessPosition& position, int piecesCount, ChessRandom& random ) const
+{
+	const bool isBlack = position.blackToMove;
+	if ( position.kingSquare[isBlack] == -1 )
+	{
+		return 0;
+	}
+	ChessPlayout kernel( position );
+	ChessPosition covered;
+	bool captured = false; // The material only changes on captures, the playout starts out of the tablebase.
+	int from = 0;
+	int to = 0;
+	for ( int ply = 0; ply < PLAYOUT_PLIES; ply++ )
+	{
+		const bool moverIsBlack = kernel.blackToMove();
+		int result = 0;
+		if ( captured && m_tablebase != nullptr && piecesCount <= m_tablebase->maxPieces() )
+		{
+			kernel.getPosition( covered );
+			if ( probe( covered, piecesCount, result ) )
+			{
+				return moverIsBlack == isBlack ? result : RESULT_SCALE - result;
+			}
+		}
+		if ( !kernel.guidedMove( random, CAPTURE_PROBABILITY, from, to ) )
+		{
+			return RESULT_SCALE / 2;
+		}
+		const ChessPiece::TYPE capturedType = kernel.makeMove( from, to );
+		if ( capturedType == ChessPiece::KING )
+		{
+			return moverIsBlack == isBlack ? RESULT_SCALE : 0;
+		}
+		captured = capturedType != ChessPiece::NONE;
+		piecesCount -= captured ? 1 : 0;
+	}
+	ChessPosition final;
+	kernel.getPosition( final );
+	const double score = double( ChessEvaluation::evaluate( final, isBlack ) );
+	return int( RESULT_SCALE / ( 1.0 + std::exp( -score / EVALUATION_SCALE ) ) );
+}
+
+// Result of the tablebase for the side to move, false without a tablebase or if it does not cover the position.
+const bool ChessMCTS::probe( const ChessPosition& position, const int piecesCount, int& result ) const
+{
+	ChessTablebaseResult tablebaseResult;
+	if ( m_tablebase == nullptr || piecesCount > m_tablebase->maxPieces() || !m_tablebase->probe( position, tablebaseResult ) )
+	{
+		return false;
+	}
+	result = tablebaseResult.wdl == ChessTablebaseResult::DRAW ? RESULT_SCALE / 2 : ( tablebaseResult.wdl == ChessTablebaseResult::WIN ? RESULT_SCALE : 0 );
+	return true;
+}
+
+void ChessMCTS::resetNode( const int32_t indexNode, const ChessMove move )
+{
+	Node& node = m_nodes[indexNode];
+	node.visits.store( 0, std::memory_order_relaxed );
+	node.score.store( 0, std::memory_order_relaxed );
+	node.firstChild = 0;
+	node.childrenCount = 0;
+	node.move = move;
+	node.state.store( LEAF, std::memory_order_relaxed );
+}
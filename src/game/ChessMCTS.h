@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "ChessMovePicker.h"
+
+struct ChessPosition;
+class ChessRandom;
+class ChessTablebase;
+
+/**
+ Monte Carlo tree search: UCT selection, nodes in a preallocated arena (the children of a node
+ are contiguous) and random playouts on the ChessPlayout kernel that always take the king when they
+ can and prefer captures half of the time. Playouts are cut after PLAYOUT_PLIES and scored with
+ ChessEvaluation.
+
+ Several threads share the tree: a thread going down counts its visit at once (virtual loss), so
+ the others spread over different branches until the result is backed up. With a playouts budget
+ the search runs on one thread and is reproducible from its seed; with a time budget it uses
+ every thread.
+
+ With a tablebase, nodes whose material it covers are not expanded and playouts stop once a
+ capture leads into covered material: both take the exact result of the table.
+*/
+class ChessMCTS
+{
+public:
+	static const int MAX_NODES = 1 << 18;
+	static const int MAX_DEPTH = 128;
+	static const int PLAYOUT_PLIES = 48;
+	static const int DEFAULT_PLAYOUTS = 3000;
+	static const int RESULT_SCALE = 1000; // A win, results are stored as integers.
+public:
+	ChessMCTS( const int threadsCount = 0 ); // 0: one per hardware thread.
+	~ChessMCTS();
+	const ChessMove search( const ChessPosition& position, const int playouts, const int milliseconds, const uint64_t seed, const std::atomic< bool >* stop = nullptr );
+	void setTablebase( const ChessTablebase* tablebase );
+	const uint64_t playouts() const;
+	const int nodesCount() const;
+private:
+	enum STATE : uint8_t
+	{
+		LEAF = 0,
+		EXPANDING = 1,
+		EXPANDED = 2
+	};
+	struct Node
+	{
+		std::atomic< int32_t > visits; // Including the threads still below the node.
+		std::atomic< int64_t > score; // Sum of the results for the side that moved into the node.
+		int32_t firstChild;
+		uint16_t childrenCount;
+		ChessMove move;
+		std::atomic< uint8_t > state;
+	};
+	void work( const ChessPosition& root, const uint64_t seed, const int64_t deadline, const std::atomic< bool >* stop );
+	const bool expand( const int32_t indexNode, const ChessPosition& position );
+	const int32_t select( const int32_t indexNode ) const;
+	const int playout( const ChessPosition& position, int piecesCount, ChessRandom& random ) const;
+	const bool probe( const ChessPosition& position, const int piecesCount, int& result ) const;
+	void resetNode( const int32_t indexNode, const ChessMove move );
+private:
+	ChessMCTS( const ChessMCTS& ) = delete;
+	ChessMCTS& operator=( const ChessMCTS& ) = delete;
+private:
+	int m_threadsCount;
+	const ChessTablebase* m_tablebase; // Not owned, nullptr: no probes.
+	std::unique_ptr< Node[] > m_nodes;
+	std::atomic< int32_t > m_nodesCount;
+	std::atomic< int64_t > m_playouts; // Started in the current search.
+	int64_t m_playoutsBudget;
+};
+
+inline void ChessMCTS::setTablebase( const ChessTablebase* tablebase )
+{
+	m_tablebase = tablebase;
+}
+
+inline const uint64_t ChessMCTS::playouts() const
+{
+	return uint64_t( m_playouts.load( std::memory_order_relaxed ) );
+}
+
+inline const int ChessMCTS::nodesCount() const
+{
+	return m_nodesCount.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,104 @@
+#include "ChessMappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+ChessMappedFile::ChessMappedFile() :
+	m_data( nullptr ),
+	m_size( 0 ),
+#ifdef _WIN32
+	m_fileHandle( nullptr ),
+	m_mappingHandle( nullptr )
+#else
+	m_fileDescriptor( -1 )
+#endif
+{}
+
+ChessMappedFile::~ChessMappedFile()
+{
+	close();
+}
+
+const bool ChessMappedFile::open( const std::string& path )
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( file == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart == 0 )
+	{
+		CloseHandle( file );
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if ( mapping == nullptr )
+	{
+		CloseHandle( file );
+		return false;
+	}
+	m_data = static_cast< const unsigned char* >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+	if ( m_data == nullptr )
+	{
+		CloseHandle( mapping );
+		CloseHandle( file );
+		return false;
+	}
+	m_fileHandle = file;
+	m_mappingHandle = mapping;
+	m_size = size_t( fileSize.QuadPart );
+#else
+	const int fd = ::open( path.c_str(), O_RDONLY );
+	if ( fd < 0 )
+	{
+		return false;
+	}
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || st.st_size == 0 )
+	{
+		::close( fd );
+		return false;
+	}
+	void* data = mmap( nullptr, size_t( st.st_size ), PROT_READ, MAP_SHARED, fd, 0 );
+	if ( data == MAP_FAILED )
+	{
+		::close( fd );
+		return false;
+	}
+	m_fileDescriptor = fd;
+	m_data = static_cast< const unsigned char* >( data );
+	m_size = size_t( st.st_size );
+#endif
+	return true;
+}
+
+void ChessMappedFile::close()
+{
+	if ( m_data == nullptr )
+	{
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile( m_data );
+	CloseHandle( m_mappingHandle );
+	CloseHandle( m_fileHandle );
+	m_fileHandle = nullptr;
+	m_mappingHandle = nullptr;
+#else
+	munmap( const_cast< unsigned char* >( m_data ), m_size );
+	::close( m_fileDescriptor );
+	m_fileDescriptor = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
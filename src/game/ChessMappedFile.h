@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+/**
+ Read-only memory mapping of a whole file (mmap / MapViewOfFile).
+ Pages are shared between every process mapping the same file.
+*/
+class ChessMappedFile
+{
+public:
+	ChessMappedFile();
+	~ChessMappedFile();
+	const bool open( const std::string& path );
+	void close();
+	const bool isOpen() const;
+	const unsigned char* data() const;
+	const size_t size() const;
+private:
+	ChessMappedFile( const ChessMappedFile& ) = delete;
+	ChessMappedFile& operator=( const ChessMappedFile& ) = delete;
+private:
+	const unsigned char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_fileHandle;
+	void* m_mappingHandle;
+#else
+	int m_fileDescriptor;
+#endif
+};
+
+inline const bool ChessMappedFile::isOpen() const
+{
+	return m_data != nullptr;
+}
+
+inline const unsigned char* ChessMappedFile::data() const
+{
+	return m_data;
+}
+
+inline const size_t ChessMappedFile::size() const
+{
+	return m_size;
+}
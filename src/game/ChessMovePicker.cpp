@@ -0,0 +1,245 @@
+#include "ChessMovePicker.h"
+#include "ChessGame.h"
+#include "ChessEvaluation.h"
+#include "../chess/ChessPosition.h"
+#include <assert.h>
+#include <utility>
+
+namespace
+{
+	const int MAX_PATHS = 8;
+
+	/**
+	 Squares of every rules path, by piece type, color (black walks them mirrored) and origin square.
+	 Paths are cut at the board edge; knights only keep their final square.
+	*/
+	struct PathTables
+	{
+		int8_t squares[ChessPiece::KING + 1][2][ChessBoard::CELLS_COUNT][MAX_PATHS][ChessPath::MAX_STEPS];
+		int8_t steps[ChessPiece::KING + 1][2][ChessBoard::CELLS_COUNT][MAX_PATHS];
+		int8_t paths[ChessPiece::KING + 1];
+		bool pawnForward[MAX_PATHS]; // The other pawn paths only capture.
+
+		PathTables()
+		{
+			const auto& rules = ChessRules::instance();
+			for ( int type = ChessPiece::PAWN; type <= ChessPiece::KING; type++ )
+			{
+				const auto range = rules.getPaths( ChessPiece::TYPE( type ) );
+				assert( range.size() <= MAX_PATHS );
+				paths[type] = int8_t( range.size() );
+				int path = 0;
+				for ( const auto& cp : range )
+				{
+					if ( type == ChessPiece::PAWN )
+					{
+						pawnForward[path] = ( cp.totalSteps() == 2 );
+					}
+					for ( int color = 0; color < 2; color++ )
+					{
+						const int direction = color == 1 ? -1 : 1;
+						for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+						{
+							int count = 0;
+							const int first = type == ChessPiece::KNIGHT ? cp.totalSteps() : 1;
+							for ( int i = first; i <= cp.totalSteps(); i++ )
+							{
+								const int r = square / ChessBoard::SIZE + direction * cp.getNode( i ).r;
+								const int c = square % ChessBoard::SIZE + direction * cp.getNode( i ).c;
+								if ( r < 0 || r >= ChessBoard::SIZE || c < 0 || c >= ChessBoard::SIZE ) break;
+								squares[type][color][square][path][count++] = int8_t( r * ChessBoard::SIZE + c );
+							}
+							steps[type][color][square][path] = int8_t( count );
+						}
+					}
+					path++;
+				}
+			}
+		}
+	};
+
+	const PathTables& pathTables()
+	{
+		static const PathTables tables;
+		return tables;
+	}
+
+	// Most valuable victim first, then least valuable attacker.
+	inline const int captureScore( const ChessPosition& position, const ChessMove move )
+	{
+		const int victim = position.cells[ChessMovePicker::to( move )];
+		const int attacker = position.cells[ChessMovePicker::from( move )];
+		const int victimValue = position.type( victim ) == ChessPiece::KING ? 100000 : ChessEvaluation::pieceValue( position.type( victim ) );
+		return victimValue * 16 - ChessEvaluation::pieceValue( position.type( attacker ) ) / 16;
+	}
+}
+
+ChessMovePicker::ChessMovePicker() :
+	m_position( nullptr ),
+	m_hashMove( NO_MOVE ),
+	m_onlyCaptures( false ),
+	m_stage( DONE ),
+	m_current( 0 ),
+	m_count( 0 )
+{
+	for ( int i = 0; i < KILLERS_COUNT; i++ )
+	{
+		m_killers[i] = NO_MOVE;
+	}
+}
+
+ChessMovePicker::ChessMovePicker( const ChessPosition& position, const ChessMove hashMove, const ChessMove* killers, const bool onlyCaptures )
+{
+	reset( position, hashMove, killers, onlyCaptures );
+}
+
+void ChessMovePicker::reset( const ChessPosition& position, const ChessMove hashMove, const ChessMove* killers, const bool onlyCaptures )
+{
+	m_position = &position;
+	m_hashMove = hashMove;
+	m_onlyCaptures = onlyCaptures;
+	m_stage = HASH_MOVE;
+	m_current = 0;
+	m_count = 0;
+	for ( int i = 0; i < KILLERS_COUNT; i++ )
+	{
+		m_killers[i] = killers != nullptr ? killers[i] : NO_MOVE;
+	}
+	if ( m_hashMove != NO_MOVE && ( !isPseudoLegal( position, m_hashMove ) || ( onlyCaptures && !isCapture( position, m_hashMove ) ) ) )
+	{
+		m_hashMove = NO_MOVE;
+	}
+}
+
+/**
+ Next move to try, NO_MOVE once every stage is exhausted.
+ Moves are pseudo legal: there are no checks in this ruleset, the game ends when a king is captured.
+*/
+const ChessMove ChessMovePicker::next()
+{
+	while ( true )
+	{
+		switch ( m_stage )
+		{
+			case HASH_MOVE:
+				m_stage = GENERATE_CAPTURES;
+				if ( m_hashMove != NO_MOVE ) return m_hashMove;
+				break;
+			case GENERATE_CAPTURES:
+				m_count = 0;
+				generate( *m_position, true, m_moves, m_count );
+				for ( int i = 0; i < m_count; i++ )
+				{
+					m_scores[i] = captureScore( *m_position, m_moves[i] );
+				}
+				m_current = 0;
+				m_stage = CAPTURES;
+				break;
+			case CAPTURES:
+				while ( m_current < m_count )
+				{
+					// Selection of the best remaining capture, most nodes only look at the first ones.
+					int best = m_current;
+					for ( int i = m_current + 1; i < m_count; i++ )
+					{
+						if ( m_scores[i] > m_scores[best] ) best = i;
+					}
+					std::swap( m_moves[best], m_moves[m_current] );
+					std::swap( m_scores[best], m_scores[m_current] );
+					const ChessMove move = m_moves[m_current++];
+					if ( move != m_hashMove ) return move;
+				}
+				m_current = 0;
+				m_stage = m_onlyCaptures ? DONE : KILLERS;
+				break;
+			case KILLERS:
+				while ( m_current < KILLERS_COUNT )
+				{
+					const ChessMove move = m_killers[m_current++];
+					if ( move != NO_MOVE && move != m_hashMove && !isCapture( *m_position, move ) && isPseudoLegal( *m_position, move ) ) return move;
+				}
+				m_stage = GENERATE_QUIETS;
+				break;
+			case GENERATE_QUIETS:
+				m_count = 0;
+				generate( *m_position, false, m_moves, m_count );
+				m_current = 0;
+				m_stage = QUIETS;
+				break;
+			case QUIETS:
+				while ( m_current < m_count )
+				{
+					const ChessMove move = m_moves[m_current++];
+					bool tried = ( move == m_hashMove );
+					for ( int i = 0; i < KILLERS_COUNT && !tried; i++ )
+					{
+						tried = ( move == m_killers[i] );
+					}
+					if ( !tried ) return move;
+				}
+				m_stage = DONE;
+				break;
+			case DONE:
+				return NO_MOVE;
+		}
+	}
+}
+
+const bool ChessMovePicker::isCapture( const ChessPosition& position, const ChessMove move )
+{
+	return position.cells[to( move )] != ChessPosition::NO_PIECE;
+}
+
+// Only the moves of the piece on the origin square are generated.
+const bool ChessMovePicker::isPseudoLegal( const ChessPosition& position, const ChessMove move )
+{
+	const int indexPiece = position.cells[from( move )];
+	if ( indexPiece == ChessPosition::NO_PIECE || position.isBlack( indexPiece ) != position.blackToMove )
+	{
+		return false;
+	}
+	ChessMove moves[MAX_MOVES];
+	int count = 0;
+	generate( position, isCapture( position, move ), moves, count, from( move ) );
+	for ( int i = 0; i < count; i++ )
+	{
+		if ( moves[i] == move ) return true;
+	}
+	return false;
+}
+
+/**
+ Same moves as ChessGame::generateMoves, including the pawns that cannot move after their double step.
+*/
+void ChessMovePicker::generate( const ChessPosition& position, const bool captures, ChessMove* moves, int& count, const int from )
+{
+	const auto& tables = pathTables();
+	const bool isBlack = position.blackToMove;
+	const int first = from != -1 ? from : 0;
+	const int last = from != -1 ? from : ChessBoard::CELLS_COUNT - 1;
+	for ( int square = first; square <= last; square++ )
+	{
+		const int indexPiece = position.cells[square];
+		if ( indexPiece == ChessPosition::NO_PIECE || position.isBlack( indexPiece ) != isBlack ) continue;
+		const ChessPiece::TYPE type = position.type( indexPiece );
+		if ( type == ChessPiece::PAWN && position.pawnUsedDoubleStep( indexPiece ) ) continue;
+		for ( int path = 0; path < tables.paths[type]; path++ )
+		{
+			const int8_t* squares = tables.squares[type][isBlack][square][path];
+			const int steps = tables.steps[type][isBlack][square][path];
+			const bool canCapture = type != ChessPiece::PAWN || !tables.pawnForward[path];
+			const bool canMove = type != ChessPiece::PAWN || tables.pawnForward[path];
+			for ( int i = 0; i < steps; i++ )
+			{
+				const int target = position.cells[squares[i]];
+				if ( target == ChessPosition::NO_PIECE )
+				{
+					if ( canMove && !captures ) moves[count++] = encode( square, squares[i] );
+					continue;
+				}
+				if ( canCapture && captures && position.isBlack( target ) != isBlack ) moves[count++] = encode( square, squares[i] );
+				if ( canMove ) break;
+			}
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include "../chess/ChessPiece.h"
+
+struct ChessPosition;
+
+/**
+ Search move: ( from << 6 ) | to, squares as row * 8 + column. Same encoding as the opening book
+ and the game records (see ChessOpeningBook::encodeMove). 0 (a1a1) is never a move.
+*/
+typedef uint16_t ChessMove;
+
+/**
+ Returns the moves of a position one by one, generating them in stages so a cutoff on an early
+ move skips the remaining generation: hash move (validated alone), captures (most valuable victim
+ first), killer moves, then quiet moves. The position must outlive the picker. A default picker
+ has no moves until reset (pickers kept in the frames of a resumable search).
+*/
+class ChessMovePicker
+{
+public:
+	static const ChessMove NO_MOVE = 0;
+	static const int MAX_MOVES = 256; // Per stage, more than the pseudo legal moves of any position.
+	static const int KILLERS_COUNT = 2;
+	enum STAGE
+	{
+		HASH_MOVE = 0,
+		GENERATE_CAPTURES,
+		CAPTURES,
+		KILLERS,
+		GENERATE_QUIETS,
+		QUIETS,
+		DONE
+	};
+public:
+	ChessMovePicker();
+	ChessMovePicker( const ChessPosition& position, const ChessMove hashMove, const ChessMove* killers, const bool onlyCaptures = false );
+	void reset( const ChessPosition& position, const ChessMove hashMove, const ChessMove* killers, const bool onlyCaptures = false );
+	const ChessMove next();
+	const STAGE stage() const;
+
+	static const ChessMove encode( const int from, const int to );
+	static const int from( const ChessMove move );
+	static const int to( const ChessMove move );
+	static const bool isCapture( const ChessPosition& position, const ChessMove move );
+	static const bool isPseudoLegal( const ChessPosition& position, const ChessMove move );
+
+	// Appends the captures or the quiet moves of the side to move (of one piece if from != -1).
+	static void generate( const ChessPosition& position, const bool captures, ChessMove* moves, int& count, const int from = -1 );
+private:
+	const ChessPosition* m_position;
+	ChessMove m_hashMove;
+	ChessMove m_killers[KILLERS_COUNT];
+	bool m_onlyCaptures;
+	STAGE m_stage;
+	int m_current;
+	int m_count;
+	ChessMove m_moves[MAX_MOVES];
+	int m_scores[MAX_MOVES];
+};
+
+inline const ChessMovePicker::STAGE ChessMovePicker::stage() const
+{
+	return m_stage;
+}
+
+inline const ChessMove ChessMovePicker::encode( const int from, const int to )
+{
+	return ChessMove( ( from << 6 ) | to );
+}
+
+inline const int ChessMovePicker::from( const ChessMove move )
+{
+	return ( move >> 6 ) & 63;
+}
+
+inline const int ChessMovePicker::to( const ChessMove move )
+{
+	return move & 63;
+}
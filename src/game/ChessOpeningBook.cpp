@@ -0,0 +1,139 @@
+#include "ChessOpeningBook.h"
+#include "ChessGame.h"
+#include <assert.h>
+
+ChessOpeningBook::ChessOpeningBook()
+{}
+
+ChessOpeningBook::~ChessOpeningBook()
+{
+	close();
+}
+
+/**
+ Maps the whole book file read-only. Pages are shared between every process using the same
+ book and only the ones touched by the binary search get loaded.
+*/
+const bool ChessOpeningBook::open( const std::string& path )
+{
+	if ( !m_file.open( path ) )
+	{
+		return false;
+	}
+	if ( size() == 0 )
+	{
+		m_file.close();
+		return false;
+	}
+	return true;
+}
+
+void ChessOpeningBook::close()
+{
+	m_file.close();
+}
+
+const size_t ChessOpeningBook::lowerBound( const uint64_t key ) const
+{
+	size_t low = 0, high = size();
+	while ( low < high )
+	{
+		const size_t middle = low + ( high - low ) / 2;
+		if ( readEntry( m_file.data() + middle * ENTRY_SIZE ).key < key )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+void ChessOpeningBook::getEntries( const uint64_t key, std::vector< ChessBookEntry >& entries ) const
+{
+	if ( !isOpen() )
+	{
+		return;
+	}
+	for ( size_t i = lowerBound( key ); i < size(); i++ )
+	{
+		const ChessBookEntry entry = readEntry( m_file.data() + i * ENTRY_SIZE );
+		if ( entry.key != key )
+		{
+			break;
+		}
+		entries.push_back( entry );
+	}
+}
+
+/**
+ Picks one of the book moves of the position with probability proportional to its weight.
+ random must be in [0, 1].
+*/
+const bool ChessOpeningBook::chooseMove( const uint64_t key, const double random, CellNode& from, CellNode& to ) const
+{
+	std::vector< ChessBookEntry > entries;
+	getEntries( key, entries );
+
+	uint32_t totalWeight = 0;
+	for ( const auto& entry : entries )
+	{
+		totalWeight += entry.weight;
+	}
+	if ( totalWeight == 0 )
+	{
+		return false;
+	}
+
+	uint32_t target = uint32_t( random * double( totalWeight ) );
+	if ( target >= totalWeight ) target = totalWeight - 1;
+	for ( const auto& entry : entries )
+	{
+		if ( target < entry.weight )
+		{
+			decodeMove( entry.move, from, to );
+			return true;
+		}
+		target -= entry.weight;
+	}
+	assert( false );
+	return false;
+}
+
+/**
+ Polyglot move layout: to file (bits 0-2), to row (3-5), from file (6-8), from row (9-11).
+ Promotion bits (12-14) are always zero since this ruleset has no promotions.
+*/
+const uint16_t ChessOpeningBook::encodeMove( const CellNode& from, const CellNode& to )
+{
+	return uint16_t( ( to.c & 7 ) | ( ( to.r & 7 ) << 3 ) | ( ( from.c & 7 ) << 6 ) | ( ( from.r & 7 ) << 9 ) );
+}
+
+void ChessOpeningBook::decodeMove( const uint16_t move, CellNode& from, CellNode& to )
+{
+	to = CellNode( ( move >> 3 ) & 7, move & 7 );
+	from = CellNode( ( move >> 9 ) & 7, ( move >> 6 ) & 7 );
+}
+
+void ChessOpeningBook::writeEntry( unsigned char* buffer, const ChessBookEntry& entry )
+{
+	for ( int i = 0; i < 8; i++ ) buffer[i] = static_cast< unsigned char >( entry.key >> ( 56 - 8 * i ) );
+	buffer[8] = static_cast< unsigned char >( entry.move >> 8 );
+	buffer[9] = static_cast< unsigned char >( entry.move );
+	buffer[10] = static_cast< unsigned char >( entry.weight >> 8 );
+	buffer[11] = static_cast< unsigned char >( entry.weight );
+	for ( int i = 0; i < 4; i++ ) buffer[12 + i] = static_cast< unsigned char >( entry.learn >> ( 24 - 8 * i ) );
+}
+
+ChessBookEntry ChessOpeningBook::readEntry( const unsigned char* buffer )
+{
+	ChessBookEntry entry;
+	entry.key = 0;
+	for ( int i = 0; i < 8; i++ ) entry.key = ( entry.key << 8 ) | buffer[i];
+	entry.move = uint16_t( ( buffer[8] << 8 ) | buffer[9] );
+	entry.weight = uint16_t( ( buffer[10] << 8 ) | buffer[11] );
+	entry.learn = ( uint32_t( buffer[12] ) << 24 ) | ( uint32_t( buffer[13] ) << 16 ) | ( uint32_t( buffer[14] ) << 8 ) | buffer[15];
+	return entry;
+}
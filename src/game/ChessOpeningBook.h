@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "ChessMappedFile.h"
+
+struct CellNode;
+
+/**
+ Polyglot-style book entry. On disk every entry takes 16 big-endian bytes:
+ key (8), move (2), weight (2), learn (4), and the file is sorted by key.
+ Keys are the position hashes of ChessGame::positionHash().
+*/
+struct ChessBookEntry
+{
+	uint64_t key;
+	uint16_t move;
+	uint16_t weight;
+	uint32_t learn;
+};
+
+class ChessOpeningBook
+{
+public:
+	static const int ENTRY_SIZE = 16;
+public:
+	ChessOpeningBook();
+	~ChessOpeningBook();
+	const bool open( const std::string& path );
+	void close();
+	const bool isOpen() const;
+	const size_t size() const;
+	void getEntries( const uint64_t key, std::vector< ChessBookEntry >& entries ) const;
+	const bool chooseMove( const uint64_t key, const double random, CellNode& from, CellNode& to ) const;
+
+	static const uint16_t encodeMove( const CellNode& from, const CellNode& to );
+	static void decodeMove( const uint16_t move, CellNode& from, CellNode& to );
+	static void writeEntry( unsigned char* buffer, const ChessBookEntry& entry );
+	static ChessBookEntry readEntry( const unsigned char* buffer );
+private:
+	const size_t lowerBound( const uint64_t key ) const;
+private:
+	ChessMappedFile m_file;
+};
+
+inline const bool ChessOpeningBook::isOpen() const
+{
+	return m_file.isOpen();
+}
+
+inline const size_t ChessOpeningBook::size() const
+{
+	// A trailing partial entry is ignored.
+	return m_file.size() / ENTRY_SIZE;
+}
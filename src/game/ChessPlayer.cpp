@@ -1,11 +1,18 @@
 #include "ChessGame.h"
 #include "ChessPlayer.h"
+#include "ChessOpeningBook.h"
+#include "ChessTablebase.h"
+#include "ChessSearch.h"
+#include "ChessMCTS.h"
+#include "ChessProfiler.h"
+#include "ChessTracer.h"
 #include <assert.h>
 #include <string>
 #include <iostream>
 #include <algorithm>
 #include <set>
 #include "../chess/ChessBoard.h"
+#include "../chess/ChessPosition.h"
 
 ChessPlayer::ChessPlayer( ChessBoard* board, ChessGame* game, const bool isBlack ) :
 	BaseItem(),
@@ -14,18 +21,47 @@ ChessPlayer::ChessPlayer( ChessBoard* board, ChessGame* game, const bool isBlack
 	m_game( game ),
 	m_currentPieceToMoveIndex( -1 ),
 	m_currentMovementIndex( -1 ),
-	m_isHuman( false )
+	m_isHuman( false ),
+	m_search( nullptr ),
+	m_mcts( nullptr ),
+	m_lentSearch( nullptr ),
+	m_lentMCTS( nullptr )
 {}
 
 ChessPlayer::~ChessPlayer()
 {
+	delete m_search;
+	m_search = nullptr;
+	delete m_mcts;
+	m_mcts = nullptr;
+	m_lentSearch = nullptr;
+	m_lentMCTS = nullptr;
 	m_board = nullptr;
 	m_game = nullptr;
 }
 
+namespace
+{
+	// Indexed by state (BaseItem::STAND shares its value with ST_WAIT_FOR_PIECE_DECISION).
+	const char* const STATE_NAMES[] =
+	{
+		"UNDEFINED",
+		"WAIT_FOR_PIECE_DECISION",
+		"WAIT_FOR_MOVEMENT_DECISION",
+		"WAIT_FOR_PIECE_TO_MOVE",
+		"EVALUATE_POSITION",
+		"END_TURN",
+		"WIN"
+	};
+}
+
 void ChessPlayer::gotoState( const int state )
 {
 	BaseItem::gotoState( state );
+	if ( ChessTracer::enabled() && state >= 0 && state <= ChessPlayer::ST_WIN )
+	{
+		ChessTracer::instant( STATE_NAMES[state], m_isBlack ? "state.black" : "state.white" );
+	}
 }
 
 void ChessPlayer::update( const int dt )
@@ -47,6 +83,36 @@ void ChessPlayer::update( const int dt )
 	}
 }
 
+/**
+ Back to the state of a new player, containers keep their storage.
+*/
+void ChessPlayer::reset()
+{
+	m_enemyPiecesToken.clear();
+	m_preMessage.clear();
+	startTurn();
+	gotoState( BaseItem::STAND );
+}
+
+// Forgets the search table, the next decisions only depend on the position and the game seed.
+void ChessPlayer::clearSearch()
+{
+	if ( m_search != nullptr )
+	{
+		m_search->clear();
+	}
+}
+
+/**
+ The next decisions use these searches instead of the ones of the player, which are only created
+ if nothing is lent (nullptr gives them back). The owner of the lent searches clears them.
+*/
+void ChessPlayer::lendSearches( ChessSearch* search, ChessMCTS* mcts )
+{
+	m_lentSearch = search;
+	m_lentMCTS = mcts;
+}
+
 void ChessPlayer::startTurn()
 {
 	m_timerPieceInMovement = 0;
@@ -68,45 +134,30 @@ void ChessPlayer::win()
 
 void ChessPlayer::evaluateFinalPosition()
 {
-	const auto& finalPosition = m_possiblePositions[m_currentPieceToMoveIndex][m_currentMovementIndex];
+	const CellNode finalPosition = m_possiblePositions[m_currentPieceToMoveIndex][m_currentMovementIndex];
+	const ChessPiece::TYPE type = m_board->piece( m_currentPieceToMoveIndex ).type();
 
-	std::string eatMsg;
+	// Make the movement, enemy piece in the final position (if any) is eaten.
+	const ChessPiece::TYPE eatenType = m_game->makeMove( m_currentPieceToMoveIndex, finalPosition );
 
-	// Check again this place to see if enemy piece will be eaten.
-	if ( m_board->existsPieceAt( finalPosition.r, finalPosition.c ) )
+	std::string eatMsg;
+	if ( eatenType != ChessPiece::NONE )
 	{
-		const auto& piece = m_board->pieceAt( finalPosition.r, finalPosition.c );
-		assert( piece.isBlack() != m_isBlack );
-		const int indexPiece = piece.index();
-		m_enemyPiecesToken.push_back( piece.type() );
-		m_board->removePiece( indexPiece );
-
-		eatMsg = std::string( "\t => ate enemy " ) + m_game->namePiece( m_enemyPiecesToken.back() );
+		m_enemyPiecesToken.push_back( eatenType );
+		eatMsg = std::string( "\t => ate enemy " ) + m_game->namePiece( eatenType );
 
 		// Jake - mate.
-		if ( m_enemyPiecesToken.back() == ChessPiece::KING )
+		if ( eatenType == ChessPiece::KING )
 		{
 			win();
 			eatMsg.append( " [[ JAKE MATE ]]" );
 		}
 	}
 
-	std::string msg = "| " + m_preMessage + " | " + name() + std::string( " => move " ) + m_game->namePiece( m_board->piece( m_currentPieceToMoveIndex ).type() ) + eatMsg;
+	std::string msg = "| " + m_preMessage + " | " + name() + std::string( " => move " ) + m_game->namePiece( type ) + eatMsg;
 	std::cout << msg << std::endl;
 	m_preMessage.clear();
 
-	// Save double step if pawn.
-	if ( m_board->piece( m_currentPieceToMoveIndex ).type() == ChessPiece::PAWN )
-	{
-		if ( std::abs( finalPosition.r - m_board->piece( m_currentPieceToMoveIndex ).row() ) == 2 )
-		{
-			m_pawnsUsedDoubleStep.push_back( m_currentPieceToMoveIndex );
-		}
-	}
-
-	// Make the movement.
-	m_board->movePieceTo( m_currentPieceToMoveIndex, finalPosition.r, finalPosition.c );
-
 	if ( getState() != ChessPlayer::ST_WIN )
 	{
 		endTurn();
@@ -115,8 +166,7 @@ void ChessPlayer::evaluateFinalPosition()
 
 void ChessPlayer::chooseRandomPieceToMove()
 {
-	int random_variable = std::rand();
-	double r = double( random_variable ) / double( RAND_MAX );
+	double r = m_game->random().nextDouble();
 	int offset = int( ( m_possiblePositions.size() - 1 ) * r );
 	for ( const auto& [key, cellNode] : m_possiblePositions )
 	{
@@ -131,8 +181,7 @@ void ChessPlayer::chooseRandomPieceToMove()
 
 void ChessPlayer::chooseRandomPositionToMove()
 {
-	int random_variable = std::rand();
-	double r = double( random_variable ) / double( RAND_MAX );
+	double r = m_game->random().nextDouble();
 	m_currentMovementIndex = int( ( m_possiblePositions[m_currentPieceToMoveIndex].size() - 1 ) * r );
 }
 
@@ -165,6 +214,19 @@ void ChessPlayer::waitForMovementDecision()
 	}
 }
 
+// Squares of the chosen move, false if generateDecision did not choose one.
+const bool ChessPlayer::decision( CellNode& from, CellNode& to ) const
+{
+	if ( !hasDecision() )
+	{
+		return false;
+	}
+	const auto& piece = m_board->piece( m_currentPieceToMoveIndex );
+	from = CellNode( piece.row(), piece.column() );
+	to = m_possiblePositions.at( m_currentPieceToMoveIndex )[m_currentMovementIndex];
+	return true;
+}
+
 const char* ChessPlayer::name() const
 {
 	return m_isBlack ? "BLACK" : "WHITE";
@@ -172,6 +234,8 @@ const char* ChessPlayer::name() const
 
 void ChessPlayer::generateDecision()
 {
+	CHESS_PROFILE_SCOPE( GENERATE_DECISION );
+	CHESS_TRACE_SCOPE( "generateDecision", "decision" );
 	/*
 	This method will set values for this variables:
 	- m_currentPieceToMoveIndex
@@ -179,6 +243,15 @@ void ChessPlayer::generateDecision()
 	based on the current levelAI.
 	*/
 
+	// A sliced search goes on where the previous update left it.
+	if ( activeSearch() != nullptr && activeSearch()->running() )
+	{
+		searchDecision();
+		return;
+	}
+	if ( bookDecision() ) return;
+	if ( tablebaseDecision() ) return;
+
 	switch ( m_game->settings().levelAI() )
 	{
 		case 0: randomDecision(); break;
@@ -186,13 +259,216 @@ void ChessPlayer::generateDecision()
 		case 2: eatRandomDecisionSafe(); break;
 		case 3: eatByHierarchyDecisionSafe(); break;
 		case 4: intelligentDecision(); break;
+		case 5: searchDecision(); break;
+		case 6: mctsDecision(); break;
+		default: assert( false && "Unknown AI level" ); randomDecision(); break;
 	}
+	// Without a decision (a sliced search not finished yet), waitForPieceDecision asks again in the next update.
+}
 
-	// TODO: Generate message or validation if something wrong happens.
+const bool ChessPlayer::bookDecision()
+{
+	CHESS_PROFILE_SCOPE( BOOK_DECISION );
+	CHESS_TRACE_SCOPE( "bookDecision", "decision" );
+	const ChessOpeningBook* book = m_game->openingBook();
+	if ( book == nullptr || !book->isOpen() )
+	{
+		return false;
+	}
+
+	CellNode from, to;
+	const double r = m_game->random().nextDouble();
+	if ( !book->chooseMove( m_game->positionHash(), r, from, to ) )
+	{
+		return false;
+	}
+
+	// Validate the book move, a hash collision or a foreign book must not produce an illegal move.
+	if ( !m_board->existsPieceAt( from.r, from.c ) || m_board->pieceAt( from.r, from.c ).isBlack() != m_isBlack )
+	{
+		return false;
+	}
+	const int indexPiece = m_board->pieceAt( from.r, from.c ).index();
+	const auto& positions = m_game->getPossiblePositionsByPiece( indexPiece, false, false );
+	for ( int i = 0; i < int( positions.size() ); i++ )
+	{
+		if ( positions[i] == to )
+		{
+			m_possiblePositions[indexPiece] = positions;
+			m_currentPieceToMoveIndex = indexPiece;
+			m_currentMovementIndex = i;
+			m_preMessage = "Opening book";
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ Every move is tried on the board and the resulting position probed, preferring the fastest win,
+ then a draw, then the slowest loss.
+*/
+const bool ChessPlayer::tablebaseDecision()
+{
+	CHESS_PROFILE_SCOPE( TABLEBASE_DECISION );
+	CHESS_TRACE_SCOPE( "tablebaseDecision", "decision" );
+	const ChessTablebase* tablebase = m_game->tablebase();
+	ChessTablebaseResult result;
+	if ( tablebase == nullptr || !tablebase->probe( *m_board, m_isBlack, result ) )
+	{
+		return false;
+	}
+
+	m_possiblePositions.clear();
+	m_game->getPossiblePositions( m_possiblePositions, m_isBlack, false, false );
+	int bestScore = 0;
+	for ( const auto&[indexPiece, positions] : m_possiblePositions )
+	{
+		const auto& piece = m_board->piece( indexPiece );
+		CellNode currentPosition( piece.row(), piece.column() );
+		for ( int i = 0; i < int( positions.size() ); i++ )
+		{
+			const auto& position = positions[i];
+			int indexPieceE = -1;
+			ChessPiece::TYPE typeE = ChessPiece::NONE;
+			if ( m_board->existsPieceAt( position.r, position.c ) )
+			{
+				const auto& pieceE = m_board->pieceAt( position.r, position.c );
+				if ( pieceE.type() == ChessPiece::KING )
+				{
+					m_currentPieceToMoveIndex = indexPiece;
+					m_currentMovementIndex = i;
+					m_preMessage = "Tablebase";
+					return true;
+				}
+				indexPieceE = pieceE.index();
+				typeE = pieceE.type();
+				m_board->removePiece( indexPieceE );
+			}
+
+			// Moving temporally.
+			m_board->movePieceTo( indexPiece, position.r, position.c );
+			ChessTablebaseResult child;
+			const bool found = tablebase->probe( *m_board, !m_isBlack, child );
+
+			// Restoring everything.
+			m_board->movePieceTo( indexPiece, currentPosition.r, currentPosition.c );
+			if ( indexPieceE != -1 )
+			{
+				m_board->restorePiece( indexPieceE, !m_isBlack, typeE, position.r, position.c );
+			}
+
+			if ( !found ) continue;
+			// Scores are positive, the best is an opponent loss in the fewest plies.
+			int score = 1000;
+			if ( child.wdl == ChessTablebaseResult::LOSS ) score = 2000 - child.distance;
+			else if ( child.wdl == ChessTablebaseResult::WIN ) score = child.distance;
+			if ( score > bestScore )
+			{
+				bestScore = score;
+				m_currentPieceToMoveIndex = indexPiece;
+				m_currentMovementIndex = i;
+			}
+		}
+	}
+
+	if ( bestScore == 0 )
+	{
+		m_possiblePositions.clear();
+		return false;
+	}
+	m_preMessage = "Tablebase";
+	return true;
+}
+
+/**
+ Alpha-beta search of the current position (see ChessSearch), the chosen move is looked up in the
+ moves of its piece like the book moves. With a search slice time in the settings, each call only
+ searches for that time: the player has no decision (and keeps waiting for it) until the search
+ is over.
+*/
+void ChessPlayer::searchDecision()
+{
+	CHESS_PROFILE_SCOPE( SEARCH_DECISION );
+	CHESS_TRACE_SCOPE( "searchDecision", "decision" );
+	if ( m_lentSearch == nullptr && m_search == nullptr )
+	{
+		m_search = new ChessSearch();
+	}
+	ChessSearch* search = activeSearch();
+	if ( !search->running() )
+	{
+		ChessPosition position;
+		m_game->getPosition( position );
+		search->setTablebase( m_game->tablebase() );
+		search->start( position, ChessSearch::DEFAULT_DEPTH );
+	}
+	if ( !search->resume( int( m_game->settings().searchSliceTime() ) ) )
+	{
+		return;
+	}
+	int score = 0;
+	const ChessMove move = search->result( score );
+	if ( !chooseMove( move ) )
+	{
+		assert( move == ChessMovePicker::NO_MOVE );
+		randomDecision();
+	}
+}
+
+/**
+ Monte Carlo tree search of the current position (see ChessMCTS). With a decision time in the
+ settings every thread searches until it is over, otherwise a fixed number of playouts is run on
+ one thread, seeded from the game so the decision can be replayed.
+*/
+void ChessPlayer::mctsDecision()
+{
+	CHESS_PROFILE_SCOPE( MCTS_DECISION );
+	CHESS_TRACE_SCOPE( "mctsDecision", "decision" );
+	if ( m_lentMCTS == nullptr && m_mcts == nullptr )
+	{
+		m_mcts = new ChessMCTS();
+	}
+	ChessMCTS* mcts = m_lentMCTS != nullptr ? m_lentMCTS : m_mcts;
+	ChessPosition position;
+	m_game->getPosition( position );
+	mcts->setTablebase( m_game->tablebase() );
+	const int milliseconds = m_game->settings().decisionTimeAI();
+	const ChessMove move = mcts->search( position, ChessMCTS::DEFAULT_PLAYOUTS, milliseconds, m_game->random().next() );
+	if ( !chooseMove( move ) )
+	{
+		assert( move == ChessMovePicker::NO_MOVE );
+		randomDecision();
+	}
+}
+
+// Looks the move of a search up in the moves of its piece, false if it is not one of them.
+const bool ChessPlayer::chooseMove( const ChessMove move )
+{
+	if ( move == ChessMovePicker::NO_MOVE )
+	{
+		return false;
+	}
+	const int indexPiece = m_board->indexAt( ChessMovePicker::from( move ) );
+	const CellNode to( ChessMovePicker::to( move ) / ChessBoard::SIZE, ChessMovePicker::to( move ) % ChessBoard::SIZE );
+	const auto& positions = m_game->getPossiblePositionsByPiece( indexPiece, false, false );
+	for ( int i = 0; i < int( positions.size() ); i++ )
+	{
+		if ( positions[i] == to )
+		{
+			m_possiblePositions[indexPiece] = positions;
+			m_currentPieceToMoveIndex = indexPiece;
+			m_currentMovementIndex = i;
+			return true;
+		}
+	}
+	return false;
 }
 
 void ChessPlayer::randomDecision()
 {
+	CHESS_PROFILE_SCOPE( RANDOM_DECISION );
+	CHESS_TRACE_SCOPE( "randomDecision", "decision" );
 	m_game->getPossiblePositions( m_possiblePositions, m_isBlack, false, false );
 	chooseRandomPieceToMove();
 	chooseRandomPositionToMove();
@@ -200,6 +476,8 @@ void ChessPlayer::randomDecision()
 
 void ChessPlayer::eatRandomDecision()
 {
+	CHESS_PROFILE_SCOPE( EAT_RANDOM_DECISION );
+	CHESS_TRACE_SCOPE( "eatRandomDecision", "decision" );
 	m_game->getPossiblePositions( m_possiblePositions, m_isBlack, true, false );
 	if ( m_possiblePositions.empty() )
 	{
@@ -211,6 +489,8 @@ void ChessPlayer::eatRandomDecision()
 
 void ChessPlayer::eatRandomDecisionSafe()
 {
+	CHESS_PROFILE_SCOPE( EAT_RANDOM_DECISION_SAFE );
+	CHESS_TRACE_SCOPE( "eatRandomDecisionSafe", "decision" );
 	m_game->getPossiblePositions( m_possiblePositions, m_isBlack, true, true );
 	if ( m_possiblePositions.empty() )
 	{
@@ -226,6 +506,8 @@ void ChessPlayer::eatRandomDecisionSafe()
 
 void ChessPlayer::eatByHierarchyDecisionSafe()
 {
+	CHESS_PROFILE_SCOPE( EAT_BY_HIERARCHY_DECISION_SAFE );
+	CHESS_TRACE_SCOPE( "eatByHierarchyDecisionSafe", "decision" );
 	std::vector< int > possibleVictims;
 	m_game->getPossibleVictims( possibleVictims, m_isBlack, true );
 	if ( !possibleVictims.empty() )
@@ -274,6 +556,8 @@ void ChessPlayer::eatByHierarchyDecisionSafe()
 
 void ChessPlayer::intelligentDecision()
 {
+	CHESS_PROFILE_SCOPE( INTELLIGENT_DECISION );
+	CHESS_TRACE_SCOPE( "intelligentDecision", "decision" );
 	m_game->getPossiblePositions( m_possiblePositions, m_isBlack, false, false );
 
 	if ( makeJakeMate() ) return;
@@ -295,6 +579,8 @@ void ChessPlayer::intelligentDecision()
 
 const bool ChessPlayer::protect()
 {
+	CHESS_PROFILE_SCOPE( PROTECT );
+	CHESS_TRACE_SCOPE( "protect", "decision" );
 	bool decisionTaken = false;
 
 	int indexFriend = -1; // To protect.
@@ -479,6 +765,8 @@ const bool ChessPlayer::protect()
 
 const bool ChessPlayer::makeJake()
 {
+	CHESS_PROFILE_SCOPE( MAKE_JAKE );
+	CHESS_TRACE_SCOPE( "makeJake", "decision" );
 	bool decisionTaken = false;
 
 	std::map< int, std::vector< CellNode > > possiblePositions;
@@ -565,6 +853,8 @@ const bool ChessPlayer::makeJake()
 
 const bool ChessPlayer::makeJakeMate()
 {
+	CHESS_PROFILE_SCOPE( MAKE_JAKE_MATE );
+	CHESS_TRACE_SCOPE( "makeJakeMate", "decision" );
 	bool decisionTaken = false;
 
 	std::vector< int > victims;
@@ -614,6 +904,8 @@ const bool ChessPlayer::makeJakeMate()
 
 const bool ChessPlayer::eatEnemySafe()
 {
+	CHESS_PROFILE_SCOPE( EAT_ENEMY_SAFE );
+	CHESS_TRACE_SCOPE( "eatEnemySafe", "decision" );
 	bool decisionTaken = false;
 
 	std::vector< int > victims;
@@ -659,6 +951,8 @@ const bool ChessPlayer::eatEnemySafe()
 
 const bool ChessPlayer::eatEnemyNotSafe()
 {
+	CHESS_PROFILE_SCOPE( EAT_ENEMY_NOT_SAFE );
+	CHESS_TRACE_SCOPE( "eatEnemyNotSafe", "decision" );
 	bool decisionTaken = false;
 
 	std::vector< int > victims;
@@ -704,6 +998,8 @@ const bool ChessPlayer::eatEnemyNotSafe()
 
 const bool ChessPlayer::moveLessImportant()
 {
+	CHESS_PROFILE_SCOPE( MOVE_LESS_IMPORTANT );
+	CHESS_TRACE_SCOPE( "moveLessImportant", "decision" );
 	bool decisionTaken = false;
 
 	std::map< int, std::vector< CellNode > > possiblePositions;
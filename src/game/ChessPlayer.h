@@ -3,9 +3,12 @@
 #include <map>
 #include <string>
 #include "../chess/BaseItem.h"
+#include "ChessMovePicker.h"
 
 class ChessBoard;
 class ChessGame;
+class ChessSearch;
+class ChessMCTS;
 struct CellNode;
 
 class ChessPlayer : public BaseItem
@@ -22,6 +25,7 @@ public:
 	~ChessPlayer();
 	void gotoState( const int state ) override;
 	void update( const int dt );
+	void reset();
 	void startTurn();
 	void endTurn();
 	void win();
@@ -29,11 +33,15 @@ public:
 
 	// Decision methods.
 	void generateDecision();
+	const bool bookDecision();
+	const bool tablebaseDecision();
 	void randomDecision();
 	void eatRandomDecision();
 	void eatRandomDecisionSafe();
 	void eatByHierarchyDecisionSafe();
 	void intelligentDecision();
+	void searchDecision();
+	void mctsDecision();
 
 	const bool protect();
 	const bool makeJake();
@@ -48,18 +56,27 @@ public:
 
 	const char* name() const;
 	const bool isBlack() const;
-	const std::vector< int >& pawnsUsedDoubleStep() const;
+	const bool hasDecision() const;
+	const bool decision( CellNode& from, CellNode& to ) const;
+	void clearSearch();
+	void lendSearches( ChessSearch* search, ChessMCTS* mcts );
 
 	// Test methods.
 	void chooseRandomPieceToMove();
 	void chooseRandomPositionToMove();
+private:
+	const bool chooseMove( const ChessMove move );
+	ChessSearch* const activeSearch() const;
 private:
 	bool m_isBlack;
 	bool m_isHuman;
 	ChessBoard* m_board;
 	ChessGame* m_game;
-	std::vector< int > m_pawnsUsedDoubleStep;
 	std::vector< ChessPiece::TYPE > m_enemyPiecesToken;
+	ChessSearch* m_search; // Created on the first search, keeps its table between turns.
+	ChessMCTS* m_mcts; // Created on the first Monte Carlo search.
+	ChessSearch* m_lentSearch; // Not owned, used instead of m_search while set (see lendSearches).
+	ChessMCTS* m_lentMCTS; // Same for m_mcts.
 
 	// Temporal variables.
 	std::map< int, std::vector< CellNode > > m_possiblePositions; // final positions (absolute).
@@ -69,12 +86,18 @@ private:
 	std::string m_preMessage;
 };
 
-inline const std::vector< int >& ChessPlayer::pawnsUsedDoubleStep() const
+inline const bool ChessPlayer::isBlack() const
 {
-	return m_pawnsUsedDoubleStep;
+	return m_isBlack;
 }
 
-inline const bool ChessPlayer::isBlack() const
+inline ChessSearch* const ChessPlayer::activeSearch() const
 {
-	return m_isBlack;
+	return m_lentSearch != nullptr ? m_lentSearch : m_search;
+}
+
+// A piece and one of its movements are chosen (see generateDecision).
+inline const bool ChessPlayer::hasDecision() const
+{
+	return m_currentPieceToMoveIndex != -1 && m_currentMovementIndex != -1;
 }
\ No newline at end of file
@@ -0,0 +1,464 @@
+#include "ChessPlayout.h"
+#include "ChessGame.h"
+#include "ChessMovePicker.h"
+#include "ChessRandom.h"
+#include "../chess/ChessPosition.h"
+#include <assert.h>
+
+namespace
+{
+	const int MAX_PATHS = 8;
+
+	/**
+	 Squares of the rules paths as bitboards, by piece type, color (black walks them mirrored) and
+	 origin square. Sliding paths (and the pawn forward path) are rays stopped by the first
+	 occupied square; knight, king and pawn captures are single squares merged in one mask.
+	*/
+	struct PlayoutTables
+	{
+		uint64_t rays[ChessPiece::KING + 1][2][ChessBoard::CELLS_COUNT][MAX_PATHS];
+		bool increasing[ChessPiece::KING + 1][2][MAX_PATHS]; // Squares of the ray grow from the origin.
+		int8_t raysCount[ChessPiece::KING + 1];
+		uint64_t steps[ChessPiece::KING + 1][2][ChessBoard::CELLS_COUNT];
+
+		PlayoutTables() :
+			rays(),
+			increasing(),
+			raysCount(),
+			steps()
+		{
+			const auto& rules = ChessRules::instance();
+			for ( int type = ChessPiece::PAWN; type <= ChessPiece::KING; type++ )
+			{
+				for ( const auto& cp : rules.getPaths( ChessPiece::TYPE( type ) ) )
+				{
+					// Pawns slide on their forward path (two steps) and capture on the others.
+					const bool isRay = type == ChessPiece::PAWN ? cp.totalSteps() == 2 : ( type != ChessPiece::KNIGHT && type != ChessPiece::KING );
+					const int path = isRay ? raysCount[type]++ : -1;
+					assert( path < MAX_PATHS );
+					for ( int color = 0; color < 2; color++ )
+					{
+						const int direction = color == 1 ? -1 : 1;
+						if ( isRay )
+						{
+							increasing[type][color][path] = direction * ( cp.getNode( 1 ).r * ChessBoard::SIZE + cp.getNode( 1 ).c ) > 0;
+						}
+						for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+						{
+							const int first = type == ChessPiece::KNIGHT ? cp.totalSteps() : 1;
+							for ( int i = first; i <= cp.totalSteps(); i++ )
+							{
+								const int r = square / ChessBoard::SIZE + direction * cp.getNode( i ).r;
+								const int c = square % ChessBoard::SIZE + direction * cp.getNode( i ).c;
+								if ( r < 0 || r >= ChessBoard::SIZE || c < 0 || c >= ChessBoard::SIZE ) break;
+								const uint64_t bit = uint64_t( 1 ) << ( r * ChessBoard::SIZE + c );
+								if ( isRay ) rays[type][color][square][path] |= bit;
+								else steps[type][color][square] |= bit;
+							}
+						}
+					}
+				}
+			}
+		}
+	};
+
+	const PlayoutTables& playoutTables()
+	{
+		static const PlayoutTables tables;
+		return tables;
+	}
+
+	inline const int firstSquare( const uint64_t mask )
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		if ( _BitScanForward( &index, uint32_t( mask ) ) ) return int( index );
+		_BitScanForward( &index, uint32_t( mask >> 32 ) );
+		return int( index ) + 32;
+#else
+		return __builtin_ctzll( mask );
+#endif
+	}
+
+	inline const int lastSquare( const uint64_t mask )
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		if ( _BitScanReverse( &index, uint32_t( mask >> 32 ) ) ) return int( index ) + 32;
+		_BitScanReverse( &index, uint32_t( mask ) );
+		return int( index );
+#else
+		return 63 - __builtin_clzll( mask );
+#endif
+	}
+
+	inline const int countSquares( const uint64_t mask )
+	{
+#ifdef _MSC_VER
+		return int( __popcnt( uint32_t( mask ) ) + __popcnt( uint32_t( mask >> 32 ) ) );
+#else
+		return __builtin_popcountll( mask );
+#endif
+	}
+
+	inline const int nthSquare( uint64_t mask, int n )
+	{
+		for ( ; n > 0; n-- ) mask &= mask - 1;
+		return firstSquare( mask );
+	}
+
+	// Uniform in [0, count), from the high bits.
+	inline const int pick( ChessRandom& random, const int count )
+	{
+		return int( ( ( random.next() >> 32 ) * uint64_t( count ) ) >> 32 );
+	}
+}
+
+ChessPlayoutStats::ChessPlayoutStats()
+{
+	clear();
+}
+
+void ChessPlayoutStats::clear()
+{
+	playouts = 0;
+	wins[0] = wins[1] = 0;
+	draws = 0;
+	plies = 0;
+	mismatches = 0;
+}
+
+const double ChessPlayoutStats::score( const bool isBlack ) const
+{
+	return playouts != 0 ? ( double( wins[isBlack] ) + 0.5 * double( draws ) ) / double( playouts ) : 0.0;
+}
+
+ChessPlayout::ChessPlayout() :
+	m_pieces(),
+	m_frozen( 0 ),
+	m_types(),
+	m_blackToMove( false )
+{}
+
+ChessPlayout::ChessPlayout( const ChessPosition& position )
+{
+	setPosition( position );
+}
+
+void ChessPlayout::setPosition( const ChessPosition& position )
+{
+	for ( int color = 0; color < 2; color++ )
+	{
+		for ( int type = ChessPiece::NONE; type <= ChessPiece::KING; type++ )
+		{
+			m_pieces[color][type] = 0;
+		}
+	}
+	m_frozen = 0;
+	for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+	{
+		const int indexPiece = position.cells[square];
+		m_types[square] = ChessPiece::NONE;
+		if ( indexPiece == ChessPosition::NO_PIECE ) continue;
+		const ChessPiece::TYPE type = position.type( indexPiece );
+		const uint64_t bit = uint64_t( 1 ) << square;
+		m_pieces[position.isBlack( indexPiece )][type] |= bit;
+		m_pieces[position.isBlack( indexPiece )][ChessPiece::NONE] |= bit;
+		m_types[square] = uint8_t( type );
+		if ( type == ChessPiece::PAWN && position.pawnUsedDoubleStep( indexPiece ) )
+		{
+			m_frozen |= bit;
+		}
+	}
+	m_blackToMove = position.blackToMove;
+}
+
+// Destination squares of the piece on the square, 0 if it is empty.
+const uint64_t ChessPlayout::targets( const int square ) const
+{
+	const ChessPiece::TYPE type = ChessPiece::TYPE( m_types[square] );
+	const bool isBlack = ( ( m_pieces[1][ChessPiece::NONE] >> square ) & 1 ) != 0;
+	const uint64_t own = m_pieces[isBlack][ChessPiece::NONE];
+	const auto& tables = playoutTables();
+	switch ( type )
+	{
+		case ChessPiece::NONE:
+			return 0;
+		case ChessPiece::PAWN:
+			if ( ( m_frozen >> square ) & 1 ) return 0;
+			return ( slide( type, isBlack, square, occupied() ) & ~occupied() ) | ( tables.steps[type][isBlack][square] & m_pieces[!isBlack][ChessPiece::NONE] );
+		case ChessPiece::KNIGHT:
+		case ChessPiece::KING:
+			return tables.steps[type][isBlack][square] & ~own;
+		default:
+			return slide( type, isBlack, square, occupied() ) & ~own;
+	}
+}
+
+// Rays of the piece cut after their first occupied square (included).
+const uint64_t ChessPlayout::slide( const ChessPiece::TYPE type, const bool isBlack, const int square, const uint64_t occupied ) const
+{
+	const auto& tables = playoutTables();
+	uint64_t result = 0;
+	for ( int path = 0; path < tables.raysCount[type]; path++ )
+	{
+		uint64_t ray = tables.rays[type][isBlack][square][path];
+		const uint64_t blockers = ray & occupied;
+		if ( blockers != 0 )
+		{
+			const int blocker = tables.increasing[type][isBlack][path] ? firstSquare( blockers ) : lastSquare( blockers );
+			ray &= ~tables.rays[type][isBlack][blocker][path];
+		}
+		result |= ray;
+	}
+	return result;
+}
+
+/**
+ Random piece of the side to move, then a random target of it. False if no piece can move.
+*/
+const bool ChessPlayout::randomMove( ChessRandom& random, int& from, int& to ) const
+{
+	uint64_t candidates = m_pieces[m_blackToMove][ChessPiece::NONE] & ~m_frozen;
+	while ( candidates != 0 )
+	{
+		const int square = nthSquare( candidates, pick( random, countSquares( candidates ) ) );
+		const uint64_t targets = this->targets( square );
+		if ( targets != 0 )
+		{
+			from = square;
+			to = nthSquare( targets, pick( random, countSquares( targets ) ) );
+			return true;
+		}
+		candidates &= ~( uint64_t( 1 ) << square );
+	}
+	return false;
+}
+
+/**
+ Move of a rollout with the bias of the ChessMCTS playouts: a piece that can capture the king
+ always does, otherwise a random capture is played with the given probability (if there is one),
+ otherwise a move of randomMove. False if no piece can move.
+*/
+const bool ChessPlayout::guidedMove( ChessRandom& random, const double captureProbability, int& from, int& to ) const
+{
+	const uint64_t king = m_pieces[!m_blackToMove][ChessPiece::KING];
+	if ( king != 0 )
+	{
+		const uint64_t kingAttackers = attackers( firstSquare( king ), m_blackToMove );
+		if ( kingAttackers != 0 )
+		{
+			from = firstSquare( kingAttackers );
+			to = firstSquare( king );
+			return true;
+		}
+	}
+
+	if ( random.nextDouble() < captureProbability )
+	{
+		// Every capture is equally likely, so pieces weigh their count of captures.
+		int squares[ChessBoard::PIECES_COUNT / 2];
+		uint64_t captures[ChessBoard::PIECES_COUNT / 2];
+		int piecesCount = 0;
+		int capturesCount = 0;
+		const uint64_t enemies = m_pieces[!m_blackToMove][ChessPiece::NONE];
+		for ( uint64_t pieces = m_pieces[m_blackToMove][ChessPiece::NONE] & ~m_frozen; pieces != 0; pieces &= pieces - 1 )
+		{
+			const int square = firstSquare( pieces );
+			const uint64_t targets = this->targets( square ) & enemies;
+			if ( targets == 0 ) continue;
+			squares[piecesCount] = square;
+			captures[piecesCount++] = targets;
+			capturesCount += countSquares( targets );
+		}
+		if ( capturesCount > 0 )
+		{
+			int n = pick( random, capturesCount );
+			for ( int i = 0; i < piecesCount; i++ )
+			{
+				const int count = countSquares( captures[i] );
+				if ( n < count )
+				{
+					from = squares[i];
+					to = nthSquare( captures[i], n );
+					return true;
+				}
+				n -= count;
+			}
+		}
+	}
+	return randomMove( random, from, to );
+}
+
+// Pieces of the color that can capture on the square, found from it since the paths are symmetric (as in ChessGame::scanAttackers).
+const uint64_t ChessPlayout::attackers( const int square, const bool isBlack ) const
+{
+	const auto& tables = playoutTables();
+	const uint64_t* pieces = m_pieces[isBlack];
+	// Pawns capture forward, so they are found on the captures of the other color.
+	uint64_t result = tables.steps[ChessPiece::PAWN][!isBlack][square] & pieces[ChessPiece::PAWN] & ~m_frozen;
+	result |= tables.steps[ChessPiece::KNIGHT][isBlack][square] & pieces[ChessPiece::KNIGHT];
+	result |= tables.steps[ChessPiece::KING][isBlack][square] & pieces[ChessPiece::KING];
+	result |= slide( ChessPiece::ROOK, isBlack, square, occupied() ) & ( pieces[ChessPiece::ROOK] | pieces[ChessPiece::QUEEN] );
+	result |= slide( ChessPiece::BISHOP, isBlack, square, occupied() ) & ( pieces[ChessPiece::BISHOP] | pieces[ChessPiece::QUEEN] );
+	return result;
+}
+
+// Same effects as ChessPosition::makeMove, returns the type of the captured piece.
+const ChessPiece::TYPE ChessPlayout::makeMove( const int from, const int to )
+{
+	const uint64_t fromBit = uint64_t( 1 ) << from;
+	const uint64_t toBit = uint64_t( 1 ) << to;
+	const ChessPiece::TYPE type = ChessPiece::TYPE( m_types[from] );
+	const ChessPiece::TYPE captured = ChessPiece::TYPE( m_types[to] );
+	assert( type != ChessPiece::NONE );
+	if ( captured != ChessPiece::NONE )
+	{
+		m_pieces[!m_blackToMove][captured] &= ~toBit;
+		m_pieces[!m_blackToMove][ChessPiece::NONE] &= ~toBit;
+		m_frozen &= ~toBit;
+	}
+	m_pieces[m_blackToMove][type] ^= fromBit | toBit;
+	m_pieces[m_blackToMove][ChessPiece::NONE] ^= fromBit | toBit;
+	m_types[to] = uint8_t( type );
+	m_types[from] = ChessPiece::NONE;
+	if ( type == ChessPiece::PAWN && ( to - from == 2 * ChessBoard::SIZE || from - to == 2 * ChessBoard::SIZE ) )
+	{
+		m_frozen |= toBit;
+	}
+	m_blackToMove = !m_blackToMove;
+	return captured;
+}
+
+// Piece indices are not kept: white pieces are numbered from 0 and black ones from PIECES_COUNT / 2.
+void ChessPlayout::getPosition( ChessPosition& position ) const
+{
+	position.clear();
+	int indexPiece[2] = { 0, ChessBoard::PIECES_COUNT / 2 };
+	for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+	{
+		const ChessPiece::TYPE type = ChessPiece::TYPE( m_types[square] );
+		if ( type == ChessPiece::NONE ) continue;
+		const bool isBlack = ( ( m_pieces[1][ChessPiece::NONE] >> square ) & 1 ) != 0;
+		position.addPiece( indexPiece[isBlack]++, type, isBlack, square );
+		if ( ( m_frozen >> square ) & 1 )
+		{
+			position.setPawnUsedDoubleStep( square );
+		}
+	}
+	position.blackToMove = m_blackToMove;
+}
+
+/**
+ Plays random moves until a king is captured, the side to move has no moves (draw) or maxPlies
+ are played (draw). The kernel is left on the final position.
+*/
+const ChessGameRecord::RESULT ChessPlayout::play( ChessRandom& random, const int maxPlies, int& plies )
+{
+	plies = 0;
+	for ( int color = 0; color < 2; color++ )
+	{
+		if ( m_pieces[color][ChessPiece::KING] == 0 )
+		{
+			return color == 1 ? ChessGameRecord::WHITE_WINS : ChessGameRecord::BLACK_WINS;
+		}
+	}
+	int from = 0;
+	int to = 0;
+	while ( plies < maxPlies && randomMove( random, from, to ) )
+	{
+		const bool isBlack = m_blackToMove;
+		const ChessPiece::TYPE captured = makeMove( from, to );
+		plies++;
+		if ( captured == ChessPiece::KING )
+		{
+			return isBlack ? ChessGameRecord::BLACK_WINS : ChessGameRecord::WHITE_WINS;
+		}
+	}
+	return ChessGameRecord::DRAW;
+}
+
+/**
+ Runs 'count' playouts from the position and adds them to the stats. With verify, every ply is
+ also played on a ChessPosition and the targets of each piece of the side to move are compared
+ with ChessMovePicker::generate (move generator fuzzing, much slower).
+*/
+void ChessPlayout::run( const ChessPosition& position, const int count, const int maxPlies, ChessRandom& random, ChessPlayoutStats& stats, const bool verify )
+{
+	const ChessPlayout start( position );
+	for ( int i = 0; i < count; i++ )
+	{
+		ChessPlayout playout = start;
+		ChessGameRecord::RESULT result = ChessGameRecord::DRAW;
+		int plies = 0;
+		if ( !verify )
+		{
+			result = playout.play( random, maxPlies, plies );
+		}
+		else
+		{
+			ChessPosition mirror = position;
+			int from = 0;
+			int to = 0;
+			while ( plies < maxPlies )
+			{
+				if ( ChessPlayout::verify( playout, mirror ) != 0 )
+				{
+					stats.mismatches++;
+				}
+				if ( mirror.kingSquare[0] == -1 || mirror.kingSquare[1] == -1 || !playout.randomMove( random, from, to ) )
+				{
+					break;
+				}
+				const bool isBlack = playout.m_blackToMove;
+				mirror.makeMove( from, to );
+				plies++;
+				if ( playout.makeMove( from, to ) == ChessPiece::KING )
+				{
+					result = isBlack ? ChessGameRecord::BLACK_WINS : ChessGameRecord::WHITE_WINS;
+					break;
+				}
+			}
+		}
+		stats.playouts++;
+		stats.plies += uint64_t( plies );
+		if ( result == ChessGameRecord::DRAW ) stats.draws++;
+		else stats.wins[result == ChessGameRecord::BLACK_WINS]++;
+	}
+}
+
+// Squares where the kernel and the position disagree (placement, side to move, targets or attackers of the king), plus getPosition.
+const int ChessPlayout::verify( const ChessPlayout& playout, const ChessPosition& position )
+{
+	int differences = playout.m_blackToMove != position.blackToMove ? 1 : 0;
+	ChessPosition converted;
+	playout.getPosition( converted );
+	if ( converted.hash != position.hash ) differences++; // The hash does not depend on the piece indices.
+	const int kingSquare = position.kingSquare[!position.blackToMove];
+	uint64_t kingAttackers = 0;
+	for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+	{
+		const int indexPiece = position.cells[square];
+		const ChessPiece::TYPE type = indexPiece != ChessPosition::NO_PIECE ? position.type( indexPiece ) : ChessPiece::NONE;
+		if ( type != ChessPiece::TYPE( playout.m_types[square] ) || ( type != ChessPiece::NONE && position.isBlack( indexPiece ) != ( ( playout.occupied( true ) >> square ) & 1 ) ) )
+		{
+			differences++;
+			continue;
+		}
+		if ( type == ChessPiece::NONE || position.isBlack( indexPiece ) != position.blackToMove ) continue;
+
+		ChessMove moves[2 * ChessMovePicker::MAX_MOVES];
+		int count = 0;
+		ChessMovePicker::generate( position, true, moves, count, square );
+		ChessMovePicker::generate( position, false, moves, count, square );
+		uint64_t expected = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			expected |= uint64_t( 1 ) << ChessMovePicker::to( moves[i] );
+		}
+		if ( expected != playout.targets( square ) ) differences++;
+		if ( kingSquare != -1 && ( ( expected >> kingSquare ) & 1 ) ) kingAttackers |= uint64_t( 1 ) << square;
+	}
+	if ( kingSquare != -1 && kingAttackers != playout.attackers( kingSquare, position.blackToMove ) ) differences++;
+	return differences;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include "ChessGameRecord.h"
+#include "../chess/ChessBoard.h"
+
+struct ChessPosition;
+class ChessRandom;
+
+// Totals of a batch of playouts (see ChessPlayout::run).
+struct ChessPlayoutStats
+{
+	ChessPlayoutStats();
+	void clear();
+	const double score( const bool isBlack ) const; // Wins plus half the draws, per playout.
+
+	uint64_t playouts;
+	uint64_t wins[2]; // By color, the king of the other color was captured.
+	uint64_t draws; // Side to move without moves, or the plies limit.
+	uint64_t plies;
+	uint64_t mismatches; // Verified plies where the kernel and ChessMovePicker disagree.
+};
+
+/**
+ Random game kernel for rollouts: the position is kept as bitboards (by color and type, plus the
+ pawns that used their double step and never move again) and each ply picks a random piece of the
+ side to move, then a random square among its targets, without building any move list. Pieces are
+ drawn again while the drawn one has no targets, so every piece that can move is equally likely.
+ Moves are the ones of ChessMovePicker::generate (and ChessGame::generateMoves); the game ends
+ when a king is captured.
+
+ Rollouts can also be driven ply by ply with guidedMove and makeMove, which add the bias of the
+ ChessMCTS playouts: the king is always taken when possible and captures are preferred.
+*/
+class ChessPlayout
+{
+public:
+	static const int DEFAULT_MAX_PLIES = 400;
+public:
+	ChessPlayout();
+	explicit ChessPlayout( const ChessPosition& position );
+	void setPosition( const ChessPosition& position );
+	const uint64_t targets( const int square ) const;
+	const bool blackToMove() const;
+	const uint64_t occupied() const;
+	const uint64_t occupied( const bool isBlack ) const;
+	const ChessGameRecord::RESULT play( ChessRandom& random, const int maxPlies, int& plies );
+	const bool guidedMove( ChessRandom& random, const double captureProbability, int& from, int& to ) const;
+	const ChessPiece::TYPE makeMove( const int from, const int to );
+	void getPosition( ChessPosition& position ) const;
+
+	static void run( const ChessPosition& position, const int count, const int maxPlies, ChessRandom& random, ChessPlayoutStats& stats, const bool verify = false );
+private:
+	const bool randomMove( ChessRandom& random, int& from, int& to ) const;
+	const uint64_t attackers( const int square, const bool isBlack ) const;
+	const uint64_t slide( const ChessPiece::TYPE type, const bool isBlack, const int square, const uint64_t occupied ) const;
+	static const int verify( const ChessPlayout& playout, const ChessPosition& position );
+private:
+	uint64_t m_pieces[2][ChessPiece::KING + 1]; // By color and type, NONE holds every piece of the color.
+	uint64_t m_frozen; // Pawns that used their double step.
+	uint8_t m_types[ChessBoard::CELLS_COUNT]; // ChessPiece::TYPE by square, NONE when empty.
+	bool m_blackToMove;
+};
+
+inline const bool ChessPlayout::blackToMove() const
+{
+	return m_blackToMove;
+}
+
+inline const uint64_t ChessPlayout::occupied() const
+{
+	return m_pieces[0][ChessPiece::NONE] | m_pieces[1][ChessPiece::NONE];
+}
+
+inline const uint64_t ChessPlayout::occupied( const bool isBlack ) const
+{
+	return m_pieces[isBlack][ChessPiece::NONE];
+}
@@ -0,0 +1,190 @@
+#include "ChessProfiler.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <iomanip>
+#include <algorithm>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#elif defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+	// Written only by its thread, read by snapshot() from any thread.
+	struct ThreadCounters
+	{
+		std::atomic< uint64_t > calls[ChessProfiler::COUNTERS_COUNT];
+		std::atomic< uint64_t > ticks[ChessProfiler::COUNTERS_COUNT];
+
+		ThreadCounters();
+		~ThreadCounters();
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector< ThreadCounters* > threads;
+		ChessProfiler::Stats finished = {}; // Counters of the threads that already exited.
+	};
+
+	Registry& registry()
+	{
+		static Registry instance;
+		return instance;
+	}
+
+	ThreadCounters::ThreadCounters()
+	{
+		for ( int i = 0; i < ChessProfiler::COUNTERS_COUNT; i++ )
+		{
+			calls[i].store( 0, std::memory_order_relaxed );
+			ticks[i].store( 0, std::memory_order_relaxed );
+		}
+		std::lock_guard< std::mutex > lock( registry().mutex );
+		registry().threads.push_back( this );
+	}
+
+	ThreadCounters::~ThreadCounters()
+	{
+		std::lock_guard< std::mutex > lock( registry().mutex );
+		auto& threads = registry().threads;
+		threads.erase( std::remove( threads.begin(), threads.end(), this ), threads.end() );
+		for ( int i = 0; i < ChessProfiler::COUNTERS_COUNT; i++ )
+		{
+			registry().finished.calls[i] += calls[i].load( std::memory_order_relaxed );
+			registry().finished.ticks[i] += ticks[i].load( std::memory_order_relaxed );
+		}
+	}
+
+	ThreadCounters& threadCounters()
+	{
+		static thread_local ThreadCounters counters;
+		return counters;
+	}
+
+	// Single writer: a relaxed load and store, no locked instruction.
+	inline void increase( std::atomic< uint64_t >& value, const uint64_t amount )
+	{
+		value.store( value.load( std::memory_order_relaxed ) + amount, std::memory_order_relaxed );
+	}
+
+	const char* const NAMES[ChessProfiler::COUNTERS_COUNT] =
+	{
+		"generateDecision",
+		"bookDecision",
+		"tablebaseDecision",
+		"randomDecision",
+		"eatRandomDecision",
+		"eatRandomDecisionSafe",
+		"eatByHierarchyDecisionSafe",
+		"intelligentDecision",
+		"searchDecision",
+		"mctsDecision",
+		"makeJakeMate",
+		"protect",
+		"makeJake",
+		"eatEnemySafe",
+		"eatEnemyNotSafe",
+		"moveLessImportant",
+		"getPossiblePositions",
+		"generateMoves",
+		"pieceMoves (generated)",
+		"getPossiblePositionsByPiece (generated)",
+		"isSafeToMoveTo",
+		"isAttacked",
+		"attackersTo",
+		"isInJake",
+		"getPossibleVictims"
+	};
+}
+
+void ChessProfiler::count( const COUNTER counter )
+{
+	increase( threadCounters().calls[counter], 1 );
+}
+
+void ChessProfiler::add( const COUNTER counter, const uint64_t ticks )
+{
+	ThreadCounters& counters = threadCounters();
+	increase( counters.calls[counter], 1 );
+	increase( counters.ticks[counter], ticks );
+}
+
+const uint64_t ChessProfiler::ticks()
+{
+#if defined( _MSC_VER ) || defined( __x86_64__ ) || defined( __i386__ )
+	return __rdtsc();
+#else
+	return uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+#endif
+}
+
+// Measured once against the steady clock.
+const double ChessProfiler::ticksPerMicrosecond()
+{
+	static const double value = []()
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const uint64_t startTicks = ticks();
+		std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+		const uint64_t elapsedTicks = ticks() - startTicks;
+		const double elapsed = std::chrono::duration< double, std::micro >( std::chrono::steady_clock::now() - start ).count();
+		return elapsed > 0.0 ? double( elapsedTicks ) / elapsed : 1.0;
+	}();
+	return value;
+}
+
+const char* ChessProfiler::name( const COUNTER counter )
+{
+	return NAMES[counter];
+}
+
+void ChessProfiler::snapshot( Stats& stats )
+{
+	std::lock_guard< std::mutex > lock( registry().mutex );
+	stats = registry().finished;
+	for ( const ThreadCounters* counters : registry().threads )
+	{
+		for ( int i = 0; i < COUNTERS_COUNT; i++ )
+		{
+			stats.calls[i] += counters->calls[i].load( std::memory_order_relaxed );
+			stats.ticks[i] += counters->ticks[i].load( std::memory_order_relaxed );
+		}
+	}
+}
+
+void ChessProfiler::reset()
+{
+	std::lock_guard< std::mutex > lock( registry().mutex );
+	registry().finished = Stats();
+	for ( ThreadCounters* counters : registry().threads )
+	{
+		for ( int i = 0; i < COUNTERS_COUNT; i++ )
+		{
+			counters->calls[i].store( 0, std::memory_order_relaxed );
+			counters->ticks[i].store( 0, std::memory_order_relaxed );
+		}
+	}
+}
+
+// One line per used counter: calls, total milliseconds and microseconds per call.
+void ChessProfiler::dump( std::ostream& stream )
+{
+	Stats stats;
+	snapshot( stats );
+	const double perMicrosecond = ticksPerMicrosecond();
+	stream << "-------------ChessProfiler---------------" << std::endl;
+	for ( int i = 0; i < COUNTERS_COUNT; i++ )
+	{
+		if ( stats.calls[i] == 0 ) continue;
+		const double microseconds = double( stats.ticks[i] ) / perMicrosecond;
+		stream << std::left << std::setw( 28 ) << NAMES[i] << std::right
+			   << std::setw( 12 ) << stats.calls[i]
+			   << std::setw( 12 ) << std::fixed << std::setprecision( 3 ) << microseconds / 1000.0 << " ms"
+			   << std::setw( 12 ) << microseconds / double( stats.calls[i] ) << " us/call" << std::endl;
+	}
+}
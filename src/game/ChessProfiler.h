@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+
+/**
+ Call counts and time spent per decision phase, generator and query. Compiled in only when
+ CHESS_PROFILING is defined: otherwise the macros below are empty and the stats stay at zero.
+ Counters live in a block owned by each thread (plain stores, no locking); snapshot() adds up
+ the blocks of every thread. Times are measured with the time stamp counter.
+*/
+class ChessProfiler
+{
+public:
+	enum COUNTER
+	{
+		// Decision phases (ChessPlayer).
+		GENERATE_DECISION = 0,
+		BOOK_DECISION,
+		TABLEBASE_DECISION,
+		RANDOM_DECISION,
+		EAT_RANDOM_DECISION,
+		EAT_RANDOM_DECISION_SAFE,
+		EAT_BY_HIERARCHY_DECISION_SAFE,
+		INTELLIGENT_DECISION,
+		SEARCH_DECISION,
+		MCTS_DECISION,
+		MAKE_JAKE_MATE,
+		PROTECT,
+		MAKE_JAKE,
+		EAT_ENEMY_SAFE,
+		EAT_ENEMY_NOT_SAFE,
+		MOVE_LESS_IMPORTANT,
+		// Generators (ChessGame).
+		GET_POSSIBLE_POSITIONS,
+		GENERATE_MOVES,
+		PIECE_MOVES_GENERATED,
+		FILTERED_MOVES_GENERATED,
+		// Queries (ChessGame).
+		IS_SAFE_TO_MOVE_TO,
+		IS_ATTACKED,
+		ATTACKERS_TO,
+		IS_IN_JAKE,
+		GET_POSSIBLE_VICTIMS,
+		COUNTERS_COUNT
+	};
+
+	struct Stats
+	{
+		uint64_t calls[COUNTERS_COUNT];
+		uint64_t ticks[COUNTERS_COUNT];
+	};
+public:
+	static void count( const COUNTER counter );
+	static void add( const COUNTER counter, const uint64_t ticks );
+	static const uint64_t ticks();
+	static const double ticksPerMicrosecond();
+	static const char* name( const COUNTER counter );
+
+	static void snapshot( Stats& stats );
+	static void reset();
+	static void dump( std::ostream& stream );
+};
+
+/**
+ Adds the lifetime of the scope to a counter (inclusive of the nested scopes).
+*/
+class ChessProfileScope
+{
+public:
+	ChessProfileScope( const ChessProfiler::COUNTER counter ) :
+		m_counter( counter ),
+		m_start( ChessProfiler::ticks() )
+	{};
+	~ChessProfileScope()
+	{
+		ChessProfiler::add( m_counter, ChessProfiler::ticks() - m_start );
+	};
+private:
+	ChessProfiler::COUNTER m_counter;
+	uint64_t m_start;
+};
+
+#ifdef CHESS_PROFILING
+#define CHESS_PROFILE_SCOPE( counter ) ChessProfileScope chessProfileScope_( ChessProfiler::counter )
+#define CHESS_PROFILE_COUNT( counter ) ChessProfiler::count( ChessProfiler::counter )
+#else
+#define CHESS_PROFILE_SCOPE( counter )
+#define CHESS_PROFILE_COUNT( counter )
+#endif
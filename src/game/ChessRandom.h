@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include <random>
+
+/**
+ xoshiro256** generator, owned by each game so parallel games do not share the std::rand state
+ and a game can be replayed from its seed (see ChessGameRecord::seed). The state is expanded
+ from the seed with splitmix64, any seed (0 included) is valid.
+*/
+class ChessRandom
+{
+public:
+	ChessRandom( const uint64_t seed = 1 );
+	void seed( const uint64_t seed );
+	const uint64_t next();
+	const double nextDouble(); // In [0, 1], both ends included (like std::rand() / RAND_MAX).
+	static const uint64_t entropySeed();
+private:
+	static const uint64_t rotl( const uint64_t x, const int k );
+private:
+	uint64_t m_state[4];
+};
+
+inline ChessRandom::ChessRandom( const uint64_t seed )
+{
+	this->seed( seed );
+}
+
+inline void ChessRandom::seed( const uint64_t seed )
+{
+	uint64_t x = seed;
+	for ( int i = 0; i < 4; i++ )
+	{
+		uint64_t z = ( x += 0x9E3779B97F4A7C15ull );
+		z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+		z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+		m_state[i] = z ^ ( z >> 31 );
+	}
+}
+
+inline const uint64_t ChessRandom::next()
+{
+	const uint64_t result = rotl( m_state[1] * 5, 7 ) * 9;
+	const uint64_t t = m_state[1] << 17;
+	m_state[2] ^= m_state[0];
+	m_state[3] ^= m_state[1];
+	m_state[1] ^= m_state[2];
+	m_state[0] ^= m_state[3];
+	m_state[2] ^= t;
+	m_state[3] = rotl( m_state[3], 45 );
+	return result;
+}
+
+inline const double ChessRandom::nextDouble()
+{
+	return double( next() >> 11 ) / double( ( uint64_t( 1 ) << 53 ) - 1 );
+}
+
+// For games without a seed in their settings.
+inline const uint64_t ChessRandom::entropySeed()
+{
+	std::random_device device;
+	const uint64_t clock = uint64_t( std::chrono::high_resolution_clock::now().time_since_epoch().count() );
+	return ( uint64_t( device() ) << 32 ^ device() ) ^ clock;
+}
+
+inline const uint64_t ChessRandom::rotl( const uint64_t x, const int k )
+{
+	return ( x << k ) | ( x >> ( 64 - k ) );
+}
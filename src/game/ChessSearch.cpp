@@ -0,0 +1,330 @@
+#include "ChessSearch.h"
+#include "ChessEvaluation.h"
+#include "ChessTablebase.h"
+#include "ChessTracer.h"
+#include "../chess/ChessPosition.h"
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+namespace
+{
+	// Win scores are stored relative to the node so they stay valid at another ply.
+	inline const int toTable( const int score, const int ply )
+	{
+		if ( !ChessSearch::isWinScore( score ) ) return score;
+		return score > 0 ? score + ply : score - ply;
+	}
+
+	inline const int fromTable( const int score, const int ply )
+	{
+		if ( !ChessSearch::isWinScore( score ) ) return score;
+		return score > 0 ? score - ply : score + ply;
+	}
+}
+
+ChessSearch::ChessSearch( const int tableBits ) :
+	m_tablebase( nullptr ),
+	m_table( size_t( 1 ) << tableBits ),
+	m_tableMask( ( uint64_t( 1 ) << tableBits ) - 1 ),
+	m_rootMove( ChessMovePicker::NO_MOVE ),
+	m_nodes( 0 ),
+	m_frames( MAX_PLY ),
+	m_ply( -1 ),
+	m_backingUp( false ),
+	m_score( 0 ),
+	m_depth( 0 ),
+	m_iteration( 0 ),
+	m_running( false ),
+	m_bestMove( ChessMovePicker::NO_MOVE ),
+	m_bestScore( 0 ),
+	m_bestDepth( 0 )
+{
+	clear();
+}
+
+ChessSearch::~ChessSearch()
+{}
+
+void ChessSearch::clear()
+{
+	std::fill( m_table.begin(), m_table.end(), TableEntry() );
+	std::fill( &m_killers[0][0], &m_killers[0][0] + MAX_PLY * ChessMovePicker::KILLERS_COUNT, ChessMove( ChessMovePicker::NO_MOVE ) );
+	m_nodes = 0;
+	m_running = false; // A search in progress is abandoned.
+}
+
+/**
+ Best move of the side to move, NO_MOVE if it has none. Each iteration starts with the best move
+ of the previous one (through the table).
+*/
+const ChessMove ChessSearch::search( const ChessPosition& position, const int depth, int& score )
+{
+	start( position, depth );
+	resume( 0 );
+	return result( score );
+}
+
+// Starts an iterative deepening search of the position, run by resume.
+void ChessSearch::start( const ChessPosition& position, const int depth )
+{
+	m_frames[0].position = position;
+	m_frames[0].piecesCount = position.piecesCount();
+	m_depth = depth;
+	m_iteration = 0;
+	m_bestMove = ChessMovePicker::NO_MOVE;
+	m_bestScore = 0;
+	m_bestDepth = 0;
+	m_running = true;
+	startIteration();
+}
+
+/**
+ Searches for the given time (0: until the end) and returns true once the search is over. The
+ clock is read every SLICE_CHECK_STEPS steps, a step being one node entered, left or backed up.
+ The slice also ends at these checks once the stop flag is set (by another thread), and before
+ any step once nodes() reaches maxNodes (0: no limit); a leaf entering its quiescence counts two
+ nodes, so the search may end one node over.
+*/
+const bool ChessSearch::resume( const int milliseconds, const std::atomic< bool >* stop, const uint64_t maxNodes )
+{
+	CHESS_TRACE_SCOPE( "searchSlice", "search" );
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( milliseconds );
+	for ( int steps = 1; m_running; steps++ )
+	{
+		if ( maxNodes != 0 && m_nodes >= maxNodes )
+		{
+			return false;
+		}
+		if ( steps % SLICE_CHECK_STEPS == 0 &&
+			 ( ( stop != nullptr && stop->load( std::memory_order_relaxed ) ) ||
+			   ( milliseconds > 0 && std::chrono::steady_clock::now() >= deadline ) ) )
+		{
+			return false;
+		}
+		step();
+	}
+	return true;
+}
+
+void ChessSearch::startIteration()
+{
+	if ( m_iteration >= m_depth )
+	{
+		m_running = false;
+		return;
+	}
+	m_iteration++;
+	if ( ChessTracer::enabled() )
+	{
+		ChessTracer::instant( "iteration", "search", "depth", m_iteration );
+	}
+	Frame& root = m_frames[0];
+	root.depth = m_iteration;
+	root.alpha = -INFINITE_SCORE;
+	root.beta = INFINITE_SCORE;
+	root.quiescence = false;
+	m_rootMove = ChessMovePicker::NO_MOVE;
+	m_ply = 0;
+	m_backingUp = false;
+}
+
+void ChessSearch::finishIteration( const int score )
+{
+	m_bestScore = score;
+	m_bestMove = m_rootMove;
+	m_bestDepth = m_iteration;
+	if ( m_bestMove == ChessMovePicker::NO_MOVE || isWinScore( score ) )
+	{
+		m_running = false;
+		return;
+	}
+	startIteration();
+}
+
+/**
+ One move of the walk: enters the frame m_ply, or gives it the score of its child. The frame then
+ either returns its score to its parent or opens the frame of its next move.
+*/
+void ChessSearch::step()
+{
+	int score = 0;
+	const bool done = m_backingUp ? backUp( m_ply, -m_score, score ) : enterNode( m_ply, score );
+	if ( !done && nextChild( m_ply ) )
+	{
+		m_ply++;
+		m_backingUp = false;
+		return;
+	}
+	m_score = done ? score : leaveNode( m_ply );
+	m_backingUp = true;
+	if ( --m_ply < 0 )
+	{
+		finishIteration( m_score );
+	}
+}
+
+/**
+ Start of a node (alpha-beta or quiescence, set by the parent): true if its score is known
+ without searching its moves (captured king, tablebase, table, stand pat), otherwise its picker is ready.
+*/
+const bool ChessSearch::enterNode( const int ply, int& score )
+{
+	Frame& frame = m_frames[ply];
+	const ChessPosition& position = frame.position;
+	m_nodes++;
+	if ( position.kingSquare[position.blackToMove] == -1 )
+	{
+		score = -WIN_SCORE + ply;
+		return true;
+	}
+	// The root is left to the caller, which needs a move (see ChessPlayer::tablebaseDecision).
+	ChessTablebaseResult tablebaseResult;
+	if ( ply > 0 && m_tablebase != nullptr && frame.piecesCount <= m_tablebase->maxPieces() && m_tablebase->probe( position, tablebaseResult ) )
+	{
+		const int winScore = WIN_SCORE - ply - tablebaseResult.distance;
+		score = tablebaseResult.wdl == ChessTablebaseResult::DRAW ? 0 : ( tablebaseResult.wdl == ChessTablebaseResult::WIN ? winScore : -winScore );
+		return true;
+	}
+
+	if ( !frame.quiescence && ( frame.depth <= 0 || ply >= MAX_PLY - 1 ) )
+	{
+		// Leaf of the alpha-beta search, the same frame continues as the quiescence root.
+		frame.quiescence = true;
+		m_nodes++;
+	}
+	if ( frame.quiescence )
+	{
+		const int standPat = ChessEvaluation::evaluate( position, position.blackToMove );
+		if ( standPat >= frame.beta || ply >= MAX_PLY - 1 )
+		{
+			score = standPat;
+			return true;
+		}
+		frame.alpha = std::max( frame.alpha, standPat );
+		frame.picker.reset( position, ChessMovePicker::NO_MOVE, nullptr, true );
+		return false;
+	}
+
+	frame.key = position.key();
+	const TableEntry& tableEntry = entry( frame.key );
+	ChessMove hashMove = ChessMovePicker::NO_MOVE;
+	if ( tableEntry.key == frame.key )
+	{
+		hashMove = tableEntry.move;
+		if ( ply > 0 && tableEntry.depth >= frame.depth )
+		{
+			const int tableScore = fromTable( tableEntry.score, ply );
+			if ( tableEntry.bound == BOUND_EXACT ||
+				 ( tableEntry.bound == BOUND_LOWER && tableScore >= frame.beta ) ||
+				 ( tableEntry.bound == BOUND_UPPER && tableScore <= frame.alpha ) )
+			{
+				score = tableScore;
+				return true;
+			}
+		}
+	}
+
+	frame.originalAlpha = frame.alpha;
+	frame.bestScore = -INFINITE_SCORE;
+	frame.bestMove = ChessMovePicker::NO_MOVE;
+	frame.picker.reset( position, hashMove, m_killers[ply] );
+	return false;
+}
+
+// Opens the frame of the next move of the node, false if it has no more moves.
+const bool ChessSearch::nextChild( const int ply )
+{
+	Frame& frame = m_frames[ply];
+	frame.move = frame.picker.next();
+	if ( frame.move == ChessMovePicker::NO_MOVE )
+	{
+		return false;
+	}
+	Frame& child = m_frames[ply + 1];
+	child.position = frame.position;
+	const bool captured = child.position.makeMove( ChessMovePicker::from( frame.move ), ChessMovePicker::to( frame.move ) ) != ChessPosition::NO_PIECE;
+	child.piecesCount = frame.piecesCount - ( captured ? 1 : 0 );
+	child.depth = frame.depth - 1;
+	child.alpha = -frame.beta;
+	child.beta = -frame.alpha;
+	child.quiescence = frame.quiescence;
+	return true;
+}
+
+// Score of the move of the frame, true on a cutoff (result is then the score of the node).
+const bool ChessSearch::backUp( const int ply, const int score, int& result )
+{
+	Frame& frame = m_frames[ply];
+	if ( frame.quiescence )
+	{
+		if ( score >= frame.beta )
+		{
+			result = score;
+			return true;
+		}
+		frame.alpha = std::max( frame.alpha, score );
+		return false;
+	}
+
+	if ( score > frame.bestScore )
+	{
+		frame.bestScore = score;
+		frame.bestMove = frame.move;
+		if ( score > frame.alpha )
+		{
+			frame.alpha = score;
+			if ( frame.alpha >= frame.beta )
+			{
+				if ( !ChessMovePicker::isCapture( frame.position, frame.move ) ) storeKiller( ply, frame.move );
+				result = leaveNode( ply );
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Score of the node once its moves are searched (or cut), stored in the table.
+const int ChessSearch::leaveNode( const int ply )
+{
+	Frame& frame = m_frames[ply];
+	if ( frame.quiescence )
+	{
+		return frame.alpha;
+	}
+	if ( frame.bestMove == ChessMovePicker::NO_MOVE )
+	{
+		return 0; // No move at all, the game cannot go on.
+	}
+	if ( ply == 0 )
+	{
+		m_rootMove = frame.bestMove;
+	}
+	TableEntry& tableEntry = entry( frame.key );
+	tableEntry.key = frame.key;
+	tableEntry.move = frame.bestMove;
+	tableEntry.score = int16_t( toTable( frame.bestScore, ply ) );
+	tableEntry.depth = int8_t( frame.depth );
+	tableEntry.bound = uint8_t( frame.bestScore >= frame.beta ? BOUND_LOWER : ( frame.bestScore > frame.originalAlpha ? BOUND_EXACT : BOUND_UPPER ) );
+	return frame.bestScore;
+}
+
+ChessSearch::TableEntry& ChessSearch::entry( const uint64_t key )
+{
+	return m_table[key & m_tableMask];
+}
+
+void ChessSearch::storeKiller( const int ply, const ChessMove move )
+{
+	ChessMove* killers = m_killers[ply];
+	if ( killers[0] != move )
+	{
+		for ( int i = ChessMovePicker::KILLERS_COUNT - 1; i > 0; i-- )
+		{
+			killers[i] = killers[i - 1];
+		}
+		killers[0] = move;
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include "ChessMovePicker.h"
+#include "../chess/ChessPosition.h"
+
+class ChessTablebase;
+
+/**
+ Alpha-beta search with iterative deepening, transposition table, killer moves and a captures
+ quiescence, on copies of ChessPosition. Moves come from a ChessMovePicker so cutoffs skip most
+ of the generation. Scores are centipawns for the side to move; capturing the king is worth
+ WIN_SCORE minus the plies needed.
+
+ The tree is walked with an explicit stack of frames (one per ply) instead of recursion, so a
+ search can be started, resumed for a slice of time on each frame of the host, and continue from
+ the same node. Slices do not change the result.
+
+ With a tablebase, the nodes below the root whose material it covers take its exact score (a win
+ or a loss in the plies it gives, counted like a king capture) instead of being searched. Those
+ plies go beyond MAX_PLY, so win scores span MAX_WIN_PLIES below WIN_SCORE (see isWinScore).
+*/
+class ChessSearch
+{
+public:
+	static const int WIN_SCORE = 30000;
+	static const int INFINITE_SCORE = 32000;
+	static const int MAX_PLY = 64;
+	static const int MAX_WIN_PLIES = MAX_PLY + 256; // Search plies plus the longest tablebase distance.
+	static const int TABLE_BITS = 16;
+	static const int DEFAULT_DEPTH = 4;
+	static const int SLICE_CHECK_STEPS = 256; // Steps between two reads of the clock in a slice.
+public:
+	ChessSearch( const int tableBits = TABLE_BITS );
+	~ChessSearch();
+	void clear();
+	void setTablebase( const ChessTablebase* tablebase );
+	const ChessMove search( const ChessPosition& position, const int depth, int& score );
+	void start( const ChessPosition& position, const int depth );
+	const bool resume( const int milliseconds, const std::atomic< bool >* stop = nullptr, const uint64_t maxNodes = 0 );
+	const bool running() const;
+	const ChessMove result( int& score ) const;
+	const int depth() const;
+	const uint64_t nodes() const;
+	static const bool isWinScore( const int score );
+private:
+	enum BOUND
+	{
+		BOUND_NONE = 0,
+		BOUND_UPPER = 1,
+		BOUND_LOWER = 2,
+		BOUND_EXACT = 3
+	};
+	struct TableEntry
+	{
+		uint64_t key;
+		ChessMove move;
+		int16_t score;
+		int8_t depth;
+		uint8_t bound;
+	};
+	// A node being searched, what the recursive alphaBeta / quiescence kept on the call stack.
+	struct Frame
+	{
+		ChessPosition position;
+		ChessMovePicker picker;
+		uint64_t key;
+		int depth;
+		int alpha;
+		int beta;
+		int originalAlpha;
+		int bestScore;
+		ChessMove move; // Searched in the child frame.
+		ChessMove bestMove;
+		bool quiescence;
+		int piecesCount; // Kings included, the tablebase is only probed with few pieces.
+	};
+	void step();
+	void startIteration();
+	void finishIteration( const int score );
+	const bool enterNode( const int ply, int& score );
+	const bool nextChild( const int ply );
+	const bool backUp( const int ply, const int score, int& result );
+	const int leaveNode( const int ply );
+	TableEntry& entry( const uint64_t key );
+	void storeKiller( const int ply, const ChessMove move );
+private:
+	ChessSearch( const ChessSearch& ) = delete;
+	ChessSearch& operator=( const ChessSearch& ) = delete;
+private:
+	const ChessTablebase* m_tablebase; // Not owned, nullptr: no probes.
+	std::vector< TableEntry > m_table;
+	uint64_t m_tableMask;
+	ChessMove m_killers[MAX_PLY][ChessMovePicker::KILLERS_COUNT];
+	ChessMove m_rootMove;
+	uint64_t m_nodes;
+
+	// Running search.
+	std::vector< Frame > m_frames; // [ply]
+	int m_ply; // Frame being searched, -1 once the iteration is over.
+	bool m_backingUp; // m_score is the result of the frame m_ply + 1.
+	int m_score;
+	int m_depth;
+	int m_iteration;
+	bool m_running;
+	ChessMove m_bestMove;
+	int m_bestScore;
+	int m_bestDepth; // Of the last finished iteration.
+};
+
+inline void ChessSearch::setTablebase( const ChessTablebase* tablebase )
+{
+	m_tablebase = tablebase;
+}
+
+inline const bool ChessSearch::running() const
+{
+	return m_running;
+}
+
+// Best move and score of the last finished iteration.
+inline const ChessMove ChessSearch::result( int& score ) const
+{
+	score = m_bestScore;
+	return m_bestMove;
+}
+
+inline const int ChessSearch::depth() const
+{
+	return m_bestDepth;
+}
+
+inline const uint64_t ChessSearch::nodes() const
+{
+	return m_nodes;
+}
+
+// Wins and losses, by king capture or tablebase.
+inline const bool ChessSearch::isWinScore( const int score )
+{
+	return std::abs( score ) > WIN_SCORE - MAX_WIN_PLIES;
+}
@@ -0,0 +1,705 @@
+#include "ChessTablebase.h"
+#include "ChessGame.h"
+#include "../chess/ChessBoard.h"
+#include "../chess/ChessPosition.h"
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <unordered_map>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+namespace
+{
+	const char TABLEBASE_MAGIC[4] = { 'C', 'T', 'B', '1' };
+	const int HEADER_SIZE = 16;
+	const int KING_SQUARES = 32; // The first white king is mirrored to files a-d.
+	const int MAX_DISTANCE = 254;
+	const uint8_t VALUE_UNKNOWN = ChessTablebase::VALUE_DRAW; // Positions never resolved are draws.
+	// Added to the moves counter of positions already won through a capture, so it never reaches zero.
+	const uint8_t WINNING_CAPTURE_GUARD = 128;
+
+	struct TablebasePiece
+	{
+		ChessPiece::TYPE type;
+		bool isBlack;
+		int square;
+	};
+
+	const int typeOrder( const ChessPiece::TYPE type )
+	{
+		switch ( type )
+		{
+			case ChessPiece::KING: return 0;
+			case ChessPiece::QUEEN: return 1;
+			case ChessPiece::ROOK: return 2;
+			case ChessPiece::BISHOP: return 3;
+			case ChessPiece::KNIGHT: return 4;
+			default: return 5;
+		}
+	}
+
+	const int typeValue( const ChessPiece::TYPE type )
+	{
+		switch ( type )
+		{
+			case ChessPiece::QUEEN: return 9;
+			case ChessPiece::ROOK: return 5;
+			case ChessPiece::BISHOP: return 3;
+			case ChessPiece::KNIGHT: return 3;
+			default: return 0;
+		}
+	}
+
+	const bool pieceLess( const TablebasePiece& a, const TablebasePiece& b )
+	{
+		if ( a.isBlack != b.isBlack ) return !a.isBlack;
+		if ( a.type != b.type ) return typeOrder( a.type ) < typeOrder( b.type );
+		return a.square < b.square;
+	}
+
+	// 3 bits per { color, type } counter.
+	const uint64_t materialKey( const TablebasePiece* pieces, const int count )
+	{
+		uint64_t key = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			key += 1ull << ( 3 * ( ( pieces[i].isBlack ? 7 : 0 ) + pieces[i].type ) );
+		}
+		return key;
+	}
+
+	const size_t tableSize( const int count )
+	{
+		size_t size = 2 * KING_SQUARES;
+		for ( int i = 1; i < count; i++ ) size *= ChessBoard::CELLS_COUNT;
+		return size;
+	}
+
+	std::string sideSignature( const TablebasePiece* pieces, const int count, const bool isBlack )
+	{
+		std::vector< TablebasePiece > side;
+		for ( int i = 0; i < count; i++ )
+		{
+			if ( pieces[i].isBlack == isBlack ) side.push_back( { pieces[i].type, false, 0 } );
+		}
+		std::sort( side.begin(), side.end(), pieceLess );
+		std::string signature;
+		for ( const auto& piece : side ) signature.push_back( ChessBoard::pieceSymbol( piece.type, false ) );
+		return signature;
+	}
+
+	std::string signatureOf( const TablebasePiece* pieces, const int count )
+	{
+		return sideSignature( pieces, count, false ) + "v" + sideSignature( pieces, count, true );
+	}
+
+	// Tables only exist with the stronger material as white.
+	const bool needsColorSwap( const TablebasePiece* pieces, const int count )
+	{
+		int strength[2] = { 0, 0 };
+		for ( int i = 0; i < count; i++ ) strength[pieces[i].isBlack] += typeValue( pieces[i].type );
+		if ( strength[0] != strength[1] ) return strength[1] > strength[0];
+		return sideSignature( pieces, count, true ) > sideSignature( pieces, count, false );
+	}
+
+	/**
+	 Puts the pieces in table order (colors swapped if needed, first white king mirrored to
+	 files a-d, then sorted) and returns the index of the position in its table.
+	*/
+	const size_t canonicalIndex( TablebasePiece* pieces, const int count, bool blackToMove, uint64_t& key )
+	{
+		if ( needsColorSwap( pieces, count ) )
+		{
+			for ( int i = 0; i < count; i++ ) pieces[i].isBlack = !pieces[i].isBlack;
+			blackToMove = !blackToMove;
+		}
+		for ( int i = 0; i < count; i++ )
+		{
+			if ( pieces[i].type == ChessPiece::KING && !pieces[i].isBlack )
+			{
+				if ( ( pieces[i].square % ChessBoard::SIZE ) >= ChessBoard::SIZE / 2 )
+				{
+					for ( int j = 0; j < count; j++ ) pieces[j].square ^= ChessBoard::SIZE - 1;
+				}
+				break;
+			}
+		}
+		std::sort( pieces, pieces + count, pieceLess );
+		key = materialKey( pieces, count );
+
+		assert( pieces[0].type == ChessPiece::KING && !pieces[0].isBlack );
+		size_t index = ( blackToMove ? 1 : 0 ) * KING_SQUARES;
+		index += ( pieces[0].square / ChessBoard::SIZE ) * ( ChessBoard::SIZE / 2 ) + ( pieces[0].square % ChessBoard::SIZE );
+		for ( int i = 1; i < count; i++ )
+		{
+			index = index * ChessBoard::CELLS_COUNT + pieces[i].square;
+		}
+		return index;
+	}
+
+	// Inverse of canonicalIndex, piece types and colors must already be in table order.
+	void decodeIndex( size_t index, TablebasePiece* pieces, const int count, bool& blackToMove )
+	{
+		for ( int i = count - 1; i > 0; i-- )
+		{
+			pieces[i].square = int( index % ChessBoard::CELLS_COUNT );
+			index /= ChessBoard::CELLS_COUNT;
+		}
+		const int king = int( index % KING_SQUARES );
+		pieces[0].square = ( king / ( ChessBoard::SIZE / 2 ) ) * ChessBoard::SIZE + king % ( ChessBoard::SIZE / 2 );
+		blackToMove = ( index / KING_SQUARES ) != 0;
+	}
+
+	// Decoded positions with overlapping pieces or unsorted twin pieces are never produced by canonicalIndex.
+	const bool isCanonical( const TablebasePiece* pieces, const int count )
+	{
+		for ( int i = 0; i < count; i++ )
+		{
+			for ( int j = i + 1; j < count; j++ )
+			{
+				if ( pieces[i].square == pieces[j].square ) return false;
+			}
+			if ( i > 0 && pieces[i].type == pieces[i - 1].type && pieces[i].isBlack == pieces[i - 1].isBlack && pieces[i].square < pieces[i - 1].square ) return false;
+		}
+		return true;
+	}
+
+	const bool parseSignature( const std::string& signature, std::vector< TablebasePiece >& pieces )
+	{
+		bool isBlack = false;
+		int kings[2] = { 0, 0 };
+		for ( const char symbol : signature )
+		{
+			if ( symbol == 'v' )
+			{
+				if ( isBlack ) return false;
+				isBlack = true;
+				continue;
+			}
+			bool unused = false;
+			const ChessPiece::TYPE type = ChessBoard::pieceType( symbol, unused );
+			if ( type == ChessPiece::NONE || type == ChessPiece::PAWN ) return false;
+			if ( type == ChessPiece::KING ) kings[isBlack]++;
+			pieces.push_back( { type, isBlack, 0 } );
+		}
+		return isBlack && kings[0] == 1 && kings[1] == 1 && int( pieces.size() ) <= ChessTablebase::MAX_PIECES;
+	}
+
+	/**
+	 Target squares by piece type and origin, taken from the game rules. Each ray stops at the first
+	 occupied square; a leaper (knight) ray has a single square.
+	*/
+	struct MoveTables
+	{
+		std::vector< std::vector< int > > rays[ChessPiece::KING + 1][ChessBoard::CELLS_COUNT];
+
+		MoveTables()
+		{
+			const ChessRules& rules = ChessRules::instance();
+			for ( int type = ChessPiece::ROOK; type <= ChessPiece::KING; type++ )
+			{
+				for ( const auto& cp : rules.getPaths( ChessPiece::TYPE( type ) ) )
+				{
+					const int steps = cp.totalSteps();
+					for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+					{
+						std::vector< int > ray;
+						for ( int i = ( type == ChessPiece::KNIGHT ? steps : 1 ); i <= steps; i++ )
+						{
+							const CellNode node = cp.getNode( i );
+							const int r = square / ChessBoard::SIZE + node.r;
+							const int c = square % ChessBoard::SIZE + node.c;
+							if ( r < 0 || r >= ChessBoard::SIZE || c < 0 || c >= ChessBoard::SIZE ) break;
+							ray.push_back( r * ChessBoard::SIZE + c );
+						}
+						if ( !ray.empty() ) rays[type][square].push_back( ray );
+					}
+				}
+			}
+		}
+	};
+
+	const MoveTables& moveTables()
+	{
+		static const MoveTables tables;
+		return tables;
+	}
+
+	const bool readResult( const uint8_t value, ChessTablebaseResult& result )
+	{
+		if ( value == ChessTablebase::VALUE_INVALID )
+		{
+			return false;
+		}
+		result.distance = value;
+		result.wdl = value == ChessTablebase::VALUE_DRAW ? ChessTablebaseResult::DRAW : ( value % 2 == 1 ? ChessTablebaseResult::WIN : ChessTablebaseResult::LOSS );
+		return true;
+	}
+
+	/**
+	 Retrograde analysis by distance layers. Positions where the side to move captures the king
+	 are won in 1 ply; then every layer un-moves from the positions resolved at the previous one:
+	 predecessors of a loss are wins, predecessors of a win lose once all their moves are losing.
+	 Captures lead to smaller tables, which are generated first.
+	*/
+	class TablebaseGenerator
+	{
+	public:
+		TablebaseGenerator( const int threadsCount, const std::string& directory );
+		const bool generate( std::vector< TablebasePiece > material );
+	private:
+		void build( const std::vector< TablebasePiece >& material, std::vector< uint8_t >& result );
+		void initialize( const std::vector< TablebasePiece >& material, const size_t begin, const size_t end, std::vector< std::pair< int, size_t > >& scheduled );
+		void retrograde( const std::vector< TablebasePiece >& material, const std::vector< size_t >& frontier, const size_t begin, const size_t end, const int distance, std::vector< size_t >& next, std::vector< std::pair< int, size_t > >& scheduled );
+		const uint8_t lookup( TablebasePiece* pieces, const int count, const bool blackToMove ) const;
+		const bool write( const std::vector< TablebasePiece >& material, const std::vector< uint8_t >& result ) const;
+		template< typename F > void parallelFor( const size_t size, F&& function );
+	private:
+		int m_threadsCount;
+		std::string m_directory;
+		std::unordered_map< uint64_t, std::vector< uint8_t > > m_tables;
+		// Working state of the table being built.
+		std::unique_ptr< std::atomic< uint8_t >[] > m_values;
+		std::unique_ptr< std::atomic< uint8_t >[] > m_counters;
+		std::vector< uint8_t > m_maxLosingCapture;
+	};
+
+	TablebaseGenerator::TablebaseGenerator( const int threadsCount, const std::string& directory ) :
+		m_threadsCount( std::max( threadsCount, 1 ) ),
+		m_directory( directory )
+	{}
+
+	template< typename F > void TablebaseGenerator::parallelFor( const size_t size, F&& function )
+	{
+		std::vector< std::thread > workers;
+		const size_t chunk = ( size + m_threadsCount - 1 ) / m_threadsCount;
+		for ( int i = 0; i < m_threadsCount; i++ )
+		{
+			const size_t begin = std::min( size, i * chunk );
+			const size_t end = std::min( size, begin + chunk );
+			workers.emplace_back( [&function, i, begin, end]() { function( i, begin, end ); } );
+		}
+		for ( auto& worker : workers )
+		{
+			worker.join();
+		}
+	}
+
+	const uint8_t TablebaseGenerator::lookup( TablebasePiece* pieces, const int count, const bool blackToMove ) const
+	{
+		uint64_t key = 0;
+		const size_t index = canonicalIndex( pieces, count, blackToMove, key );
+		return m_tables.at( key )[index];
+	}
+
+	const bool TablebaseGenerator::generate( std::vector< TablebasePiece > material )
+	{
+		uint64_t key = 0;
+		canonicalIndex( material.data(), int( material.size() ), false, key );
+		if ( m_tables.find( key ) != m_tables.end() )
+		{
+			return true;
+		}
+
+		// Every capture of a non king piece leads to a smaller table.
+		for ( size_t i = 0; i < material.size(); i++ )
+		{
+			if ( material[i].type == ChessPiece::KING ) continue;
+			std::vector< TablebasePiece > subMaterial( material );
+			subMaterial.erase( subMaterial.begin() + i );
+			if ( !generate( subMaterial ) ) return false;
+		}
+
+		std::vector< uint8_t > result;
+		build( material, result );
+		const bool written = write( material, result );
+		m_tables.emplace( key, std::move( result ) );
+		return written;
+	}
+
+	void TablebaseGenerator::build( const std::vector< TablebasePiece >& material, std::vector< uint8_t >& result )
+	{
+		const size_t size = tableSize( int( material.size() ) );
+		m_values.reset( new std::atomic< uint8_t >[size] );
+		m_counters.reset( new std::atomic< uint8_t >[size] );
+		m_maxLosingCapture.assign( size, 0 );
+
+		// layers[d]: positions resolved at distance d, deferred[d]: positions to resolve at d if still unknown.
+		std::vector< std::vector< size_t > > layers( MAX_DISTANCE + 2 );
+		std::vector< std::vector< size_t > > deferred( MAX_DISTANCE + 2 );
+		auto schedule = [&deferred]( const std::vector< std::pair< int, size_t > >& scheduled )
+		{
+			for ( const auto&[distance, index] : scheduled )
+			{
+				if ( distance <= MAX_DISTANCE ) deferred[distance].push_back( index );
+			}
+		};
+
+		std::vector< std::vector< std::pair< int, size_t > > > scheduled( m_threadsCount );
+		parallelFor( size, [&]( const int indexThread, const size_t begin, const size_t end )
+		{
+			initialize( material, begin, end, scheduled[indexThread] );
+		} );
+		for ( auto& threadScheduled : scheduled )
+		{
+			schedule( threadScheduled );
+			threadScheduled.clear();
+		}
+
+		std::vector< std::vector< size_t > > next( m_threadsCount );
+		for ( int distance = 1; distance <= MAX_DISTANCE; distance++ )
+		{
+			auto& frontier = layers[distance];
+			for ( const size_t index : deferred[distance] )
+			{
+				uint8_t unknown = VALUE_UNKNOWN;
+				if ( m_values[index].compare_exchange_strong( unknown, uint8_t( distance ) ) ) frontier.push_back( index );
+			}
+			deferred[distance].clear();
+
+			if ( distance < MAX_DISTANCE )
+			{
+				parallelFor( frontier.size(), [&]( const int indexThread, const size_t begin, const size_t end )
+				{
+					retrograde( material, frontier, begin, end, distance, next[indexThread], scheduled[indexThread] );
+				} );
+			}
+			for ( int i = 0; i < m_threadsCount; i++ )
+			{
+				layers[distance + 1].insert( layers[distance + 1].end(), next[i].begin(), next[i].end() );
+				next[i].clear();
+				schedule( scheduled[i] );
+				scheduled[i].clear();
+			}
+			frontier.clear();
+			frontier.shrink_to_fit();
+		}
+
+		result.resize( size );
+		for ( size_t i = 0; i < size; i++ )
+		{
+			const uint8_t value = m_values[i].load( std::memory_order_relaxed );
+			result[i] = ( value == VALUE_UNKNOWN ) ? ChessTablebase::VALUE_DRAW : value;
+		}
+		m_values.reset();
+		m_counters.reset();
+		m_maxLosingCapture.clear();
+	}
+
+	void TablebaseGenerator::initialize( const std::vector< TablebasePiece >& material, const size_t begin, const size_t end, std::vector< std::pair< int, size_t > >& scheduled )
+	{
+		const auto& tables = moveTables();
+		const int count = int( material.size() );
+		TablebasePiece pieces[ChessTablebase::MAX_PIECES];
+		TablebasePiece child[ChessTablebase::MAX_PIECES];
+		int occupancy[ChessBoard::CELLS_COUNT];
+
+		for ( size_t index = begin; index < end; index++ )
+		{
+			bool blackToMove = false;
+			std::copy( material.begin(), material.end(), pieces );
+			decodeIndex( index, pieces, count, blackToMove );
+			m_counters[index].store( 0, std::memory_order_relaxed );
+			if ( !isCanonical( pieces, count ) )
+			{
+				m_values[index].store( ChessTablebase::VALUE_INVALID, std::memory_order_relaxed );
+				continue;
+			}
+			m_values[index].store( VALUE_UNKNOWN, std::memory_order_relaxed );
+
+			std::fill( occupancy, occupancy + ChessBoard::CELLS_COUNT, -1 );
+			for ( int i = 0; i < count; i++ ) occupancy[pieces[i].square] = i;
+
+			int moves = 0, bestCapture = 0, maxLosingCapture = 0;
+			bool kingCapture = false;
+			for ( int i = 0; i < count && !kingCapture; i++ )
+			{
+				if ( pieces[i].isBlack != blackToMove ) continue;
+				for ( const auto& ray : tables.rays[pieces[i].type][pieces[i].square] )
+				{
+					for ( const int target : ray )
+					{
+						const int occupant = occupancy[target];
+						if ( occupant == -1 )
+						{
+							moves++;
+							continue;
+						}
+						if ( pieces[occupant].isBlack != blackToMove )
+						{
+							if ( pieces[occupant].type == ChessPiece::KING )
+							{
+								kingCapture = true;
+								break;
+							}
+							int childCount = 0;
+							for ( int j = 0; j < count; j++ )
+							{
+								if ( j == occupant ) continue;
+								child[childCount] = pieces[j];
+								if ( j == i ) child[childCount].square = target;
+								childCount++;
+							}
+							const uint8_t value = lookup( child, childCount, !blackToMove );
+							if ( value == ChessTablebase::VALUE_DRAW ) moves++;
+							else if ( value % 2 == 0 ) bestCapture = ( bestCapture == 0 ) ? value + 1 : std::min( bestCapture, value + 1 );
+							else maxLosingCapture = std::max( maxLosingCapture, int( value ) );
+						}
+						break;
+					}
+					if ( kingCapture ) break;
+				}
+			}
+
+			if ( kingCapture )
+			{
+				scheduled.emplace_back( 1, index );
+				continue;
+			}
+			m_maxLosingCapture[index] = uint8_t( maxLosingCapture );
+			if ( bestCapture > 0 )
+			{
+				scheduled.emplace_back( bestCapture, index );
+				moves += WINNING_CAPTURE_GUARD;
+			}
+			else if ( moves == 0 && maxLosingCapture > 0 )
+			{
+				// Every move is a capture into a lost position.
+				scheduled.emplace_back( maxLosingCapture + 1, index );
+			}
+			m_counters[index].store( uint8_t( moves ), std::memory_order_relaxed );
+		}
+	}
+
+	void TablebaseGenerator::retrograde( const std::vector< TablebasePiece >& material, const std::vector< size_t >& frontier, const size_t begin, const size_t end, const int distance, std::vector< size_t >& next, std::vector< std::pair< int, size_t > >& scheduled )
+	{
+		const auto& tables = moveTables();
+		const int count = int( material.size() );
+		const bool isLoss = ( distance % 2 == 0 ); // For the side to move in the frontier positions.
+		TablebasePiece pieces[ChessTablebase::MAX_PIECES];
+		TablebasePiece parent[ChessTablebase::MAX_PIECES];
+		int occupancy[ChessBoard::CELLS_COUNT];
+
+		for ( size_t k = begin; k < end; k++ )
+		{
+			bool blackToMove = false;
+			std::copy( material.begin(), material.end(), pieces );
+			decodeIndex( frontier[k], pieces, count, blackToMove );
+			std::fill( occupancy, occupancy + ChessBoard::CELLS_COUNT, -1 );
+			for ( int i = 0; i < count; i++ ) occupancy[pieces[i].square] = i;
+
+			// Un-move every piece of the side that just moved (moves are reversible for pawnless material).
+			for ( int i = 0; i < count; i++ )
+			{
+				if ( pieces[i].isBlack == blackToMove ) continue;
+				for ( const auto& ray : tables.rays[pieces[i].type][pieces[i].square] )
+				{
+					for ( const int target : ray )
+					{
+						if ( occupancy[target] != -1 ) break;
+						std::copy( pieces, pieces + count, parent );
+						parent[i].square = target;
+						uint64_t key = 0;
+						const size_t parentIndex = canonicalIndex( parent, count, !blackToMove, key );
+						if ( m_values[parentIndex].load( std::memory_order_relaxed ) != VALUE_UNKNOWN ) continue;
+
+						if ( isLoss )
+						{
+							uint8_t unknown = VALUE_UNKNOWN;
+							if ( m_values[parentIndex].compare_exchange_strong( unknown, uint8_t( distance + 1 ) ) ) next.push_back( parentIndex );
+						}
+						else if ( m_counters[parentIndex].fetch_sub( 1 ) == 1 )
+						{
+							const int lossDistance = std::max( distance + 1, m_maxLosingCapture[parentIndex] + 1 );
+							uint8_t unknown = VALUE_UNKNOWN;
+							if ( lossDistance != distance + 1 ) scheduled.emplace_back( lossDistance, parentIndex );
+							else if ( m_values[parentIndex].compare_exchange_strong( unknown, uint8_t( lossDistance ) ) ) next.push_back( parentIndex );
+						}
+					}
+				}
+			}
+		}
+	}
+
+	const bool TablebaseGenerator::write( const std::vector< TablebasePiece >& material, const std::vector< uint8_t >& result ) const
+	{
+		const std::string name = signatureOf( material.data(), int( material.size() ) );
+		const std::string path = m_directory + "/" + name + ".ctb";
+		std::ofstream stream( path, std::ios::binary );
+		if ( !stream )
+		{
+			std::cout << "Could not open " << path << std::endl;
+			return false;
+		}
+		char header[HEADER_SIZE] = {};
+		std::copy( TABLEBASE_MAGIC, TABLEBASE_MAGIC + 4, header );
+		header[4] = char( material.size() );
+		for ( size_t i = 0; i < material.size(); i++ )
+		{
+			header[5 + i] = char( material[i].type | ( material[i].isBlack ? 8 : 0 ) );
+		}
+		stream.write( header, HEADER_SIZE );
+		stream.write( reinterpret_cast< const char* >( result.data() ), std::streamsize( result.size() ) );
+
+		size_t wins = 0, losses = 0, draws = 0;
+		for ( const uint8_t value : result )
+		{
+			if ( value == ChessTablebase::VALUE_INVALID ) continue;
+			if ( value == ChessTablebase::VALUE_DRAW ) draws++;
+			else if ( value % 2 == 1 ) wins++;
+			else losses++;
+		}
+		std::cout << name << ": " << wins << " wins, " << losses << " losses, " << draws << " draws" << std::endl;
+		return bool( stream );
+	}
+}
+
+//============================== ChessTablebase ===============================
+
+ChessTablebase::ChessTablebase() :
+	m_maxPieces( 0 )
+{}
+
+ChessTablebase::~ChessTablebase()
+{
+	close();
+}
+
+/**
+ Maps every "*.ctb" file of the directory. Returns false if no table was found.
+*/
+const bool ChessTablebase::open( const std::string& directory )
+{
+	close();
+	std::error_code error;
+	for ( const auto& entry : std::filesystem::directory_iterator( directory, error ) )
+	{
+		if ( entry.path().extension() != ".ctb" ) continue;
+		ChessMappedFile* file = new ChessMappedFile();
+		if ( !file->open( entry.path().string() ) || file->size() < HEADER_SIZE || !std::equal( TABLEBASE_MAGIC, TABLEBASE_MAGIC + 4, file->data() ) )
+		{
+			delete file;
+			continue;
+		}
+		const int count = file->data()[4];
+		if ( count < 2 || count > MAX_PIECES || file->size() != HEADER_SIZE + tableSize( count ) )
+		{
+			delete file;
+			continue;
+		}
+		TablebasePiece pieces[MAX_PIECES];
+		for ( int i = 0; i < count; i++ )
+		{
+			const uint8_t code = file->data()[5 + i];
+			pieces[i] = { ChessPiece::TYPE( code & 7 ), ( code & 8 ) != 0, 0 };
+		}
+		m_tables[materialKey( pieces, count )] = { count, file->data() + HEADER_SIZE };
+		m_files.push_back( file );
+		m_maxPieces = std::max( m_maxPieces, count );
+	}
+	return !m_tables.empty();
+}
+
+void ChessTablebase::close()
+{
+	for ( auto file : m_files )
+	{
+		delete file;
+	}
+	m_files.clear();
+	m_tables.clear();
+	m_maxPieces = 0;
+}
+
+const bool ChessTablebase::probe( const ChessBoard& board, const bool blackToMove, ChessTablebaseResult& result ) const
+{
+	const auto& pieces = board.getPieces();
+	if ( int( pieces.size() ) > m_maxPieces )
+	{
+		return false;
+	}
+	ChessPiece::TYPE types[MAX_PIECES];
+	bool blacks[MAX_PIECES];
+	int squares[MAX_PIECES];
+	int count = 0;
+	for ( const auto&[indexPiece, piece] : pieces )
+	{
+		types[count] = piece.type();
+		blacks[count] = piece.isBlack();
+		squares[count] = piece.row() * ChessBoard::SIZE + piece.column();
+		count++;
+	}
+	return probe( count, types, blacks, squares, blackToMove, result );
+}
+
+// For the searches: gives up as soon as the position has more pieces than the largest table.
+const bool ChessTablebase::probe( const ChessPosition& position, ChessTablebaseResult& result ) const
+{
+	ChessPiece::TYPE types[MAX_PIECES];
+	bool blacks[MAX_PIECES];
+	int squares[MAX_PIECES];
+	int count = 0;
+	for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+	{
+		const int indexPiece = position.cells[square];
+		if ( indexPiece == ChessPosition::NO_PIECE )
+		{
+			continue;
+		}
+		if ( count == m_maxPieces )
+		{
+			return false;
+		}
+		types[count] = position.type( indexPiece );
+		blacks[count] = position.isBlack( indexPiece );
+		squares[count] = square;
+		count++;
+	}
+	return probe( count, types, blacks, squares, position.blackToMove, result );
+}
+
+const bool ChessTablebase::probe( const int count, const ChessPiece::TYPE* types, const bool* blacks, const int* squares, const bool blackToMove, ChessTablebaseResult& result ) const
+{
+	if ( count < 2 || count > m_maxPieces )
+	{
+		return false;
+	}
+	TablebasePiece pieces[MAX_PIECES];
+	int kings[2] = { 0, 0 };
+	for ( int i = 0; i < count; i++ )
+	{
+		if ( types[i] == ChessPiece::PAWN ) return false;
+		if ( types[i] == ChessPiece::KING ) kings[blacks[i]]++;
+		pieces[i] = { types[i], blacks[i], squares[i] };
+	}
+	if ( kings[0] != 1 || kings[1] != 1 )
+	{
+		return false;
+	}
+	uint64_t key = 0;
+	const size_t index = canonicalIndex( pieces, count, blackToMove, key );
+	const auto table = m_tables.find( key );
+	if ( table == m_tables.end() )
+	{
+		return false;
+	}
+	return readResult( table->second.values[index], result );
+}
+
+/**
+ Generates the table of the given material ("KQvKR") and every smaller table it depends on.
+*/
+const bool ChessTablebase::generate( const std::string& signature, const std::string& directory, const int threadsCount )
+{
+	std::vector< TablebasePiece > material;
+	if ( !parseSignature( signature, material ) )
+	{
+		return false;
+	}
+	TablebaseGenerator generator( threadsCount, directory );
+	return generator.generate( material );
+}
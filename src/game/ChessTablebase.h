@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include "../chess/ChessPiece.h"
+#include "ChessMappedFile.h"
+
+class ChessBoard;
+struct ChessPosition;
+
+struct ChessTablebaseResult
+{
+	enum WDL
+	{
+		LOSS = -1,
+		DRAW = 0,
+		WIN = 1
+	};
+	WDL wdl; // For the side to move.
+	int distance; // Plies until the king capture (0 for draws).
+};
+
+/**
+ Endgame tablebases for pawnless material with up to MAX_PIECES pieces (kings included).
+ One file per material ("KQvKR.ctb"): a 16 bytes header followed by one byte per position,
+ indexed by side to move and the squares of the pieces, with the first white king mirrored
+ to files a-d. Byte values: 0 draw, odd N win in N plies, even N loss in N plies, 255 invalid.
+*/
+class ChessTablebase
+{
+public:
+	static const int MAX_PIECES = 5;
+	static const uint8_t VALUE_DRAW = 0;
+	static const uint8_t VALUE_INVALID = 255;
+public:
+	ChessTablebase();
+	~ChessTablebase();
+	const bool open( const std::string& directory );
+	void close();
+	const int maxPieces() const;
+	const bool probe( const ChessBoard& board, const bool blackToMove, ChessTablebaseResult& result ) const;
+	const bool probe( const ChessPosition& position, ChessTablebaseResult& result ) const;
+	const bool probe( const int count, const ChessPiece::TYPE* types, const bool* blacks, const int* squares, const bool blackToMove, ChessTablebaseResult& result ) const;
+
+	static const bool generate( const std::string& signature, const std::string& directory, const int threadsCount );
+private:
+	ChessTablebase( const ChessTablebase& ) = delete;
+	ChessTablebase& operator=( const ChessTablebase& ) = delete;
+private:
+	struct Table
+	{
+		int count;
+		const uint8_t* values;
+	};
+	std::vector< ChessMappedFile* > m_files;
+	std::unordered_map< uint64_t, Table > m_tables; // By material key.
+	int m_maxPieces;
+};
+
+inline const int ChessTablebase::maxPieces() const
+{
+	return m_maxPieces;
+}
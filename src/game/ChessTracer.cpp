@@ -0,0 +1,246 @@
+#include "ChessTracer.h"
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+std::atomic< bool > ChessTracer::s_enabled( false );
+
+namespace
+{
+	struct Event
+	{
+		const char* name;
+		const char* category;
+		const char* argName;
+		int64_t argValue;
+		uint64_t time; // Nanoseconds since the epoch of the registry.
+		char phase; // 'B', 'E' or 'i'.
+	};
+
+	struct ThreadEvents
+	{
+		int id;
+		std::string name;
+		std::vector< Event > events;
+		size_t dropped = 0; // Once the buffer was full.
+		int droppedOpen = 0; // Begin events dropped, their end events are dropped too.
+	};
+
+	// Owned by its thread; the mutex is only contended while the trace is written or cleared.
+	struct ThreadBuffer
+	{
+		std::mutex mutex;
+		ThreadEvents data;
+
+		ThreadBuffer();
+		~ThreadBuffer();
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector< ThreadBuffer* > threads;
+		std::vector< ThreadEvents > finished; // Events of the threads that already exited.
+		std::string fileName;
+		int nextThreadId = 1;
+		const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+		~Registry();
+	};
+
+	Registry& registry()
+	{
+		static Registry instance;
+		return instance;
+	}
+
+	ThreadBuffer::ThreadBuffer()
+	{
+		std::lock_guard< std::mutex > lock( registry().mutex );
+		data.id = registry().nextThreadId++;
+		data.name = "thread " + std::to_string( data.id );
+		registry().threads.push_back( this );
+	}
+
+	ThreadBuffer::~ThreadBuffer()
+	{
+		std::lock_guard< std::mutex > lock( registry().mutex );
+		auto& threads = registry().threads;
+		threads.erase( std::remove( threads.begin(), threads.end(), this ), threads.end() );
+		if ( !data.events.empty() )
+		{
+			registry().finished.push_back( std::move( data ) );
+		}
+	}
+
+	ThreadBuffer& threadBuffer()
+	{
+		static thread_local ThreadBuffer buffer;
+		return buffer;
+	}
+
+	void record( const char phase, const char* name, const char* category, const char* argName, const int64_t argValue )
+	{
+		const uint64_t time = uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - registry().epoch ).count() );
+		ThreadBuffer& buffer = threadBuffer();
+		std::lock_guard< std::mutex > lock( buffer.mutex );
+		ThreadEvents& data = buffer.data;
+		if ( data.events.size() >= ChessTracer::MAX_THREAD_EVENTS && ( phase != 'E' || data.droppedOpen > 0 ) )
+		{
+			data.droppedOpen += phase == 'B' ? 1 : ( phase == 'E' ? -1 : 0 );
+			data.dropped++;
+			return;
+		}
+		data.events.push_back( Event{ name, category, argName, argValue, time, phase } );
+	}
+
+	// JSON string, quotes included.
+	void writeString( std::ostream& stream, const char* text )
+	{
+		stream << '"';
+		for ( ; *text != '\0'; text++ )
+		{
+			const char c = *text;
+			if ( c == '"' || c == '\\' )
+			{
+				stream << '\\' << c;
+			}
+			else if ( static_cast< unsigned char >( c ) < 0x20 )
+			{
+				stream << "\\u" << std::hex << std::setw( 4 ) << std::setfill( '0' ) << int( c ) << std::dec << std::setfill( ' ' );
+			}
+			else
+			{
+				stream << c;
+			}
+		}
+		stream << '"';
+	}
+
+	void writeEvents( std::ostream& stream, const ThreadEvents& thread, bool& first )
+	{
+		const std::string name = thread.dropped == 0 ? thread.name : thread.name + " (" + std::to_string( thread.dropped ) + " events dropped)";
+		stream << ( first ? "\n" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.id << ",\"args\":{\"name\":";
+		writeString( stream, name.c_str() );
+		stream << "}}";
+		first = false;
+		for ( const Event& event : thread.events )
+		{
+			stream << ",\n{\"name\":";
+			writeString( stream, event.name );
+			stream << ",\"cat\":";
+			writeString( stream, event.category );
+			stream << ",\"ph\":\"" << event.phase
+				   << "\",\"ts\":" << event.time / 1000 << '.' << std::setw( 3 ) << std::setfill( '0' ) << event.time % 1000 << std::setfill( ' ' )
+				   << ",\"pid\":1,\"tid\":" << thread.id;
+			if ( event.phase == 'i' )
+			{
+				stream << ",\"s\":\"t\"";
+			}
+			if ( event.argName != nullptr )
+			{
+				stream << ",\"args\":{";
+				writeString( stream, event.argName );
+				stream << ":" << event.argValue << "}";
+			}
+			stream << "}";
+		}
+	}
+
+	void writeTrace( Registry& registry, std::ostream& stream )
+	{
+		std::lock_guard< std::mutex > lock( registry.mutex );
+		bool first = true;
+		stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		for ( const ThreadEvents& thread : registry.finished )
+		{
+			writeEvents( stream, thread, first );
+		}
+		for ( ThreadBuffer* buffer : registry.threads )
+		{
+			std::lock_guard< std::mutex > bufferLock( buffer->mutex );
+			writeEvents( stream, buffer->data, first );
+		}
+		stream << "\n]}" << std::endl;
+	}
+
+	// The trace asked for by start( fileName ) is written when the process exits.
+	Registry::~Registry()
+	{
+		if ( !fileName.empty() )
+		{
+			std::ofstream file( fileName );
+			writeTrace( *this, file );
+		}
+	}
+}
+
+void ChessTracer::start( const std::string& fileName )
+{
+	{
+		std::lock_guard< std::mutex > lock( registry().mutex );
+		registry().fileName = fileName;
+	}
+	s_enabled.store( true, std::memory_order_relaxed );
+}
+
+void ChessTracer::stop()
+{
+	s_enabled.store( false, std::memory_order_relaxed );
+}
+
+void ChessTracer::clear()
+{
+	std::lock_guard< std::mutex > lock( registry().mutex );
+	registry().finished.clear();
+	for ( ThreadBuffer* buffer : registry().threads )
+	{
+		std::lock_guard< std::mutex > bufferLock( buffer->mutex );
+		buffer->data.events.clear();
+		buffer->data.dropped = 0;
+	}
+}
+
+void ChessTracer::begin( const char* name, const char* category, const char* argName, const int64_t argValue )
+{
+	if ( !enabled() ) return;
+	record( 'B', name, category, argName, argValue );
+}
+
+void ChessTracer::end( const char* name, const char* category )
+{
+	// Also recorded when stopped in between, so the begin event is not left open.
+	record( 'E', name, category, nullptr, 0 );
+}
+
+void ChessTracer::instant( const char* name, const char* category, const char* argName, const int64_t argValue )
+{
+	if ( !enabled() ) return;
+	record( 'i', name, category, argName, argValue );
+}
+
+void ChessTracer::setThreadName( const std::string& name )
+{
+	ThreadBuffer& buffer = threadBuffer();
+	std::lock_guard< std::mutex > lock( buffer.mutex );
+	buffer.data.name = name;
+}
+
+void ChessTracer::write( std::ostream& stream )
+{
+	writeTrace( registry(), stream );
+}
+
+const bool ChessTracer::write( const std::string& fileName )
+{
+	std::ofstream file( fileName );
+	if ( !file.is_open() )
+	{
+		return false;
+	}
+	write( file );
+	return file.good();
+}
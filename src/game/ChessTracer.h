@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <ostream>
+#include <atomic>
+
+/**
+ Timeline of begin/end and instant events in the Chrome trace-event format (chrome://tracing,
+ Perfetto). Off by default: while stopped every call returns after one relaxed load. Events go
+ to a buffer owned by the calling thread, so games played on several threads show up as separate
+ tracks. Names and categories must be string literals (only the pointer is kept).
+
+ A thread keeps at most MAX_THREAD_EVENTS events: once full, its new events are dropped (except
+ the end events of begin events already kept) and their count is appended to the thread name.
+*/
+class ChessTracer
+{
+public:
+	static const size_t MAX_THREAD_EVENTS = 1 << 18; // 12 MB.
+public:
+	// The trace is written to fileName when the process exits (nothing is written if empty).
+	static void start( const std::string& fileName = std::string() );
+	static void stop();
+	static const bool enabled();
+	static void clear();
+
+	static void begin( const char* name, const char* category, const char* argName = nullptr, const int64_t argValue = 0 );
+	static void end( const char* name, const char* category );
+	static void instant( const char* name, const char* category, const char* argName = nullptr, const int64_t argValue = 0 );
+	static void setThreadName( const std::string& name );
+
+	// On demand: events of every thread recorded so far.
+	static void write( std::ostream& stream );
+	static const bool write( const std::string& fileName );
+private:
+	static std::atomic< bool > s_enabled;
+};
+
+inline const bool ChessTracer::enabled()
+{
+	return s_enabled.load( std::memory_order_relaxed );
+}
+
+/**
+ Begin event on construction, end event on destruction. Nothing is recorded if the tracer was
+ stopped when the scope started.
+*/
+class ChessTraceScope
+{
+public:
+	ChessTraceScope( const char* name, const char* category, const char* argName = nullptr, const int64_t argValue = 0 ) :
+		m_name( nullptr ),
+		m_category( category )
+	{
+		if ( ChessTracer::enabled() )
+		{
+			m_name = name;
+			ChessTracer::begin( name, category, argName, argValue );
+		}
+	};
+	~ChessTraceScope()
+	{
+		if ( m_name != nullptr )
+		{
+			ChessTracer::end( m_name, m_category );
+		}
+	};
+private:
+	ChessTraceScope( const ChessTraceScope& ) = delete;
+	ChessTraceScope& operator=( const ChessTraceScope& ) = delete;
+private:
+	const char* m_name;
+	const char* m_category;
+};
+
+#define CHESS_TRACE_SCOPE( name, category ) ChessTraceScope chessTraceScope_( name, category )
@@ -1,6 +1,9 @@
 #include "../../../game/ChessGame.h"
+#include "../../../game/ChessOpeningBook.h"
+#include "../../../game/ChessTablebase.h"
 #include <thread>
 #include <chrono>
+#include <fstream>
 
 class Application
 {
@@ -9,10 +12,14 @@ public:
 	~Application();
 public:
 	void start();
+	void recordGames( const char* path );
 private:
 	bool m_finished;
 	std::chrono::steady_clock::time_point m_lastTime;
 	ChessGame* m_game;
+	ChessOpeningBook m_openingBook;
+	ChessTablebase m_tablebase;
+	std::ofstream m_recordStream;
 };
 
 Application::Application():
@@ -21,6 +28,14 @@ Application::Application():
 {
 	ChessGameSettings settings( true, 0, 0, 4 );
 	m_game = new ChessGame( settings );
+	if ( m_openingBook.open( "book.bin" ) )
+	{
+		m_game->setOpeningBook( &m_openingBook );
+	}
+	if ( m_tablebase.open( "tablebases" ) )
+	{
+		m_game->setTablebase( &m_tablebase );
+	}
 }
 
 Application::~Application()
@@ -29,6 +44,16 @@ Application::~Application()
 	m_game = nullptr;
 }
 
+void Application::recordGames( const char* path )
+{
+	m_recordStream.open( path, std::ios::binary );
+	if ( m_recordStream )
+	{
+		ChessGameRecord::writeHeader( m_recordStream );
+		m_game->setRecordStream( &m_recordStream );
+	}
+}
+
 void Application::start()
 {
 	m_lastTime = std::chrono::steady_clock::now();
@@ -46,8 +71,12 @@ void Application::start()
 	}
 }
 
-int main()
+int main( int argc, char** argv )
 {
 	Application app;
+	if ( argc > 1 )
+	{
+		app.recordGames( argv[1] ); // Finished games are appended to this file (see book_builder).
+	}
 	app.start();
 }
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "../../../game/ChessGame.h"
+#include "../../../game/ChessGameRecord.h"
+#include "../../../game/ChessGameReader.h"
+#include "../../../game/ChessOpeningBook.h"
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+
+/**
+ Builds an opening book from recorded games.
+ The inputs are read once (see ChessGameReader); every worker replays the games it is handed and
+ aggregates { position, move } statistics in its own sharded hash maps, then shards are merged in
+ parallel and written sorted by key.
+
+ usage: book_builder <output book> <games.cgr | games.pgn>... [-threads N] [-min N] [-plies N]
+*/
+
+namespace
+{
+	const int SHARD_BITS = 6;
+	const int SHARDS_COUNT = 1 << SHARD_BITS;
+
+	struct PositionMove
+	{
+		uint64_t key;
+		uint16_t move;
+		bool operator==( const PositionMove& other ) const
+		{
+			return key == other.key && move == other.move;
+		}
+	};
+
+	struct PositionMoveHash
+	{
+		size_t operator()( const PositionMove& pm ) const
+		{
+			return size_t( pm.key ^ ( uint64_t( pm.move ) * 0x9E3779B97F4A7C15ull ) );
+		}
+	};
+
+	struct MoveStats
+	{
+		uint32_t wins = 0;
+		uint32_t draws = 0;
+		uint32_t losses = 0;
+	};
+
+	typedef std::unordered_map< PositionMove, MoveStats, PositionMoveHash > Shard;
+
+	// Shards are contiguous key ranges, so concatenating sorted shards gives a sorted book.
+	inline int shardOf( const uint64_t key )
+	{
+		return int( key >> ( 64 - SHARD_BITS ) );
+	}
+}
+
+class BookBuilder
+{
+public:
+	BookBuilder( const int threadsCount, const int maxPlies );
+	void addInput( const std::string& path );
+	void build();
+	const bool write( const std::string& path, const uint32_t minGames ) const;
+private:
+	void replay( const int indexThread, ChessGame& game, const ChessGameRecord& record );
+	void merge( const int indexShard, const uint32_t minGames, std::vector< ChessBookEntry >& entries ) const;
+private:
+	int m_threadsCount;
+	int m_maxPlies;
+	std::vector< std::string > m_inputs;
+	std::vector< std::vector< Shard > > m_shards; // [thread][shard]
+	std::vector< size_t > m_gamesCount; // [thread]
+};
+
+BookBuilder::BookBuilder( const int threadsCount, const int maxPlies ) :
+	m_threadsCount( std::max( threadsCount, 1 ) ),
+	m_maxPlies( maxPlies )
+{}
+
+void BookBuilder::addInput( const std::string& path )
+{
+	m_inputs.push_back( path );
+}
+
+void BookBuilder::build()
+{
+	m_shards.assign( m_threadsCount, std::vector< Shard >( SHARDS_COUNT ) );
+	m_gamesCount.assign( m_threadsCount, 0 );
+	// One game per worker, PGN games are parsed into the record of their worker.
+	std::vector< std::unique_ptr< ChessGame > > workerGames( m_threadsCount );
+	std::vector< ChessGameRecord > workerRecords( m_threadsCount );
+	for ( auto& game : workerGames )
+	{
+		game.reset( new ChessGame( ChessGameSettings( false, 0 ) ) );
+	}
+	ChessGameReader reader( m_inputs );
+	reader.process( m_threadsCount, [this, &workerGames, &workerRecords]( const int indexThread, ChessGameInput& input )
+	{
+		ChessGame& game = *workerGames[indexThread];
+		ChessGameRecord& record = workerRecords[indexThread];
+		if ( input.pgn.empty() )
+		{
+			replay( indexThread, game, input.record );
+		}
+		else if ( game.loadPGN( input.pgn, record ) )
+		{
+			replay( indexThread, game, record );
+		}
+	} );
+	size_t games = 0;
+	for ( const size_t count : m_gamesCount ) games += count;
+	std::cout << "Games replayed: " << games << std::endl;
+}
+
+void BookBuilder::replay( const int indexThread, ChessGame& game, const ChessGameRecord& record )
+{
+	auto& shards = m_shards[indexThread];
+	if ( !game.loadStart( record ) )
+	{
+		return;
+	}
+	m_gamesCount[indexThread]++;
+
+	const int plies = std::min( int( record.moves.size() ), m_maxPlies );
+	for ( int i = 0; i < plies; i++ )
+	{
+		const uint64_t key = game.positionHash();
+		const bool isBlack = game.isBlackTurn();
+		CellNode from, to;
+		ChessOpeningBook::decodeMove( record.moves[i], from, to );
+		if ( !game.playMove( from, to ) )
+		{
+			break;
+		}
+		auto& stats = shards[shardOf( key )][{ key, record.moves[i] }];
+		if ( record.result == ChessGameRecord::DRAW || record.result == ChessGameRecord::UNKNOWN )
+		{
+			stats.draws++;
+		}
+		else if ( ( record.result == ChessGameRecord::BLACK_WINS ) == isBlack )
+		{
+			stats.wins++;
+		}
+		else
+		{
+			stats.losses++;
+		}
+	}
+}
+
+/**
+ Weight of a move = 2 * wins + draws from the point of view of the side that played it,
+ scaled down per position when it does not fit in 16 bits.
+*/
+void BookBuilder::merge( const int indexShard, const uint32_t minGames, std::vector< ChessBookEntry >& entries ) const
+{
+	Shard merged;
+	for ( const auto& shards : m_shards )
+	{
+		for ( const auto&[positionMove, stats] : shards[indexShard] )
+		{
+			auto& total = merged[positionMove];
+			total.wins += stats.wins;
+			total.draws += stats.draws;
+			total.losses += stats.losses;
+		}
+	}
+
+	std::vector< std::pair< ChessBookEntry, uint64_t > > buffer; // { entry, points }
+	buffer.reserve( merged.size() );
+	for ( const auto&[positionMove, stats] : merged )
+	{
+		const uint64_t points = 2ull * stats.wins + stats.draws;
+		if ( points == 0 || stats.wins + stats.draws + stats.losses < minGames ) continue;
+		buffer.push_back( { { positionMove.key, positionMove.move, 0, 0 }, points } );
+	}
+	std::sort( buffer.begin(), buffer.end(), []( const auto& a, const auto& b )
+	{
+		// Ties by move, so the book does not depend on the threads count.
+		if ( a.first.key != b.first.key ) return a.first.key < b.first.key;
+		return a.second != b.second ? a.second > b.second : a.first.move < b.first.move;
+	} );
+
+	entries.reserve( buffer.size() );
+	for ( size_t begin = 0; begin < buffer.size(); )
+	{
+		// Entries of a position are sorted by points, the first one has the maximum.
+		size_t end = begin;
+		while ( end < buffer.size() && buffer[end].first.key == buffer[begin].first.key ) end++;
+		const uint64_t maxPoints = buffer[begin].second;
+		for ( size_t i = begin; i < end; i++ )
+		{
+			ChessBookEntry entry = buffer[i].first;
+			const uint64_t weight = maxPoints > 0xFFFF ? ( buffer[i].second * 0xFFFF ) / maxPoints : buffer[i].second;
+			entry.weight = uint16_t( std::max< uint64_t >( weight, 1 ) );
+			entries.push_back( entry );
+		}
+		begin = end;
+	}
+}
+
+const bool BookBuilder::write( const std::string& path, const uint32_t minGames ) const
+{
+	std::vector< std::vector< ChessBookEntry > > entries( SHARDS_COUNT );
+	std::vector< std::thread > workers;
+	for ( int i = 0; i < m_threadsCount; i++ )
+	{
+		workers.emplace_back( [this, i, minGames, &entries]()
+		{
+			for ( int indexShard = i; indexShard < SHARDS_COUNT; indexShard += m_threadsCount )
+			{
+				merge( indexShard, minGames, entries[indexShard] );
+			}
+		} );
+	}
+	for ( auto& worker : workers )
+	{
+		worker.join();
+	}
+
+	std::ofstream stream( path, std::ios::binary );
+	if ( !stream )
+	{
+		return false;
+	}
+	size_t count = 0;
+	std::vector< unsigned char > buffer;
+	for ( const auto& shardEntries : entries )
+	{
+		buffer.resize( shardEntries.size() * ChessOpeningBook::ENTRY_SIZE );
+		for ( size_t i = 0; i < shardEntries.size(); i++ )
+		{
+			ChessOpeningBook::writeEntry( buffer.data() + i * ChessOpeningBook::ENTRY_SIZE, shardEntries[i] );
+		}
+		stream.write( reinterpret_cast< const char* >( buffer.data() ), std::streamsize( buffer.size() ) );
+		count += shardEntries.size();
+	}
+	std::cout << "Book entries written: " << count << std::endl;
+	return bool( stream );
+}
+
+int main( int argc, char** argv )
+{
+	if ( argc < 3 )
+	{
+		std::cout << "usage: book_builder <output book> <games.cgr | games.pgn>... [-threads N] [-min N] [-plies N]" << std::endl;
+		return 1;
+	}
+	int threadsCount = int( std::thread::hardware_concurrency() );
+	int maxPlies = 40;
+	uint32_t minGames = 1;
+	std::vector< std::string > inputs;
+	for ( int i = 2; i < argc; i++ )
+	{
+		const std::string arg = argv[i];
+		if ( arg == "-threads" && i + 1 < argc ) threadsCount = std::stoi( argv[++i] );
+		else if ( arg == "-min" && i + 1 < argc ) minGames = uint32_t( std::stoul( argv[++i] ) );
+		else if ( arg == "-plies" && i + 1 < argc ) maxPlies = std::stoi( argv[++i] );
+		else inputs.push_back( arg );
+	}
+
+	BookBuilder builder( threadsCount, maxPlies );
+	for ( const auto& input : inputs )
+	{
+		builder.addInput( input );
+	}
+	builder.build();
+	return builder.write( argv[1], minGames ) ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#include "Allocations.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic< uint64_t > s_allocations( 0 );
+}
+
+const uint64_t allocationsCount()
+{
+	return s_allocations.load( std::memory_order_relaxed );
+}
+
+void* operator new( std::size_t size )
+{
+	s_allocations.fetch_add( 1, std::memory_order_relaxed );
+	void* memory = std::malloc( size == 0 ? 1 : size );
+	if ( memory == nullptr ) throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[]( std::size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete( void* memory ) noexcept
+{
+	std::free( memory );
+}
+
+void operator delete[]( void* memory ) noexcept
+{
+	std::free( memory );
+}
+
+void operator delete( void* memory, std::size_t ) noexcept
+{
+	std::free( memory );
+}
+
+void operator delete[]( void* memory, std::size_t ) noexcept
+{
+	std::free( memory );
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+/**
+ Heap allocations made by the process so far, counted by the replaced operator new. The
+ replacements live alone in Allocations.cpp: inlined into the containers code, their free calls
+ would be seen as mismatched with the operator new the containers allocated with.
+*/
+const uint64_t allocationsCount();
@@ -0,0 +1,523 @@
+#include "../../../game/ChessGame.h"
+#include "../../../game/ChessPlayer.h"
+#include "../../../game/ChessProfiler.h"
+#include "../../../game/ChessTracer.h"
+#include "Allocations.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+/**
+ Decision latency of every AI level over a fixed corpus of positions (opening, middlegame and
+ endgame). Each ChessPlayer::generateDecision call is timed alone; the report has the p50, p90,
+ p99 and max latency, the heap allocations per decision and, when built with CHESS_PROFILING (as
+ the project does), the isSafeToMoveTo calls per decision. A perft count on ChessGame gives the
+ move generation speed in nodes per second.
+
+ The JSON output (-json) is the baseline of the regression check (-baseline): the workloads run
+ several times (-runs, 5 by default when checking), the medians are compared with the tolerance
+ and the exit code is 2 if any p99 latency, allocations per decision or perft speed regressed.
+
+ -trace writes a ChessTracer timeline of the runs (decisions, player states, search iterations) to
+ the file; the latencies then include the cost of tracing.
+
+ usage: decision_bench [-levels FIRST-LAST] [-repeat N] [-runs N] [-json file] [-baseline file [-tolerance PERCENT]] [-trace file]
+ e.g.   decision_bench -levels 0-6 -runs 5 -json baseline.json
+		decision_bench -levels 0-6 -baseline baseline.json -tolerance 15
+*/
+
+namespace
+{
+	// Positions reached in games between the random levels, black to move.
+	struct Phase
+	{
+		const char* name;
+		std::vector< std::string > positions;
+	};
+
+	const Phase PHASES[] =
+	{
+		{ "opening", {
+			"rn1kq3/1bpp1p1p/p3p2b/8/8/3P1P1P/PPP1P3/RN2K1NR b - - 0 9",
+			"1nbkq1nr/2pp1p1p/1p4p1/4p3/8/P5PP/2PPPPB1/2BQK1NR b - - 0 9",
+			"r1bkq1n1/pp1p4/n1p1pppb/8/6P1/P2P4/1PP1PPBP/RN2K1NR b - - 0 9",
+			"rnbkqbr1/p5pp/1pppp2n/5p2/8/1P1PPNP1/P1P1QP1P/RNB1KB1R b - - 0 9",
+			"rnbk2nr/Rp1p3p/2p2pp1/4p3/8/1P1P1PP1/2P1P2P/2BQKBNR b - - 0 9",
+			"r1bk1bn1/p1p1qp1r/1pnpp1pp/8/7P/4PPP1/PPPP1R2/RNBQKBN1 b - - 0 9",
+			"rn1kqb1r/p1p2pp1/1p1ppn2/8/7p/1P1PPP1P/P1P3BP/RNBQK1R1 b - - 0 9",
+			"rnbk2nr/p1p1b1pp/1p1ppp2/1N2q3/8/1P3P1N/P1PPP1PP/1RBQKB1R b - - 0 9" } },
+		{ "middlegame", {
+			"2rk1r2/N6q/3n1bp1/ppnPN1Pp/PP1P3P/2pQ1p2/2P2P2/R1B1KR1B b - - 0 41",
+			"1n1k2Pr/1bp5/1pPN3n/r2B4/pP2Pp1p/P4N1P/1qQp4/B2RK2R b - - 0 41",
+			"3k2r1/6b1/np1Pp1p1/PRpn1pP1/2P1bp1p/5Q1P/2NB4/4KBR1 b - - 0 41",
+			"1r1k4/3bP1br/p2n4/1B1pQ3/3P2P1/2p2p1p/PR3P1p/4K2R b - - 0 41",
+			"2Pk1bn1/4r2r/q4P2/2P1p2P/8/PB1p1b2/1B4QP/2R1K1N1 b - - 0 41",
+			"2bk2q1/r1P3r1/1P6/p3P1pp/P2p1pBb/B2PQ1nN/1Rn5/1N2K1R1 b - - 0 41",
+			"P2k2n1/Pr1b2r1/1QP1qp2/1B4pp/1n1p1pP1/N2P1P2/1B5P/3RK1R1 b - - 0 41",
+			"2rk1qn1/N3bp1r/npR3Pp/p2p4/PP1Pp3/B7/3QPR2/1N2K3 b - - 0 41" } },
+		{ "endgame", {
+			"2P5/8/1k6/4B2p/7P/2N3R1/8/3QK3 b - - 0 131",
+			"3k4/8/8/1P4R1/4r3/Q1P5/8/4K1N1 b - - 0 30",
+			"3k4/p7/7n/7p/1r5P/2R5/5K2/8 b - - 0 34",
+			"8/8/6k1/4B1P1/3PPP2/N7/2P5/4K3 b - - 0 30",
+			"3k1b2/5p2/6p1/8/6P1/4P3/7r/4K1N1 b - - 0 24",
+			"3k4/2p5/2P1p3/6P1/5N2/8/6B1/1N2K3 b - - 0 29",
+			"1n1k4/5p2/3p4/1P6/5pP1/8/5P2/4K3 b - - 0 23",
+			"1B1k4/4q3/8/3p1p2/8/3P4/8/3Q1K2 b - - 0 25" } }
+	};
+
+
+	// Move generation workload: start position and one middlegame, counted with ChessGame.
+	struct PerftWorkload
+	{
+		const char* name;
+		const char* fen; // Empty for the default position.
+		int depth;
+	};
+
+	const PerftWorkload PERFTS[] =
+	{
+		{ "start", "", 4 },
+		{ "middlegame", "2rk1r2/N6q/3n1bp1/ppnPN1Pp/PP1P3P/2pQ1p2/2P2P2/R1B1KR1B b - - 0 41", 3 }
+	};
+
+	// Below this the latency differences are timer and scheduling noise.
+	const double MIN_LATENCY_DELTA_US = 5.0;
+
+	struct Sample
+	{
+		double microseconds;
+		uint64_t allocations;
+		uint64_t safeChecks;
+	};
+
+	struct Result
+	{
+		int level;
+		std::string phase;
+		size_t decisions;
+		double p50;
+		double p90;
+		double p99;
+		double max;
+		double allocations; // Per decision.
+		double safeChecks; // Per decision.
+	};
+
+	struct PerftResult
+	{
+		std::string name;
+		int depth;
+		uint64_t nodes;
+		double nodesPerSecond;
+	};
+
+	// Nearest rank on sorted latencies.
+	double percentile( const std::vector< double >& sorted, const double fraction )
+	{
+		const size_t rank = size_t( fraction * double( sorted.size() ) + 0.999999 );
+		return sorted[std::min( sorted.size(), std::max< size_t >( rank, 1 ) ) - 1];
+	}
+
+	double median( std::vector< double > values )
+	{
+		std::sort( values.begin(), values.end() );
+		const size_t middle = values.size() / 2;
+		return values.size() % 2 == 1 ? values[middle] : ( values[middle - 1] + values[middle] ) / 2.0;
+	}
+
+	Result summarize( const int level, const std::string& phase, const std::vector< Sample >& samples )
+	{
+		std::vector< double > latencies;
+		uint64_t allocations = 0;
+		uint64_t safeChecks = 0;
+		for ( const Sample& sample : samples )
+		{
+			latencies.push_back( sample.microseconds );
+			allocations += sample.allocations;
+			safeChecks += sample.safeChecks;
+		}
+		std::sort( latencies.begin(), latencies.end() );
+		const double count = double( samples.size() );
+		return Result{ level, phase, samples.size(),
+					   percentile( latencies, 0.50 ), percentile( latencies, 0.90 ), percentile( latencies, 0.99 ), latencies.back(),
+					   double( allocations ) / count, double( safeChecks ) / count };
+	}
+
+	// One decision of the side to move; false if the level found no move.
+	const bool measure( ChessGame& game, const std::string& fen, Sample& sample )
+	{
+		if ( !game.loadFEN( fen ) )
+		{
+			std::cerr << "Invalid position " << fen << std::endl;
+			return false;
+		}
+		ChessPlayer* const player = game.activePlayer();
+		ChessProfiler::Stats before;
+		game.getStats( before );
+		const uint64_t allocations = allocationsCount();
+		const auto start = std::chrono::steady_clock::now();
+		player->generateDecision();
+		const auto end = std::chrono::steady_clock::now();
+		sample.allocations = allocationsCount() - allocations;
+		ChessProfiler::Stats after;
+		game.getStats( after );
+		sample.safeChecks = after.calls[ChessProfiler::IS_SAFE_TO_MOVE_TO] - before.calls[ChessProfiler::IS_SAFE_TO_MOVE_TO];
+		sample.microseconds = std::chrono::duration< double, std::micro >( end - start ).count();
+		return player->hasDecision();
+	}
+
+	// Per level: one result per phase and one for all the positions.
+	const bool runDecisions( const int firstLevel, const int lastLevel, const int repeat, std::vector< Result >& results )
+	{
+		for ( int level = firstLevel; level <= lastLevel; level++ )
+		{
+			ChessGame game( ChessGameSettings( false, 0, 0, level ) );
+			std::vector< Sample > all;
+			std::vector< std::vector< Sample > > phases;
+			bool failed = false;
+			for ( const Phase& phase : PHASES )
+			{
+				std::vector< Sample > samples;
+				// The first pass only warms up the caches. The search table of level 5 is not one of them:
+				// loadFEN reseeds the game, which clears it, so every decision searches from an empty table.
+				for ( int pass = 0; pass <= repeat; pass++ )
+				{
+					game.seedRandom( uint64_t( pass ) + 1 );
+					for ( const std::string& fen : phase.positions )
+					{
+						Sample sample;
+						failed |= !measure( game, fen, sample );
+						if ( pass > 0 ) samples.push_back( sample );
+					}
+				}
+				all.insert( all.end(), samples.begin(), samples.end() );
+				phases.push_back( samples );
+			}
+			if ( failed )
+			{
+				std::cerr << "Level " << level << " did not decide in every position" << std::endl;
+				return false;
+			}
+			for ( size_t i = 0; i < phases.size(); i++ )
+			{
+				results.push_back( summarize( level, PHASES[i].name, phases[i] ) );
+			}
+			results.push_back( summarize( level, "all", all ) );
+		}
+		return true;
+	}
+
+	// Leaf count; the side to move is passed along since makeMove does not change turns.
+	uint64_t perft( ChessGame& game, const bool isBlack, const int depth )
+	{
+		std::map< int, std::vector< CellNode > > moves;
+		game.getPossiblePositions( moves, isBlack, false, false );
+		uint64_t nodes = 0;
+		for ( const auto& [indexPiece, positions] : moves )
+		{
+			for ( const CellNode& node : positions )
+			{
+				if ( depth == 1 )
+				{
+					nodes++;
+					continue;
+				}
+				ChessMoveUndo undo;
+				const ChessPiece::TYPE captured = game.makeMove( indexPiece, node, &undo );
+				nodes += captured == ChessPiece::KING ? 1 : perft( game, !isBlack, depth - 1 );
+				game.unmakeMove( undo );
+			}
+		}
+		return nodes;
+	}
+
+	void runPerfts( std::vector< PerftResult >& results )
+	{
+		ChessGame game( ChessGameSettings( false, 0, 0, 0 ) );
+		const std::string start = game.getFEN();
+		for ( const PerftWorkload& workload : PERFTS )
+		{
+			game.loadFEN( workload.fen[0] == '\0' ? start : std::string( workload.fen ) );
+			const auto begin = std::chrono::steady_clock::now();
+			const uint64_t nodes = perft( game, game.isBlackTurn(), workload.depth );
+			const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count();
+			results.push_back( PerftResult{ workload.name, workload.depth, nodes, double( nodes ) / std::max( seconds, 1e-9 ) } );
+		}
+	}
+
+	// Field by field median of several runs of the same workloads.
+	void medianOfRuns( const std::vector< std::vector< Result > >& runs, std::vector< Result >& results )
+	{
+		results = runs[0];
+		for ( size_t i = 0; i < results.size(); i++ )
+		{
+			std::vector< double > p50, p90, p99, max, allocations, safeChecks;
+			for ( const auto& run : runs )
+			{
+				p50.push_back( run[i].p50 );
+				p90.push_back( run[i].p90 );
+				p99.push_back( run[i].p99 );
+				max.push_back( run[i].max );
+				allocations.push_back( run[i].allocations );
+				safeChecks.push_back( run[i].safeChecks );
+			}
+			results[i].p50 = median( p50 );
+			results[i].p90 = median( p90 );
+			results[i].p99 = median( p99 );
+			results[i].max = median( max );
+			results[i].allocations = median( allocations );
+			results[i].safeChecks = median( safeChecks );
+		}
+	}
+
+	void medianOfRuns( const std::vector< std::vector< PerftResult > >& runs, std::vector< PerftResult >& results )
+	{
+		results = runs[0];
+		for ( size_t i = 0; i < results.size(); i++ )
+		{
+			std::vector< double > nodesPerSecond;
+			for ( const auto& run : runs )
+			{
+				nodesPerSecond.push_back( run[i].nodesPerSecond );
+			}
+			results[i].nodesPerSecond = median( nodesPerSecond );
+		}
+	}
+
+	void writeJSON( std::ostream& stream, const std::vector< Result >& results, const std::vector< PerftResult >& perfts, const int repeat, const int runs )
+	{
+#ifdef CHESS_PROFILING
+		const bool profiling = true;
+#else
+		const bool profiling = false;
+#endif
+		stream << "{\n\t\"repeat\": " << repeat << ",\n\t\"runs\": " << runs << ",\n\t\"profiling\": " << ( profiling ? "true" : "false" ) << ",\n\t\"results\": [";
+		for ( size_t i = 0; i < results.size(); i++ )
+		{
+			const Result& result = results[i];
+			stream << ( i == 0 ? "\n" : ",\n" ) << std::fixed << std::setprecision( 3 )
+				   << "\t\t{ \"level\": " << result.level << ", \"phase\": \"" << result.phase << "\""
+				   << ", \"decisions\": " << result.decisions
+				   << ", \"p50_us\": " << result.p50 << ", \"p90_us\": " << result.p90
+				   << ", \"p99_us\": " << result.p99 << ", \"max_us\": " << result.max
+				   << ", \"allocations\": " << result.allocations << ", \"safe_checks\": " << result.safeChecks << " }";
+		}
+		stream << "\n\t],\n\t\"perft\": [";
+		for ( size_t i = 0; i < perfts.size(); i++ )
+		{
+			const PerftResult& perft = perfts[i];
+			stream << ( i == 0 ? "\n" : ",\n" ) << std::fixed << std::setprecision( 0 )
+				   << "\t\t{ \"name\": \"" << perft.name << "\", \"depth\": " << perft.depth
+				   << ", \"nodes\": " << perft.nodes << ", \"nodes_per_second\": " << perft.nodesPerSecond << " }";
+		}
+		stream << "\n\t]\n}" << std::endl;
+	}
+
+	/**
+	 Reads back the flat objects of an array written by writeJSON ("key": number or "key": "text"),
+	 one map per object. Enough for the files of this tool, not a general JSON reader.
+	*/
+	const bool readJSONArray( const std::string& text, const std::string& array, std::vector< std::map< std::string, std::string > >& objects )
+	{
+		size_t position = text.find( "\"" + array + "\"" );
+		if ( position == std::string::npos ) return false;
+		position = text.find( '[', position );
+		const size_t last = text.find( ']', position );
+		if ( position == std::string::npos || last == std::string::npos ) return false;
+		while ( true )
+		{
+			const size_t open = text.find( '{', position );
+			if ( open == std::string::npos || open > last ) break;
+			const size_t close = text.find( '}', open );
+			if ( close == std::string::npos ) return false;
+			std::map< std::string, std::string > object;
+			size_t cursor = open + 1;
+			while ( true )
+			{
+				const size_t keyStart = text.find( '"', cursor );
+				if ( keyStart == std::string::npos || keyStart > close ) break;
+				const size_t keyEnd = text.find( '"', keyStart + 1 );
+				const size_t colon = text.find( ':', keyEnd );
+				size_t valueEnd = text.find_first_of( ",}", colon );
+				std::string value = text.substr( colon + 1, valueEnd - colon - 1 );
+				value.erase( 0, value.find_first_not_of( " \t\n\"" ) );
+				value.erase( value.find_last_not_of( " \t\n\"" ) + 1 );
+				object[text.substr( keyStart + 1, keyEnd - keyStart - 1 )] = value;
+				cursor = valueEnd + 1;
+			}
+			objects.push_back( object );
+			position = close + 1;
+		}
+		return true;
+	}
+
+	/**
+	 Compares the medians with a baseline written by -json. Latency and allocations regress when
+	 above the baseline by more than the tolerance, perft when below it. Returns the regressions.
+	*/
+	int compare( const std::string& baselinePath, const std::vector< Result >& results, const std::vector< PerftResult >& perfts, const double tolerance )
+	{
+		std::ifstream file( baselinePath );
+		if ( !file.is_open() )
+		{
+			std::cerr << "Could not read " << baselinePath << std::endl;
+			return -1;
+		}
+		const std::string text( ( std::istreambuf_iterator< char >( file ) ), std::istreambuf_iterator< char >() );
+		std::vector< std::map< std::string, std::string > > baseResults, basePerfts;
+		if ( !readJSONArray( text, "results", baseResults ) || !readJSONArray( text, "perft", basePerfts ) )
+		{
+			std::cerr << "Invalid baseline " << baselinePath << std::endl;
+			return -1;
+		}
+
+		int regressions = 0;
+		auto check = [&]( const std::string& what, const double baseline, const double current, const bool higherIsWorse, const double minimumDelta )
+		{
+			const double delta = higherIsWorse ? current - baseline : baseline - current;
+			const bool regressed = delta > baseline * tolerance && delta > minimumDelta;
+			std::cout << ( regressed ? "REGRESSION " : "ok         " ) << std::left << std::setw( 36 ) << what << std::right
+					  << std::fixed << std::setprecision( 1 ) << std::setw( 14 ) << baseline << " -> " << std::setw( 14 ) << current << std::endl;
+			regressions += regressed ? 1 : 0;
+		};
+		for ( const auto& base : baseResults )
+		{
+			if ( base.count( "phase" ) == 0 || base.at( "phase" ) != "all" ) continue;
+			const int level = std::stoi( base.at( "level" ) );
+			const auto found = std::find_if( results.begin(), results.end(), [&]( const Result& result ) { return result.level == level && result.phase == "all"; } );
+			if ( found == results.end() ) continue;
+			const std::string name = "level " + std::to_string( level );
+			check( name + " p99 us", std::stod( base.at( "p99_us" ) ), found->p99, true, MIN_LATENCY_DELTA_US );
+			check( name + " allocations/decision", std::stod( base.at( "allocations" ) ), found->allocations, true, 0.5 );
+		}
+		for ( const auto& base : basePerfts )
+		{
+			const auto found = std::find_if( perfts.begin(), perfts.end(), [&]( const PerftResult& perft ) { return perft.name == base.at( "name" ); } );
+			if ( found == perfts.end() ) continue;
+			if ( std::to_string( found->nodes ) != base.at( "nodes" ) )
+			{
+				std::cout << "perft " << found->name << " counts " << found->nodes << " nodes, the baseline " << base.at( "nodes" ) << std::endl;
+			}
+			check( "perft " + found->name + " nodes/s", std::stod( base.at( "nodes_per_second" ) ), found->nodesPerSecond, false, 0.0 );
+		}
+		return regressions;
+	}
+}
+
+int main( int argc, char** argv )
+{
+	int firstLevel = 0;
+	int lastLevel = 6;
+	int repeat = 10;
+	int runs = 1;
+	double tolerance = 0.10;
+	std::string jsonPath;
+	std::string baselinePath;
+	std::string tracePath;
+	for ( int i = 1; i < argc; i++ )
+	{
+		const std::string arg = argv[i];
+		if ( arg == "-levels" && i + 1 < argc )
+		{
+			const std::string levels = argv[++i];
+			const size_t dash = levels.find( '-' );
+			firstLevel = std::stoi( levels.substr( 0, dash ) );
+			lastLevel = dash == std::string::npos ? firstLevel : std::stoi( levels.substr( dash + 1 ) );
+		}
+		else if ( arg == "-repeat" && i + 1 < argc ) repeat = std::max( 1, std::stoi( argv[++i] ) );
+		else if ( arg == "-runs" && i + 1 < argc ) runs = std::max( 1, std::stoi( argv[++i] ) );
+		else if ( arg == "-tolerance" && i + 1 < argc ) tolerance = std::stod( argv[++i] ) / 100.0;
+		else if ( arg == "-json" && i + 1 < argc ) jsonPath = argv[++i];
+		else if ( arg == "-baseline" && i + 1 < argc ) baselinePath = argv[++i];
+		else if ( arg == "-trace" && i + 1 < argc ) tracePath = argv[++i];
+		else
+		{
+			std::cout << "usage: decision_bench [-levels FIRST-LAST] [-repeat N] [-runs N] [-json file] [-baseline file [-tolerance PERCENT]] [-trace file]" << std::endl;
+			return 1;
+		}
+	}
+	if ( !baselinePath.empty() && runs == 1 )
+	{
+		runs = 5; // A single run is too noisy to gate on.
+	}
+
+	std::vector< std::vector< Result > > resultRuns( runs );
+	std::vector< std::vector< PerftResult > > perftRuns( runs );
+	if ( !tracePath.empty() )
+	{
+		ChessTracer::start();
+		ChessTracer::setThreadName( "decision_bench" );
+	}
+	for ( int run = 0; run < runs; run++ )
+	{
+		std::cout.setstate( std::ios::badbit ); // The games print their moves, not wanted in the report.
+		const bool decided = runDecisions( firstLevel, lastLevel, repeat, resultRuns[run] );
+		runPerfts( perftRuns[run] );
+		std::cout.clear();
+		if ( !decided )
+		{
+			return 1;
+		}
+	}
+	if ( !tracePath.empty() )
+	{
+		ChessTracer::stop();
+		if ( !ChessTracer::write( tracePath ) )
+		{
+			std::cout << "Could not write " << tracePath << std::endl;
+			return 1;
+		}
+	}
+	std::vector< Result > results;
+	std::vector< PerftResult > perfts;
+	medianOfRuns( resultRuns, results );
+	medianOfRuns( perftRuns, perfts );
+
+	std::cout << std::left << std::setw( 6 ) << "level" << std::setw( 12 ) << "phase" << std::right
+			  << std::setw( 10 ) << "p50 us" << std::setw( 10 ) << "p90 us" << std::setw( 10 ) << "p99 us" << std::setw( 10 ) << "max us"
+			  << std::setw( 10 ) << "allocs" << std::setw( 10 ) << "safe" << std::endl;
+	for ( const Result& result : results )
+	{
+		std::cout << std::left << std::setw( 6 ) << result.level << std::setw( 12 ) << result.phase << std::right
+				  << std::fixed << std::setprecision( 1 )
+				  << std::setw( 10 ) << result.p50 << std::setw( 10 ) << result.p90 << std::setw( 10 ) << result.p99 << std::setw( 10 ) << result.max
+				  << std::setw( 10 ) << result.allocations << std::setw( 10 ) << result.safeChecks << std::endl;
+	}
+	for ( const PerftResult& perft : perfts )
+	{
+		std::cout << "perft " << perft.name << " depth " << perft.depth << ": " << perft.nodes << " nodes, "
+				  << std::fixed << std::setprecision( 0 ) << perft.nodesPerSecond << " nodes/s" << std::endl;
+	}
+
+	if ( !jsonPath.empty() )
+	{
+		std::ofstream file( jsonPath );
+		if ( !file.is_open() )
+		{
+			std::cout << "Could not write " << jsonPath << std::endl;
+			return 1;
+		}
+		writeJSON( file, results, perfts, repeat, runs );
+	}
+
+	if ( !baselinePath.empty() )
+	{
+		const int regressions = compare( baselinePath, results, perfts, tolerance );
+		if ( regressions < 0 )
+		{
+			return 1;
+		}
+		if ( regressions > 0 )
+		{
+			std::cout << regressions << " regression(s) against " << baselinePath << std::endl;
+			return 2;
+		}
+	}
+	return 0;
+}
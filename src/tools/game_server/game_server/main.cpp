@@ -0,0 +1,983 @@
+#include "../../../game/ChessGame.h"
+#include "../../../game/ChessGamePool.h"
+#include "../../../game/ChessGameRecord.h"
+#include "../../../game/ChessOpeningBook.h"
+#include "../../../game/ChessTablebase.h"
+#include "../../../game/ChessRandom.h"
+#include "../../../game/ChessSearch.h"
+#include "../../../game/ChessMCTS.h"
+#include "../../../game/ChessTracer.h"
+#include <iostream>
+
+/**
+ Hosts many games in one process for clients connected to a Unix domain socket. One thread runs
+ an epoll loop (clients, timers, worker completions); AI moves are played by a pool of worker
+ threads; the next AI move of a game (pace) and the deadline of a human move are kept in a timer
+ wheel, so a game waiting for either costs no CPU. Games come from a ChessGamePool per AI level
+ and go back to it when they end; the searches of levels 5 and 6 belong to the workers, which lend
+ them to the game they advance, so an idle game does not hold a search table or a tree.
+
+ Protocol, one command or event per line:
+	new <level> [none|white|black] [pace ms] [seed]	->	created <id>	(the client plays the given color)
+	move <id> <move>	(e2e4 or SAN, by the creator)		->	ok
+	watch <id> / unwatch <id> / close <id>				->	ok
+	fen <id>											->	fen <id> <FEN>
+	stats												->	stats sessions N running N waiting N scheduled N clients N
+	events to the creator and the watchers: move <id> <ply> <move>, timeout <id>, end <id> <result>
+ A human that lets the deadline pass has the AI move for it. Errors are answered with error <text>.
+
+ With -trace, the moves played by the workers (and the decisions inside them) are recorded with
+ ChessTracer and written to the file when the server stops.
+
+ usage: game_server <socket path> [-threads N] [-deadline ms] [-max-sessions N] [-book file] [-tablebases dir] [-trace file]
+ e.g.   game_server /tmp/chess.sock -threads 4 -deadline 30000
+*/
+
+#if defined( __linux__ )
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace
+{
+	const int LEVELS_COUNT = 7;
+	const int SEARCH_LEVEL = 5; // Alpha-beta search (ChessSearch).
+	const int MCTS_LEVEL = 6; // Monte Carlo tree search (ChessMCTS).
+	const int MAX_UPDATES_PER_MOVE = 64; // A move takes a few updates, more means the side to move has none.
+	const size_t MAX_OUTPUT = 1 << 20; // Pending bytes of a client that does not read, then it is dropped.
+	const int TIMER_SLOTS = 1024;
+	const int64_t TIMER_TICK = 10; // Milliseconds.
+
+	inline const int64_t now()
+	{
+		return std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	// SIGINT and SIGTERM, read from a signalfd: they must be blocked before any thread starts.
+	const sigset_t stopSignals()
+	{
+		sigset_t signals;
+		sigemptyset( &signals );
+		sigaddset( &signals, SIGINT );
+		sigaddset( &signals, SIGTERM );
+		return signals;
+	}
+
+	std::string moveText( const uint16_t move )
+	{
+		CellNode from, to;
+		ChessOpeningBook::decodeMove( move, from, to );
+		return ChessGame::moveToString( from, to );
+	}
+}
+
+/**
+ Hashed timer wheel of intrusive lists, one node per session slot. A timer is linked in the slot
+ of the tick that covers its deadline and fires when that tick is processed; timers further than
+ one turn of the wheel stay linked until the turn that reaches them.
+*/
+class TimerWheel
+{
+public:
+	TimerWheel( const int64_t start );
+	void resize( const size_t count );
+	void schedule( const uint32_t index, const int64_t deadline );
+	void cancel( const uint32_t index );
+	void advance( const int64_t time, std::vector< uint32_t >& expired );
+	const size_t size() const;
+private:
+	struct Node
+	{
+		int64_t deadline;
+		int32_t prev;
+		int32_t next;
+		int32_t slot; // -1 if not scheduled.
+	};
+private:
+	std::vector< int32_t > m_slots; // First node of each slot, -1 if empty.
+	std::vector< Node > m_nodes; // By session slot.
+	int64_t m_current; // Next tick to process.
+	size_t m_size;
+};
+
+TimerWheel::TimerWheel( const int64_t start ) :
+	m_slots( TIMER_SLOTS, -1 ),
+	m_current( start / TIMER_TICK ),
+	m_size( 0 )
+{}
+
+void TimerWheel::resize( const size_t count )
+{
+	m_nodes.resize( count, Node{ 0, -1, -1, -1 } );
+}
+
+void TimerWheel::schedule( const uint32_t index, const int64_t deadline )
+{
+	cancel( index );
+	const int64_t tick = std::max( ( deadline + TIMER_TICK - 1 ) / TIMER_TICK, m_current );
+	const int32_t slot = int32_t( tick % TIMER_SLOTS );
+	Node& node = m_nodes[index];
+	node.deadline = deadline;
+	node.slot = slot;
+	node.prev = -1;
+	node.next = m_slots[slot];
+	if ( node.next != -1 ) m_nodes[node.next].prev = int32_t( index );
+	m_slots[slot] = int32_t( index );
+	m_size++;
+}
+
+void TimerWheel::cancel( const uint32_t index )
+{
+	Node& node = m_nodes[index];
+	if ( node.slot == -1 ) return;
+	if ( node.prev != -1 ) m_nodes[node.prev].next = node.next;
+	else m_slots[node.slot] = node.next;
+	if ( node.next != -1 ) m_nodes[node.next].prev = node.prev;
+	node.slot = -1;
+	m_size--;
+}
+
+// Processes the ticks up to the time, the expired timers are unlinked and appended.
+void TimerWheel::advance( const int64_t time, std::vector< uint32_t >& expired )
+{
+	for ( ; m_current <= time / TIMER_TICK; m_current++ )
+	{
+		for ( int32_t index = m_slots[m_current % TIMER_SLOTS]; index != -1; )
+		{
+			const int32_t next = m_nodes[index].next;
+			if ( m_nodes[index].deadline <= time )
+			{
+				cancel( uint32_t( index ) );
+				expired.push_back( uint32_t( index ) );
+			}
+			index = next;
+		}
+	}
+}
+
+inline const size_t TimerWheel::size() const
+{
+	return m_size;
+}
+
+struct Session
+{
+	enum STATE
+	{
+		FREE = 0,
+		SCHEDULED, // Next AI move in the timer wheel.
+		RUNNING, // Queued or played by a worker.
+		WAITING // For the move of the client, deadline in the timer wheel.
+	};
+	uint32_t id;
+	uint32_t slot;
+	ChessGame* game;
+	int level;
+	int human; // Color played by the owner: -1 none, 0 white, 1 black.
+	int pace; // Milliseconds between two AI moves.
+	int owner; // Socket of the creator, -1 once disconnected.
+	STATE state;
+	bool closing; // Closed while RUNNING, released when the worker is done.
+	bool stalled; // The side to move had no moves.
+	size_t published; // Moves already sent.
+	std::string fen;
+	std::vector< int > watchers; // Sockets.
+};
+
+/**
+ Threads playing AI moves. Finished sessions are collected by the event loop, which is woken up
+ through an eventfd.
+*/
+class WorkerPool
+{
+public:
+	typedef std::function< void( const int indexWorker, Session* session ) > Job;
+public:
+	WorkerPool( const int threadsCount, const Job& job );
+	~WorkerPool();
+	void push( Session* session );
+	void completed( std::vector< Session* >& sessions );
+	const int eventDescriptor() const;
+private:
+	void work( const int indexWorker );
+private:
+	Job m_job;
+	std::vector< std::thread > m_threads;
+	std::deque< Session* > m_queue;
+	std::vector< Session* > m_completed;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopping;
+	int m_event;
+};
+
+WorkerPool::WorkerPool( const int threadsCount, const Job& job ) :
+	m_job( job ),
+	m_stopping( false ),
+	m_event( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) )
+{
+	for ( int i = 0; i < std::max( threadsCount, 1 ); i++ )
+	{
+		m_threads.emplace_back( &WorkerPool::work, this, i );
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_stopping = true;
+	}
+	m_condition.notify_all();
+	for ( auto& thread : m_threads )
+	{
+		thread.join();
+	}
+	close( m_event );
+}
+
+void WorkerPool::push( Session* session )
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_queue.push_back( session );
+	}
+	m_condition.notify_one();
+}
+
+void WorkerPool::completed( std::vector< Session* >& sessions )
+{
+	uint64_t count = 0;
+	while ( read( m_event, &count, sizeof( count ) ) > 0 ) {}
+	std::lock_guard< std::mutex > lock( m_mutex );
+	sessions.swap( m_completed );
+	m_completed.clear();
+}
+
+inline const int WorkerPool::eventDescriptor() const
+{
+	return m_event;
+}
+
+void WorkerPool::work( const int indexWorker )
+{
+	if ( ChessTracer::enabled() )
+	{
+		ChessTracer::setThreadName( "worker " + std::to_string( indexWorker ) );
+	}
+	for ( ;; )
+	{
+		Session* session = nullptr;
+		{
+			std::unique_lock< std::mutex > lock( m_mutex );
+			m_condition.wait( lock, [this]() { return m_stopping || !m_queue.empty(); } );
+			if ( m_stopping ) return;
+			session = m_queue.front();
+			m_queue.pop_front();
+		}
+		m_job( indexWorker, session );
+		{
+			std::lock_guard< std::mutex > lock( m_mutex );
+			m_completed.push_back( session );
+		}
+		const uint64_t one = 1;
+		if ( write( m_event, &one, sizeof( one ) ) < 0 ) {}
+	}
+}
+
+// Searches of a worker, lent to the game it advances.
+struct WorkerSearches
+{
+	std::unique_ptr< ChessSearch > search; // Created on the first game of SEARCH_LEVEL.
+	std::unique_ptr< ChessMCTS > mcts; // Created on the first game of MCTS_LEVEL.
+};
+
+struct Client
+{
+	std::string input;
+	std::string output; // Not sent yet, the socket is then polled for writing.
+	std::vector< uint32_t > watching; // Session ids, stale ones are ignored.
+};
+
+class GameServer
+{
+public:
+	GameServer( const int threadsCount, const int deadline, const size_t maxSessions, const ChessOpeningBook* book, const ChessTablebase* tablebase );
+	~GameServer();
+	const bool listen( const std::string& path );
+	void run();
+private:
+	void accept();
+	void receive( const int fd );
+	void flush( const int fd );
+	void disconnect( const int fd );
+	void send( const int fd, const std::string& line );
+	void broadcast( Session& session, const std::string& line );
+	void execute( const int fd, const std::string& line );
+	void create( const int fd, std::istringstream& arguments );
+	void play( const int fd, Session& session, const std::string& text );
+	void closeSession( Session& session );
+	Session* find( const uint32_t id );
+	void advance( const int indexWorker, Session* session );
+	void onCompleted( Session& session );
+	void onExpired( Session& session );
+	void publish( Session& session );
+	void next( Session& session );
+	void release( Session& session );
+	void armTimer();
+	const std::string stats() const;
+private:
+	int m_deadline;
+	size_t m_maxSessions;
+	const ChessOpeningBook* m_book;
+	const ChessTablebase* m_tablebase;
+	std::unique_ptr< ChessGamePool > m_pools[LEVELS_COUNT]; // Created on first use.
+	std::vector< WorkerSearches > m_searches; // [worker], only used by its worker.
+	std::vector< std::unique_ptr< Session > > m_sessions; // By slot.
+	std::vector< uint32_t > m_freeSlots;
+	std::unordered_map< uint32_t, uint32_t > m_slotsById;
+	uint32_t m_nextId;
+	std::unordered_map< int, Client > m_clients; // By socket.
+	TimerWheel m_timers;
+	bool m_timerArmed;
+	WorkerPool m_workers;
+	std::string m_path;
+	int m_listen;
+	int m_epoll;
+	int m_timer;
+	int m_signal;
+};
+
+GameServer::GameServer( const int threadsCount, const int deadline, const size_t maxSessions, const ChessOpeningBook* book, const ChessTablebase* tablebase ) :
+	m_deadline( deadline ),
+	m_maxSessions( maxSessions ),
+	m_book( book ),
+	m_tablebase( tablebase ),
+	m_searches( size_t( std::max( threadsCount, 1 ) ) ),
+	m_nextId( 1 ),
+	m_timers( now() ),
+	m_timerArmed( false ),
+	m_workers( threadsCount, [this]( const int indexWorker, Session* session ) { advance( indexWorker, session ); } ),
+	m_listen( -1 ),
+	m_epoll( epoll_create1( EPOLL_CLOEXEC ) ),
+	m_timer( timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ),
+	m_signal( -1 )
+{
+	const sigset_t signals = stopSignals();
+	m_signal = signalfd( -1, &signals, SFD_NONBLOCK | SFD_CLOEXEC );
+
+	for ( const int fd : { m_timer, m_signal, m_workers.eventDescriptor() } )
+	{
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		epoll_ctl( m_epoll, EPOLL_CTL_ADD, fd, &event );
+	}
+}
+
+GameServer::~GameServer()
+{
+	for ( const auto& client : m_clients )
+	{
+		close( client.first );
+	}
+	if ( m_listen != -1 )
+	{
+		close( m_listen );
+		unlink( m_path.c_str() );
+	}
+	close( m_timer );
+	close( m_signal );
+	close( m_epoll );
+}
+
+const bool GameServer::listen( const std::string& path )
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if ( path.size() >= sizeof( address.sun_path ) )
+	{
+		return false;
+	}
+	std::strcpy( address.sun_path, path.c_str() );
+	unlink( path.c_str() );
+	m_listen = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if ( m_listen == -1 || bind( m_listen, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) != 0 || ::listen( m_listen, SOMAXCONN ) != 0 )
+	{
+		return false;
+	}
+	m_path = path;
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = m_listen;
+	return epoll_ctl( m_epoll, EPOLL_CTL_ADD, m_listen, &event ) == 0;
+}
+
+// Until SIGINT or SIGTERM.
+void GameServer::run()
+{
+	epoll_event events[64];
+	std::vector< Session* > completed;
+	std::vector< uint32_t > expired;
+	for ( ;; )
+	{
+		const int count = epoll_wait( m_epoll, events, 64, -1 );
+		if ( count < 0 && errno != EINTR )
+		{
+			return;
+		}
+		for ( int i = 0; i < count; i++ )
+		{
+			const int fd = events[i].data.fd;
+			if ( fd == m_signal )
+			{
+				return;
+			}
+			else if ( fd == m_listen )
+			{
+				accept();
+			}
+			else if ( fd == m_workers.eventDescriptor() )
+			{
+				m_workers.completed( completed );
+				for ( Session* session : completed )
+				{
+					onCompleted( *session );
+				}
+			}
+			else if ( fd == m_timer )
+			{
+				uint64_t ticks = 0;
+				while ( read( m_timer, &ticks, sizeof( ticks ) ) > 0 ) {}
+				expired.clear();
+				m_timers.advance( now(), expired );
+				for ( const uint32_t slot : expired )
+				{
+					onExpired( *m_sessions[slot] );
+				}
+			}
+			else
+			{
+				if ( events[i].events & ( EPOLLHUP | EPOLLERR ) )
+				{
+					disconnect( fd );
+					continue;
+				}
+				if ( events[i].events & EPOLLOUT ) flush( fd );
+				if ( events[i].events & EPOLLIN ) receive( fd );
+			}
+		}
+		armTimer();
+	}
+}
+
+// The timer only ticks while some session waits in the wheel.
+void GameServer::armTimer()
+{
+	const bool needed = m_timers.size() > 0;
+	if ( needed == m_timerArmed )
+	{
+		return;
+	}
+	itimerspec spec = {};
+	if ( needed )
+	{
+		spec.it_interval.tv_nsec = long( TIMER_TICK * 1000000 );
+		spec.it_value = spec.it_interval;
+	}
+	timerfd_settime( m_timer, 0, &spec, nullptr );
+	m_timerArmed = needed;
+}
+
+void GameServer::accept()
+{
+	for ( ;; )
+	{
+		const int fd = accept4( m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+		if ( fd == -1 )
+		{
+			return;
+		}
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		epoll_ctl( m_epoll, EPOLL_CTL_ADD, fd, &event );
+		m_clients[fd] = Client();
+	}
+}
+
+void GameServer::receive( const int fd )
+{
+	char buffer[4096];
+	for ( ;; )
+	{
+		const ssize_t size = recv( fd, buffer, sizeof( buffer ), 0 );
+		if ( size == 0 || ( size < 0 && errno != EAGAIN && errno != EWOULDBLOCK ) )
+		{
+			disconnect( fd );
+			return;
+		}
+		if ( size < 0 )
+		{
+			break;
+		}
+		m_clients[fd].input.append( buffer, size_t( size ) );
+	}
+	for ( ;; )
+	{
+		auto found = m_clients.find( fd );
+		if ( found == m_clients.end() ) return;
+		std::string& input = found->second.input;
+		const size_t end = input.find( '\n' );
+		if ( end == std::string::npos ) break;
+		std::string line = input.substr( 0, end );
+		input.erase( 0, end + 1 );
+		if ( !line.empty() && line.back() == '\r' ) line.pop_back();
+		execute( fd, line );
+	}
+}
+
+void GameServer::send( const int fd, const std::string& line )
+{
+	auto found = m_clients.find( fd );
+	if ( found == m_clients.end() )
+	{
+		return;
+	}
+	std::string& output = found->second.output;
+	const bool pending = !output.empty();
+	output += line;
+	output += '\n';
+	if ( output.size() > MAX_OUTPUT )
+	{
+		disconnect( fd );
+		return;
+	}
+	if ( !pending )
+	{
+		flush( fd );
+	}
+}
+
+void GameServer::flush( const int fd )
+{
+	auto found = m_clients.find( fd );
+	if ( found == m_clients.end() )
+	{
+		return;
+	}
+	std::string& output = found->second.output;
+	const bool pending = !output.empty();
+	while ( !output.empty() )
+	{
+		const ssize_t size = ::send( fd, output.data(), output.size(), MSG_NOSIGNAL );
+		if ( size <= 0 ) break;
+		output.erase( 0, size_t( size ) );
+	}
+	if ( pending || !output.empty() )
+	{
+		epoll_event event = {};
+		event.events = output.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+		event.data.fd = fd;
+		epoll_ctl( m_epoll, EPOLL_CTL_MOD, fd, &event );
+	}
+}
+
+// Games of the client keep running, they end by themselves.
+void GameServer::disconnect( const int fd )
+{
+	auto found = m_clients.find( fd );
+	if ( found == m_clients.end() )
+	{
+		return;
+	}
+	for ( const uint32_t id : found->second.watching )
+	{
+		if ( Session* session = find( id ) )
+		{
+			session->watchers.erase( std::remove( session->watchers.begin(), session->watchers.end(), fd ), session->watchers.end() );
+			if ( session->owner == fd ) session->owner = -1;
+		}
+	}
+	m_clients.erase( found );
+	epoll_ctl( m_epoll, EPOLL_CTL_DEL, fd, nullptr );
+	close( fd );
+}
+
+void GameServer::broadcast( Session& session, const std::string& line )
+{
+	const std::vector< int > watchers = session.watchers; // A slow watcher is dropped while sending.
+	for ( const int fd : watchers )
+	{
+		send( fd, line );
+	}
+}
+
+Session* GameServer::find( const uint32_t id )
+{
+	const auto found = m_slotsById.find( id );
+	return found != m_slotsById.end() ? m_sessions[found->second].get() : nullptr;
+}
+
+void GameServer::execute( const int fd, const std::string& line )
+{
+	std::istringstream arguments( line );
+	std::string command;
+	arguments >> command;
+	if ( command.empty() )
+	{
+		return;
+	}
+	if ( command == "new" )
+	{
+		create( fd, arguments );
+		return;
+	}
+	if ( command == "stats" )
+	{
+		send( fd, stats() );
+		return;
+	}
+
+	uint32_t id = 0;
+	Session* session = ( arguments >> id ) ? find( id ) : nullptr;
+	if ( session == nullptr )
+	{
+		send( fd, "error unknown game" );
+		return;
+	}
+	if ( command == "fen" )
+	{
+		send( fd, "fen " + std::to_string( id ) + " " + session->fen );
+	}
+	else if ( command == "watch" )
+	{
+		if ( std::find( session->watchers.begin(), session->watchers.end(), fd ) == session->watchers.end() )
+		{
+			session->watchers.push_back( fd );
+			m_clients[fd].watching.push_back( id );
+		}
+		send( fd, "ok" );
+	}
+	else if ( command == "unwatch" )
+	{
+		session->watchers.erase( std::remove( session->watchers.begin(), session->watchers.end(), fd ), session->watchers.end() );
+		send( fd, "ok" );
+	}
+	else if ( command == "move" || command == "close" )
+	{
+		if ( session->owner != fd )
+		{
+			send( fd, "error not the owner" );
+		}
+		else if ( command == "close" )
+		{
+			send( fd, "ok" );
+			closeSession( *session );
+		}
+		else
+		{
+			std::string text;
+			arguments >> text;
+			play( fd, *session, text );
+		}
+	}
+	else
+	{
+		send( fd, "error unknown command" );
+	}
+}
+
+void GameServer::create( const int fd, std::istringstream& arguments )
+{
+	int level = -1;
+	std::string color = "none";
+	int pace = 0;
+	uint64_t seed = 0;
+	arguments >> level;
+	arguments >> color >> pace >> seed;
+	if ( level < 0 || level >= LEVELS_COUNT || ( color != "none" && color != "white" && color != "black" ) || pace < 0 )
+	{
+		send( fd, "error usage: new <level 0-" + std::to_string( LEVELS_COUNT - 1 ) + "> [none|white|black] [pace ms] [seed]" );
+		return;
+	}
+	if ( m_slotsById.size() >= m_maxSessions )
+	{
+		send( fd, "error too many games" );
+		return;
+	}
+
+	if ( m_pools[level] == nullptr )
+	{
+		m_pools[level].reset( new ChessGamePool( ChessGameSettings( false, 0, 0, unsigned( level ) ) ) );
+	}
+	uint32_t slot = 0;
+	if ( !m_freeSlots.empty() )
+	{
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		slot = uint32_t( m_sessions.size() );
+		m_sessions.emplace_back( new Session() );
+		m_timers.resize( m_sessions.size() );
+	}
+	Session& session = *m_sessions[slot];
+	session.id = m_nextId++;
+	session.slot = slot;
+	session.game = m_pools[level]->acquire();
+	session.game->setOpeningBook( m_book );
+	session.game->setTablebase( m_tablebase );
+	session.game->seedRandom( seed != 0 ? seed : ChessRandom::entropySeed() );
+	session.level = level;
+	session.human = color == "white" ? 0 : ( color == "black" ? 1 : -1 );
+	session.pace = pace;
+	session.owner = fd;
+	session.state = Session::FREE;
+	session.closing = false;
+	session.stalled = false;
+	session.published = 0;
+	session.fen = session.game->getFEN();
+	session.watchers.assign( 1, fd );
+	m_slotsById[session.id] = slot;
+	m_clients[fd].watching.push_back( session.id );
+	send( fd, "created " + std::to_string( session.id ) );
+	next( session );
+}
+
+void GameServer::play( const int fd, Session& session, const std::string& text )
+{
+	CellNode from, to;
+	if ( session.state != Session::WAITING )
+	{
+		send( fd, "error not your turn" );
+		return;
+	}
+	if ( !session.game->parseMove( text, from, to ) || !session.game->playMove( from, to ) )
+	{
+		send( fd, "error illegal move" );
+		return;
+	}
+	m_timers.cancel( session.slot );
+	session.fen = session.game->getFEN();
+	send( fd, "ok" );
+	publish( session );
+	next( session );
+}
+
+void GameServer::closeSession( Session& session )
+{
+	broadcast( session, "end " + std::to_string( session.id ) + " *" );
+	m_slotsById.erase( session.id );
+	if ( session.state == Session::RUNNING )
+	{
+		session.closing = true; // Released when the worker is done.
+		return;
+	}
+	release( session );
+}
+
+/**
+ Worker side: the AI of the side to move plays one move (the game settings have no movement
+ time, so the player states go by on successive updates).
+*/
+void GameServer::advance( const int indexWorker, Session* session )
+{
+	CHESS_TRACE_SCOPE( "advance", "server" );
+	ChessGame* game = session->game;
+	WorkerSearches& searches = m_searches[indexWorker];
+	if ( session->level == SEARCH_LEVEL && searches.search == nullptr )
+	{
+		searches.search.reset( new ChessSearch() );
+	}
+	if ( session->level == MCTS_LEVEL && searches.mcts == nullptr )
+	{
+		searches.mcts.reset( new ChessMCTS( 1 ) ); // Playouts budget, one thread.
+	}
+	game->lendSearches( searches.search.get(), searches.mcts.get() );
+	const size_t plies = game->record().moves.size();
+	for ( int i = 0; i < MAX_UPDATES_PER_MOVE && !game->isFinished() && game->record().moves.size() == plies; i++ )
+	{
+		game->update( 0 );
+	}
+	game->lendSearches( nullptr, nullptr );
+	session->stalled = !game->isFinished() && game->record().moves.size() == plies;
+}
+
+void GameServer::onCompleted( Session& session )
+{
+	if ( session.closing )
+	{
+		release( session );
+		return;
+	}
+	// Set here, the event loop reads it for fen requests while the worker plays.
+	session.fen = session.game->getFEN();
+	publish( session );
+	next( session );
+}
+
+void GameServer::onExpired( Session& session )
+{
+	if ( session.state == Session::WAITING )
+	{
+		broadcast( session, "timeout " + std::to_string( session.id ) );
+	}
+	session.state = Session::RUNNING;
+	m_workers.push( &session );
+}
+
+void GameServer::publish( Session& session )
+{
+	const auto& moves = session.game->record().moves;
+	for ( ; session.published < moves.size(); session.published++ )
+	{
+		broadcast( session, "move " + std::to_string( session.id ) + " " + std::to_string( session.published + 1 ) + " " + moveText( moves[session.published] ) );
+	}
+}
+
+// Ends the game, or waits for its next move (client, timer or worker).
+void GameServer::next( Session& session )
+{
+	ChessGame* game = session.game;
+	if ( game->isFinished() || session.stalled )
+	{
+		const auto result = session.stalled ? ChessGameRecord::DRAW : game->record().result;
+		broadcast( session, "end " + std::to_string( session.id ) + " " + ChessGameRecord::resultToString( result ) );
+		m_slotsById.erase( session.id );
+		release( session );
+	}
+	else if ( session.human == int( game->isBlackTurn() ) )
+	{
+		session.state = Session::WAITING;
+		m_timers.schedule( session.slot, now() + m_deadline );
+	}
+	else if ( session.pace > 0 && session.published > 0 )
+	{
+		session.state = Session::SCHEDULED;
+		m_timers.schedule( session.slot, now() + session.pace );
+	}
+	else
+	{
+		session.state = Session::RUNNING;
+		m_workers.push( &session );
+	}
+}
+
+void GameServer::release( Session& session )
+{
+	m_timers.cancel( session.slot );
+	m_pools[session.level]->release( session.game );
+	session.game = nullptr;
+	session.state = Session::FREE;
+	session.watchers.clear();
+	session.fen.clear();
+	m_freeSlots.push_back( session.slot );
+}
+
+const std::string GameServer::stats() const
+{
+	size_t counts[4] = { 0, 0, 0, 0 };
+	for ( const auto& session : m_sessions )
+	{
+		counts[session->state]++;
+	}
+	return "stats sessions " + std::to_string( m_slotsById.size() ) + " running " + std::to_string( counts[Session::RUNNING] ) +
+		   " waiting " + std::to_string( counts[Session::WAITING] ) + " scheduled " + std::to_string( counts[Session::SCHEDULED] ) +
+		   " clients " + std::to_string( m_clients.size() );
+}
+
+int main( int argc, char** argv )
+{
+	if ( argc < 2 )
+	{
+		std::cout << "usage: game_server <socket path> [-threads N] [-deadline ms] [-max-sessions N] [-book file] [-tablebases dir] [-trace file]" << std::endl;
+		return 1;
+	}
+	int threadsCount = std::max( int( std::thread::hardware_concurrency() ), 1 );
+	int deadline = 60000;
+	size_t maxSessions = 100000;
+	std::string bookPath;
+	std::string tablebasesPath;
+	std::string tracePath;
+	for ( int i = 2; i < argc; i++ )
+	{
+		const std::string arg = argv[i];
+		if ( arg == "-threads" && i + 1 < argc ) threadsCount = std::stoi( argv[++i] );
+		else if ( arg == "-deadline" && i + 1 < argc ) deadline = std::stoi( argv[++i] );
+		else if ( arg == "-max-sessions" && i + 1 < argc ) maxSessions = size_t( std::stoul( argv[++i] ) );
+		else if ( arg == "-book" && i + 1 < argc ) bookPath = argv[++i];
+		else if ( arg == "-tablebases" && i + 1 < argc ) tablebasesPath = argv[++i];
+		else if ( arg == "-trace" && i + 1 < argc ) tracePath = argv[++i];
+	}
+
+	ChessOpeningBook book;
+	if ( !bookPath.empty() && !book.open( bookPath ) )
+	{
+		std::cout << "Could not open " << bookPath << std::endl;
+		return 1;
+	}
+	ChessTablebase tablebase;
+	if ( !tablebasesPath.empty() && !tablebase.open( tablebasesPath ) )
+	{
+		std::cout << "Could not open " << tablebasesPath << std::endl;
+		return 1;
+	}
+
+	if ( !tracePath.empty() )
+	{
+		ChessTracer::start(); // Before the workers are created, so they are named.
+		ChessTracer::setThreadName( "event loop" );
+	}
+	const sigset_t signals = stopSignals();
+	pthread_sigmask( SIG_BLOCK, &signals, nullptr );
+	signal( SIGPIPE, SIG_IGN );
+	GameServer server( threadsCount, deadline, maxSessions, bookPath.empty() ? nullptr : &book, tablebasesPath.empty() ? nullptr : &tablebase );
+	if ( !server.listen( argv[1] ) )
+	{
+		std::cout << "Could not listen on " << argv[1] << ": " << std::strerror( errno ) << std::endl;
+		return 1;
+	}
+	std::cout << "Listening on " << argv[1] << std::endl;
+	std::cout.setstate( std::ios::badbit ); // The games print their moves.
+	server.run();
+	std::cout.clear();
+	if ( !tracePath.empty() )
+	{
+		ChessTracer::stop();
+		if ( !ChessTracer::write( tracePath ) )
+		{
+			std::cout << "Could not write " << tracePath << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+#else
+int main( int argc, char** argv )
+{
+	std::cout << "game_server needs Linux (epoll, Unix domain sockets)." << std::endl;
+	return 1;
+}
+#endif
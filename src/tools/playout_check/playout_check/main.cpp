@@ -0,0 +1,99 @@
+#include "../../../game/ChessGame.h"
+#include "../../../game/ChessPlayout.h"
+#include "../../../game/ChessRandom.h"
+#include "../../../chess/ChessPosition.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+/**
+ Runs random playouts (see ChessPlayout) from a position and reports the results and the speed in
+ plies per second. With -verify every ply is compared with ChessMovePicker::generate, which fuzzes
+ both move generators: the exit code is 2 if they disagreed on any ply. Each thread runs its share
+ of the playouts with its own generator, seeded from -seed.
+
+ usage: playout_check [-fen FEN] [-playouts N] [-plies N] [-seed N] [-threads N] [-verify]
+ e.g.   playout_check -playouts 1000000
+		playout_check -playouts 20000 -verify -seed 7
+*/
+
+int main( int argc, char** argv )
+{
+	std::string fen;
+	int playoutsCount = 100000;
+	int maxPlies = ChessPlayout::DEFAULT_MAX_PLIES;
+	uint64_t seed = 1;
+	int threadsCount = 1;
+	bool verify = false;
+	for ( int i = 1; i < argc; i++ )
+	{
+		const std::string arg = argv[i];
+		if ( arg == "-fen" && i + 1 < argc ) fen = argv[++i];
+		else if ( arg == "-playouts" && i + 1 < argc ) playoutsCount = std::stoi( argv[++i] );
+		else if ( arg == "-plies" && i + 1 < argc ) maxPlies = std::stoi( argv[++i] );
+		else if ( arg == "-seed" && i + 1 < argc ) seed = std::stoull( argv[++i] );
+		else if ( arg == "-threads" && i + 1 < argc ) threadsCount = std::max( std::stoi( argv[++i] ), 1 );
+		else if ( arg == "-verify" ) verify = true;
+		else
+		{
+			std::cout << "usage: playout_check [-fen FEN] [-playouts N] [-plies N] [-seed N] [-threads N] [-verify]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout.setstate( std::ios::badbit ); // The game prints its creation.
+	ChessGame game( ChessGameSettings( false, 0 ) );
+	const bool loaded = fen.empty() || game.loadFEN( fen );
+	std::cout.clear();
+	if ( !loaded )
+	{
+		std::cout << "Invalid FEN: " << fen << std::endl;
+		return 1;
+	}
+	ChessPosition position;
+	game.getPosition( position );
+
+	std::vector< ChessPlayoutStats > stats( threadsCount );
+	std::vector< std::thread > workers;
+	ChessRandom seeds( seed );
+	const auto start = std::chrono::steady_clock::now();
+	for ( int i = 0; i < threadsCount; i++ )
+	{
+		const int count = playoutsCount / threadsCount + ( i < playoutsCount % threadsCount ? 1 : 0 );
+		workers.emplace_back( [&, i, count]( const uint64_t threadSeed )
+		{
+			ChessRandom random( threadSeed );
+			ChessPlayout::run( position, count, maxPlies, random, stats[i], verify );
+		}, seeds.next() );
+	}
+	for ( auto& worker : workers )
+	{
+		worker.join();
+	}
+	const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+	ChessPlayoutStats total;
+	for ( const ChessPlayoutStats& threadStats : stats )
+	{
+		total.playouts += threadStats.playouts;
+		total.wins[0] += threadStats.wins[0];
+		total.wins[1] += threadStats.wins[1];
+		total.draws += threadStats.draws;
+		total.plies += threadStats.plies;
+		total.mismatches += threadStats.mismatches;
+	}
+	const double pliesPerSecond = double( total.plies ) / std::max( seconds, 1e-9 );
+	std::cout << "Playouts: " << total.playouts << ", white wins: " << total.wins[0] << ", black wins: " << total.wins[1]
+			  << ", draws: " << total.draws << std::endl;
+	std::cout << std::fixed << std::setprecision( 1 ) << "Plies: " << total.plies << " (" << double( total.plies ) / std::max( double( total.playouts ), 1.0 )
+			  << " per playout), " << std::setprecision( 0 ) << pliesPerSecond << " plies/s, " << pliesPerSecond / threadsCount << " per thread" << std::endl;
+	if ( verify )
+	{
+		std::cout << "Verified plies with mismatches: " << total.mismatches << std::endl;
+	}
+	return total.mismatches == 0 ? 0 : 2;
+}
@@ -0,0 +1,538 @@
+#include "../../../game/ChessGame.h"
+#include "../../../game/ChessGameRecord.h"
+#include "../../../game/ChessOpeningBook.h"
+#include "../../../game/ChessPlayer.h"
+#include "../../../game/ChessMovePicker.h"
+#include "../../../game/ChessPlayout.h"
+#include "../../../game/ChessRandom.h"
+#include "../../../game/ChessSearch.h"
+#include "../../../game/ChessMCTS.h"
+#include "../../../game/ChessTablebase.h"
+#include "../../../chess/ChessBoard.h"
+#include "../../../chess/ChessPosition.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+
+/**
+ Regression checks of the game library, on fixed positions and seeds so every run is the same:
+	fen			FEN export of loaded positions and of random games loads back to the same FEN;
+				malformed placements are rejected and leave the board as it was.
+	perft		the move generators count the same leaves, make / unmake restores the position.
+	book		an opening book file reads back its entries.
+	replay		game records read back and replay to the same moves.
+	tablebase	on a generated KQvK table, ChessSearch scores are exact and ChessMCTS keeps the wins.
+ Each check prints its failures and a summary line; the exit code is 1 if any check failed.
+
+ usage: regression_check [check...]	(all of them by default)
+ e.g.   regression_check fen
+*/
+
+namespace
+{
+	const char* const FENS[] =
+	{
+		"rnbkqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b - - 0 1",
+		"rnbkqbnr/pppp1ppp/4p3/8/8/6P1/PPPPPP1P/RNBQKBNR b - - 0 2",
+		"2b1k2r/2pp3p/2p2Bp1/p3pp2/Pr6/3P4/1P2PPBP/1RQ1K2R w - - 0 16",
+		"rnbk1bn1/2pp4/4pq1r/8/1p1N2p1/1P2P3/1RP2PPP/2BQKBR1 b - - 0 21",
+		"4k3/8/8/3q4/8/8/3Q4/4K3 w - - 0 40",
+		"k7/8/8/8/8/8/8/K7 b - - 0 1"
+	};
+
+	const char* const INVALID_FENS[] =
+	{
+		"rnbkqbnr/pppppppp/8/8/8/P7/PPPPPPPP/RNBQKBNR b - - 0 1", // 17 white pieces.
+		"rnbkqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQQBNR b - - 0 1", // No white king.
+		"rnbkqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNRR b - - 0 1", // 9 columns.
+		"rnbkqbnr/pppppppp/8/8/8/8/PPPPPPPP b - - 0 1", // 7 rows.
+		"rnbkqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x - - 0 1" // Side to move.
+	};
+
+	const int RANDOM_GAMES = 20;
+	const int RANDOM_PLIES = 120;
+	struct PerftCase
+	{
+		const char* fen;
+		int depth;
+		uint64_t leaves;
+	};
+
+	// Positions where a king was captured are leaves, they are not expanded.
+	const PerftCase PERFT_CASES[] =
+	{
+		{ "rnbkqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b - - 0 1", 4, 196830 },
+		{ "2b1k2r/2pp3p/2p2Bp1/p3pp2/Pr6/3P4/1P2PPBP/1RQ1K2R w - - 0 16", 3, 33471 },
+		{ "rnbk1bn1/2pp4/4pq1r/8/1p1N2p1/1P2P3/1RP2PPP/2BQKBR1 b - - 0 21", 3, 51278 },
+		{ "4k3/8/8/3q4/8/8/3Q4/4K3 w - - 0 40", 4, 485155 }
+	};
+
+	const int BOOK_PLIES = 12;
+	const unsigned int REPLAY_LEVELS[] = { 1, 2, 3, 4, 5 };
+	const int REPLAY_PLIES = 40;
+	const int TABLEBASE_POSITIONS = 200;
+	const int TABLEBASE_DEPTH = 2; // The root is not probed, its moves are.
+	const int TABLEBASE_PLAYOUTS = 150; // Few enough that playouts alone miss some of the wins.
+
+	std::unique_ptr< ChessGame > createGame( const unsigned int levelAI = 4 )
+	{
+		std::cout.setstate( std::ios::badbit ); // The game prints its creation.
+		std::unique_ptr< ChessGame > game( new ChessGame( ChessGameSettings( false, 0, 0, levelAI ) ) );
+		std::cout.clear();
+		return game;
+	}
+
+	// Plays a random move of the side to move, false if it has none or the game is over.
+	const bool playRandomMove( ChessGame& game, ChessRandom& random )
+	{
+		if ( game.isFinished() )
+		{
+			return false;
+		}
+		ChessPosition position;
+		game.getPosition( position );
+		ChessMove moves[2 * ChessMovePicker::MAX_MOVES];
+		int count = 0;
+		ChessMovePicker::generate( position, true, moves, count );
+		ChessMovePicker::generate( position, false, moves, count );
+		if ( count == 0 )
+		{
+			return false;
+		}
+		const ChessMove move = moves[random.next() % uint64_t( count )];
+		const int from = ChessMovePicker::from( move );
+		const int to = ChessMovePicker::to( move );
+		return game.playMove( CellNode( from / ChessBoard::SIZE, from % ChessBoard::SIZE ), CellNode( to / ChessBoard::SIZE, to % ChessBoard::SIZE ) );
+	}
+
+	/**
+	 Loads the FEN of the game into the other one, which must export the same FEN and keep its key
+	 when loading it again. The keys of both games may differ: FEN does not tell which pawns used
+	 their double step, loadFEN guesses it from the rows.
+	*/
+	const bool sameAfterReload( const ChessGame& game, ChessGame& other )
+	{
+		const std::string fen = game.getFEN();
+		const bool loaded = other.loadFEN( fen ) && other.getFEN() == fen;
+		const uint64_t key = other.positionHash();
+		if ( !loaded || !other.loadFEN( fen ) || other.positionHash() != key )
+		{
+			std::cout << "  fen: " << fen << " does not load back" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Plays the decisions of the AI, like ChessGame::replay does.
+	void playDecisions( ChessGame& game, const int plies )
+	{
+		for ( int ply = 0; ply < plies && !game.isFinished(); ply++ )
+		{
+			CellNode from, to;
+			game.activePlayer()->generateDecision();
+			if ( !game.activePlayer()->decision( from, to ) || !game.playMove( from, to ) )
+			{
+				return;
+			}
+		}
+	}
+
+	const bool sameRecord( const ChessGameRecord& a, const ChessGameRecord& b )
+	{
+		return a.moves == b.moves && a.result == b.result && a.seed == b.seed && a.startFEN == b.startFEN
+			&& a.hasStartPosition == b.hasStartPosition && ( !a.hasStartPosition || a.startPosition.key() == b.startPosition.key() );
+	}
+}
+
+// FEN import / export.
+const int checkFEN()
+{
+	int failures = 0;
+	std::unique_ptr< ChessGame > game = createGame();
+	std::unique_ptr< ChessGame > other = createGame();
+	for ( const char* fen : FENS )
+	{
+		if ( !game->loadFEN( fen ) || game->getFEN() != fen )
+		{
+			std::cout << "  fen: " << fen << " exported as " << game->getFEN() << std::endl;
+			failures++;
+		}
+		else if ( !sameAfterReload( *game, *other ) )
+		{
+			failures++;
+		}
+	}
+	for ( const char* fen : INVALID_FENS )
+	{
+		game->resetPosition();
+		const std::string before = game->getFEN();
+		if ( game->loadFEN( fen ) || game->getFEN() != before )
+		{
+			std::cout << "  fen: " << fen << " accepted or changed the board" << std::endl;
+			failures++;
+		}
+	}
+	ChessRandom random( 1 );
+	for ( int i = 0; i < RANDOM_GAMES; i++ )
+	{
+		game->resetPosition();
+		for ( int ply = 0; ply < RANDOM_PLIES && playRandomMove( *game, random ) && !game->isFinished(); ply++ )
+		{
+			if ( !sameAfterReload( *game, *other ) )
+			{
+				failures++;
+				break;
+			}
+		}
+	}
+	return failures;
+}
+
+/**
+ Leaves of the position at depth. On every node the targets of each piece of the side to move
+ must be the same for ChessGame (loaded with the position), ChessMovePicker::generate and
+ ChessPlayout, and ChessGame::unmakeMove must take every move back; the first different node is
+ printed.
+*/
+const uint64_t perft( ChessGame& game, const ChessPosition& position, const int depth, int& failures )
+{
+	if ( depth == 0 || position.kingSquare[0] == -1 || position.kingSquare[1] == -1 )
+	{
+		return 1;
+	}
+	ChessMove moves[2 * ChessMovePicker::MAX_MOVES];
+	int count = 0;
+	ChessMovePicker::generate( position, true, moves, count );
+	ChessMovePicker::generate( position, false, moves, count );
+	uint64_t targets[ChessBoard::CELLS_COUNT] = {};
+	for ( int i = 0; i < count; i++ )
+	{
+		targets[ChessMovePicker::from( moves[i] )] |= uint64_t( 1 ) << ChessMovePicker::to( moves[i] );
+	}
+
+	game.loadPosition( position );
+	const ChessPlayout playout( position );
+	for ( int square = 0; square < ChessBoard::CELLS_COUNT; square++ )
+	{
+		const int indexPiece = position.cells[square];
+		if ( indexPiece == ChessPosition::NO_PIECE || position.isBlack( indexPiece ) != position.blackToMove )
+		{
+			continue;
+		}
+		uint64_t gameTargets = 0;
+		for ( const CellNode& node : game.getPossiblePositionsByPiece( indexPiece, false, false ) )
+		{
+			gameTargets |= uint64_t( 1 ) << ( node.r * ChessBoard::SIZE + node.c );
+		}
+		if ( gameTargets != targets[square] || playout.targets( square ) != targets[square] )
+		{
+			if ( failures++ == 0 )
+			{
+				std::cout << "  perft: moves from square " << square << " differ in " << game.getFEN() << std::endl;
+			}
+		}
+	}
+
+	// ChessGame::makeMove must give the position of ChessPosition::makeMove, unmakeMove the node again.
+	for ( int i = 0; i < count; i++ )
+	{
+		const int from = ChessMovePicker::from( moves[i] );
+		const int to = ChessMovePicker::to( moves[i] );
+		ChessPosition child = position;
+		child.makeMove( from, to );
+		ChessMoveUndo undo;
+		ChessPosition made, unmade;
+		game.makeMove( position.cells[from], CellNode( to / ChessBoard::SIZE, to % ChessBoard::SIZE ), &undo );
+		game.getPosition( made );
+		game.unmakeMove( undo );
+		game.getPosition( unmade );
+		if ( made.hash != child.hash || unmade.hash != position.hash || unmade.pawnsUsedDoubleStep != position.pawnsUsedDoubleStep )
+		{
+			if ( failures++ == 0 )
+			{
+				std::cout << "  perft: move " << i << " is not taken back in " << game.getFEN() << std::endl;
+			}
+		}
+	}
+
+	uint64_t leaves = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		ChessPosition child = position;
+		child.makeMove( ChessMovePicker::from( moves[i] ), ChessMovePicker::to( moves[i] ) );
+		leaves += perft( game, child, depth - 1, failures );
+	}
+	return leaves;
+}
+
+// Move generators.
+const int checkPerft()
+{
+	int failures = 0;
+	std::unique_ptr< ChessGame > game = createGame();
+	for ( const PerftCase& perftCase : PERFT_CASES )
+	{
+		ChessPosition position;
+		game->loadFEN( perftCase.fen );
+		game->getPosition( position );
+		int differences = 0;
+		const uint64_t leaves = perft( *game, position, perftCase.depth, differences );
+		if ( differences > 0 || leaves != perftCase.leaves )
+		{
+			std::cout << "  perft: " << perftCase.fen << " depth " << perftCase.depth << ": " << leaves << " leaves (expected "
+					  << perftCase.leaves << "), " << differences << " different nodes" << std::endl;
+			failures++;
+		}
+	}
+	return failures;
+}
+
+// Opening book files (ChessOpeningBook), laid out like book_builder writes them.
+const int checkBook()
+{
+	int failures = 0;
+	for ( int move = 0; move < ChessBoard::CELLS_COUNT * ChessBoard::CELLS_COUNT; move++ )
+	{
+		const CellNode from( move / ChessBoard::CELLS_COUNT / ChessBoard::SIZE, move / ChessBoard::CELLS_COUNT % ChessBoard::SIZE );
+		const CellNode to( move % ChessBoard::CELLS_COUNT / ChessBoard::SIZE, move % ChessBoard::SIZE );
+		CellNode decodedFrom, decodedTo;
+		ChessOpeningBook::decodeMove( ChessOpeningBook::encodeMove( from, to ), decodedFrom, decodedTo );
+		if ( !( decodedFrom == from ) || !( decodedTo == to ) )
+		{
+			std::cout << "  book: " << ChessGame::moveToString( from, to ) << " decodes to " << ChessGame::moveToString( decodedFrom, decodedTo ) << std::endl;
+			failures++;
+		}
+	}
+
+	// Times each move was played per position, the weights of the book.
+	std::map< uint64_t, std::map< uint16_t, uint16_t > > counts;
+	std::unique_ptr< ChessGame > game = createGame();
+	ChessRandom random( 3 );
+	for ( int i = 0; i < RANDOM_GAMES; i++ )
+	{
+		game->resetPosition();
+		for ( int ply = 0; ply < BOOK_PLIES; ply++ )
+		{
+			const uint64_t key = game->positionHash();
+			const size_t played = game->record().moves.size();
+			if ( !playRandomMove( *game, random ) )
+			{
+				break;
+			}
+			counts[key][game->record().moves[played]]++;
+		}
+	}
+
+	std::vector< ChessBookEntry > entries;
+	for ( const auto&[key, moves] : counts )
+	{
+		const size_t begin = entries.size();
+		for ( const auto&[move, count] : moves )
+		{
+			entries.push_back( { key, move, count, uint32_t( entries.size() ) } );
+		}
+		std::stable_sort( entries.begin() + begin, entries.end(), []( const ChessBookEntry& a, const ChessBookEntry& b ) { return a.weight > b.weight; } );
+	}
+	const std::string path = ( std::filesystem::temp_directory_path() / "regression_check.book" ).string();
+	{
+		std::vector< unsigned char > buffer( entries.size() * ChessOpeningBook::ENTRY_SIZE );
+		for ( size_t i = 0; i < entries.size(); i++ )
+		{
+			ChessOpeningBook::writeEntry( buffer.data() + i * ChessOpeningBook::ENTRY_SIZE, entries[i] );
+		}
+		std::ofstream stream( path, std::ios::binary );
+		stream.write( reinterpret_cast< const char* >( buffer.data() ), std::streamsize( buffer.size() ) );
+	}
+
+	ChessOpeningBook book;
+	if ( !book.open( path ) || book.size() != entries.size() )
+	{
+		std::cout << "  book: " << path << " does not open with " << entries.size() << " entries" << std::endl;
+		std::filesystem::remove( path );
+		return failures + 1;
+	}
+	std::vector< ChessBookEntry > read;
+	for ( size_t begin = 0; begin < entries.size(); begin += read.size() )
+	{
+		read.clear();
+		book.getEntries( entries[begin].key, read );
+		bool same = !read.empty() && begin + read.size() <= entries.size();
+		for ( size_t i = 0; same && i < read.size(); i++ )
+		{
+			const ChessBookEntry& entry = entries[begin + i];
+			same = read[i].key == entry.key && read[i].move == entry.move && read[i].weight == entry.weight && read[i].learn == entry.learn;
+		}
+		CellNode from, to, bestFrom, bestTo;
+		ChessOpeningBook::decodeMove( entries[begin].move, bestFrom, bestTo );
+		if ( !same || !book.chooseMove( entries[begin].key, 0.0, from, to ) || !( from == bestFrom ) || !( to == bestTo ) )
+		{
+			std::cout << "  book: entries of key " << entries[begin].key << " do not read back" << std::endl;
+			failures++;
+			read.assign( 1, entries[begin] );
+		}
+	}
+	read.clear();
+	book.getEntries( entries.back().key + 1, read );
+	if ( counts.count( entries.back().key + 1 ) == 0 && !read.empty() )
+	{
+		std::cout << "  book: a key not in the book has entries" << std::endl;
+		failures++;
+	}
+	book.close();
+	std::filesystem::remove( path );
+	return failures;
+}
+
+// Game records (ChessGameRecord) and ChessGame::replay.
+const int checkReplay()
+{
+	int failures = 0;
+	ChessRandom random( 2 );
+	std::unique_ptr< ChessGame > source = createGame();
+	for ( int i = 0; i < 12; i++ ) playRandomMove( *source, random ); // Captures leave the indices out of square order.
+	ChessPosition position;
+	source->getPosition( position );
+
+	for ( const unsigned int levelAI : REPLAY_LEVELS )
+	{
+		std::unique_ptr< ChessGame > game = createGame( levelAI );
+		std::unique_ptr< ChessGame > other = createGame( levelAI );
+		for ( int start = 0; start < 3; start++ )
+		{
+			if ( start == 0 ) game->resetGame();
+			if ( start == 1 ) game->loadFEN( FENS[2] );
+			if ( start == 2 ) game->loadPosition( position );
+			playDecisions( *game, REPLAY_PLIES );
+
+			std::stringstream stream;
+			ChessGameRecord::writeHeader( stream );
+			game->record().write( stream );
+			ChessGameRecord record;
+			const int version = ChessGameRecord::readHeader( stream );
+			uint16_t decided = 0;
+			if ( version != ChessGameRecord::VERSION || !record.read( stream, version ) || !sameRecord( record, game->record() ) )
+			{
+				std::cout << "  replay: level " << levelAI << ", start " << start << ": record does not read back" << std::endl;
+				failures++;
+			}
+			else if ( other->replay( record, &decided ) != record.moves.size() || !sameRecord( other->record(), record ) )
+			{
+				std::cout << "  replay: level " << levelAI << ", start " << start << ": diverges at " << other->getFEN() << std::endl;
+				failures++;
+			}
+		}
+	}
+	return failures;
+}
+
+// Tablebase probes inside the searches, from KQvK positions: every move leads to a covered position.
+const int checkTablebase()
+{
+	int failures = 0;
+	const std::filesystem::path directory = std::filesystem::temp_directory_path() / "regression_check.tablebases";
+	std::filesystem::create_directories( directory );
+	std::cout.setstate( std::ios::badbit ); // The generator prints its tables.
+	const bool generated = ChessTablebase::generate( "KQvK", directory.string(), 1 );
+	std::cout.clear();
+	ChessTablebase tablebase;
+	if ( !generated || !tablebase.open( directory.string() ) )
+	{
+		std::cout << "  tablebase: KQvK is not generated in " << directory.string() << std::endl;
+		std::filesystem::remove_all( directory );
+		return failures + 1;
+	}
+	ChessSearch search;
+	search.setTablebase( &tablebase );
+	ChessMCTS mcts( 1 );
+	mcts.setTablebase( &tablebase );
+
+	ChessRandom random( 3 );
+	for ( int i = 0; i < TABLEBASE_POSITIONS; i++ )
+	{
+		int squares[3];
+		for ( int j = 0; j < 3; j++ )
+		{
+			do squares[j] = int( random.next() % ChessBoard::CELLS_COUNT );
+			while ( std::find( squares, squares + j, squares[j] ) != squares + j );
+		}
+		ChessPosition position;
+		position.clear();
+		position.addPiece( 0, ChessPiece::KING, false, squares[0] );
+		position.addPiece( 1, ChessPiece::QUEEN, false, squares[1] );
+		position.addPiece( ChessBoard::PIECES_COUNT / 2, ChessPiece::KING, true, squares[2] );
+		position.blackToMove = ( random.next() & 1 ) != 0;
+		ChessTablebaseResult expected;
+		if ( !tablebase.probe( position, expected ) )
+		{
+			continue; // Not a legal position.
+		}
+
+		int score = 0;
+		search.clear();
+		const ChessMove move = search.search( position, TABLEBASE_DEPTH, score );
+		const int winScore = ChessSearch::WIN_SCORE - expected.distance;
+		const int expectedScore = expected.wdl == ChessTablebaseResult::DRAW ? 0 : ( expected.wdl == ChessTablebaseResult::WIN ? winScore : -winScore );
+		if ( score != expectedScore )
+		{
+			std::cout << "  tablebase: search scores " << score << " instead of " << expectedScore << std::endl;
+			failures++;
+		}
+		if ( expected.wdl != ChessTablebaseResult::WIN || move == ChessMovePicker::NO_MOVE )
+		{
+			continue;
+		}
+		const ChessMove mctsMove = mcts.search( position, TABLEBASE_PLAYOUTS, 0, random.next() );
+		ChessPosition child = position;
+		child.makeMove( ChessMovePicker::from( mctsMove ), ChessMovePicker::to( mctsMove ) );
+		ChessTablebaseResult result;
+		if ( child.kingSquare[child.blackToMove] != -1 && ( !tablebase.probe( child, result ) || result.wdl != ChessTablebaseResult::LOSS ) )
+		{
+			std::cout << "  tablebase: Monte Carlo move " << ChessMovePicker::from( mctsMove ) << "-" << ChessMovePicker::to( mctsMove ) << " gives the win away" << std::endl;
+			failures++;
+		}
+	}
+	tablebase.close();
+	std::filesystem::remove_all( directory );
+	return failures;
+}
+
+int main( int argc, char** argv )
+{
+	struct Check
+	{
+		const char* name;
+		const int ( *run )();
+	};
+	const Check checks[] =
+	{
+		{ "fen", checkFEN },
+		{ "perft", checkPerft },
+		{ "book", checkBook },
+		{ "replay", checkReplay },
+		{ "tablebase", checkTablebase }
+	};
+
+	int failed = 0;
+	for ( const Check& check : checks )
+	{
+		bool selected = argc < 2;
+		for ( int i = 1; i < argc; i++ )
+		{
+			selected = selected || check.name == std::string( argv[i] );
+		}
+		if ( !selected )
+		{
+			continue;
+		}
+		const int failures = check.run();
+		std::cout << check.name << ": " << ( failures == 0 ? "ok" : std::to_string( failures ) + " failures" ) << std::endl;
+		failed += failures > 0 ? 1 : 0;
+	}
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#include "../../../game/ChessGame.h"
+#include "../../../game/ChessGameRecord.h"
+#include "../../../game/ChessGameReader.h"
+#include "../../../game/ChessOpeningBook.h"
+#include "../../../game/ChessTablebase.h"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+/**
+ Replays recorded games (.cgr, see ChessGameRecord) through the current decision logic and checks
+ that every decision is the recorded move: a refactor of the generators or the heuristics must
+ not change any of them. The inputs are read once and the games replayed on several threads
+ (see ChessGameReader); each divergence is reported with the
+ game index, the ply, the position and both moves. The level, book and tablebases must be the
+ ones the games were played with.
+
+ usage: replay_check <games.cgr>... [-level N] [-threads N] [-book file] [-tablebases dir]
+*/
+
+namespace
+{
+	struct Divergence
+	{
+		size_t indexGame;
+		size_t ply;
+		std::string fen;
+		uint16_t recorded;
+		uint16_t decided;
+	};
+
+	std::string moveText( const uint16_t move )
+	{
+		if ( move == 0 ) return "none";
+		CellNode from, to;
+		ChessOpeningBook::decodeMove( move, from, to );
+		return ChessGame::moveToString( from, to );
+	}
+}
+
+class ReplayChecker
+{
+public:
+	ReplayChecker( const int threadsCount, const int levelAI, const ChessOpeningBook* book, const ChessTablebase* tablebase );
+	void addInput( const std::string& path );
+	void run();
+	const bool report() const;
+private:
+	int m_threadsCount;
+	int m_levelAI;
+	const ChessOpeningBook* m_book;
+	const ChessTablebase* m_tablebase;
+	std::vector< std::string > m_inputs;
+	std::vector< size_t > m_gamesCount; // [thread]
+	std::vector< size_t > m_movesCount; // [thread]
+	std::vector< Divergence > m_divergences;
+	std::mutex m_mutex; // Of m_divergences.
+	double m_seconds;
+};
+
+ReplayChecker::ReplayChecker( const int threadsCount, const int levelAI, const ChessOpeningBook* book, const ChessTablebase* tablebase ) :
+	m_threadsCount( std::max( threadsCount, 1 ) ),
+	m_levelAI( levelAI ),
+	m_book( book ),
+	m_tablebase( tablebase ),
+	m_seconds( 0.0 )
+{}
+
+void ReplayChecker::addInput( const std::string& path )
+{
+	m_inputs.push_back( path );
+}
+
+void ReplayChecker::run()
+{
+	m_gamesCount.assign( m_threadsCount, 0 );
+	m_movesCount.assign( m_threadsCount, 0 );
+	std::vector< std::unique_ptr< ChessGame > > games( m_threadsCount );
+	for ( auto& game : games )
+	{
+		game.reset( new ChessGame( ChessGameSettings( false, 0, 0, m_levelAI ) ) );
+		game->setOpeningBook( m_book );
+		game->setTablebase( m_tablebase );
+	}
+	const auto start = std::chrono::steady_clock::now();
+	ChessGameReader reader( m_inputs );
+	reader.process( m_threadsCount, [this, &games]( const int indexThread, ChessGameInput& input )
+	{
+		if ( !input.pgn.empty() )
+		{
+			return; // PGN games have no seed to replay them with.
+		}
+		ChessGame& game = *games[indexThread];
+		const ChessGameRecord& record = input.record;
+		uint16_t decided = 0;
+		const size_t ply = game.replay( record, &decided );
+		m_gamesCount[indexThread]++;
+		m_movesCount[indexThread] += ply;
+		if ( ply < record.moves.size() )
+		{
+			std::lock_guard< std::mutex > lock( m_mutex );
+			m_divergences.push_back( { input.index, ply, game.getFEN(), record.moves[ply], decided } );
+		}
+	} );
+	m_seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+	std::sort( m_divergences.begin(), m_divergences.end(), []( const Divergence& a, const Divergence& b ) { return a.indexGame < b.indexGame; } );
+}
+
+// False if any game diverged.
+const bool ReplayChecker::report() const
+{
+	size_t games = 0;
+	size_t moves = 0;
+	for ( const size_t count : m_gamesCount ) games += count;
+	for ( const size_t count : m_movesCount ) moves += count;
+	for ( const Divergence& divergence : m_divergences )
+	{
+		std::cout << "Game " << divergence.indexGame << " diverges at ply " << divergence.ply << " (" << divergence.fen << "): recorded "
+				  << moveText( divergence.recorded ) << ", decided " << moveText( divergence.decided ) << std::endl;
+	}
+	std::cout << "Games replayed: " << games << ", moves: " << moves << ", diverged: " << m_divergences.size()
+			  << " (" << int( double( moves ) / std::max( m_seconds, 1e-9 ) ) << " moves/s)" << std::endl;
+	return m_divergences.empty();
+}
+
+int main( int argc, char** argv )
+{
+	int threadsCount = int( std::thread::hardware_concurrency() );
+	int levelAI = 4;
+	std::string bookPath;
+	std::string tablebasesPath;
+	std::vector< std::string > inputs;
+	for ( int i = 1; i < argc; i++ )
+	{
+		const std::string arg = argv[i];
+		if ( arg == "-threads" && i + 1 < argc ) threadsCount = std::stoi( argv[++i] );
+		else if ( arg == "-level" && i + 1 < argc ) levelAI = std::stoi( argv[++i] );
+		else if ( arg == "-book" && i + 1 < argc ) bookPath = argv[++i];
+		else if ( arg == "-tablebases" && i + 1 < argc ) tablebasesPath = argv[++i];
+		else inputs.push_back( arg );
+	}
+	if ( inputs.empty() )
+	{
+		std::cout << "usage: replay_check <games.cgr>... [-level N] [-threads N] [-book file] [-tablebases dir]" << std::endl;
+		return 1;
+	}
+
+	ChessOpeningBook book;
+	if ( !bookPath.empty() && !book.open( bookPath ) )
+	{
+		std::cout << "Could not open " << bookPath << std::endl;
+		return 1;
+	}
+	ChessTablebase tablebase;
+	if ( !tablebasesPath.empty() && !tablebase.open( tablebasesPath ) )
+	{
+		std::cout << "Could not open " << tablebasesPath << std::endl;
+		return 1;
+	}
+
+	ReplayChecker checker( threadsCount, levelAI, bookPath.empty() ? nullptr : &book, tablebasesPath.empty() ? nullptr : &tablebase );
+	for ( const auto& input : inputs )
+	{
+		checker.addInput( input );
+	}
+	std::cout.setstate( std::ios::badbit ); // The games print their moves.
+	checker.run();
+	std::cout.clear();
+	return checker.report() ? 0 : 2;
+}
@@ -0,0 +1,49 @@
+#include "../../../game/ChessTablebase.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <filesystem>
+
+/**
+ Generates pawnless endgame tablebases (and the smaller tables they depend on) into a directory,
+ created if needed.
+
+ usage: tablebase_gen <output directory> <material>... [-threads N]
+ e.g.   tablebase_gen tablebases KQvK KRvK KQvKR
+*/
+
+int main( int argc, char** argv )
+{
+	if ( argc < 3 )
+	{
+		std::cout << "usage: tablebase_gen <output directory> <material>... [-threads N]" << std::endl;
+		return 1;
+	}
+	int threadsCount = int( std::thread::hardware_concurrency() );
+	std::vector< std::string > signatures;
+	for ( int i = 2; i < argc; i++ )
+	{
+		const std::string arg = argv[i];
+		if ( arg == "-threads" && i + 1 < argc ) threadsCount = std::stoi( argv[++i] );
+		else signatures.push_back( arg );
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories( argv[1], error );
+	if ( error )
+	{
+		std::cout << "Could not create " << argv[1] << ": " << error.message() << std::endl;
+		return 1;
+	}
+
+	for ( const auto& signature : signatures )
+	{
+		if ( !ChessTablebase::generate( signature, argv[1], threadsCount ) )
+		{
+			std::cout << "Could not generate " << signature << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,449 @@
+#include "../../../game/ChessGame.h"
+#include "../../../game/ChessSearch.h"
+#include "../../../game/ChessMCTS.h"
+#include "../../../game/ChessMovePicker.h"
+#include "../../../game/ChessRandom.h"
+#include "../../../chess/ChessBoard.h"
+#include "../../../chess/ChessPosition.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <algorithm>
+
+/**
+ UCI front end, for tournament managers (cutechess-cli and the like) over stdin / stdout. The
+ commands are read on the main thread and the search runs on its own thread, so stop and ponderhit
+ are handled at once: the alpha-beta search (ChessSearch) sees the stop flag within
+ ChessSearch::SLICE_CHECK_STEPS steps, the Monte Carlo search (ChessMCTS) at its next playout.
+
+ startpos is the start position of this game (ChessBoard::initInDefaultPositions, black moves
+ first); "position fen" takes the FEN of ChessGame::loadFEN. Moves are coordinates (e2e4).
+ go supports wtime, btime, winc, binc, movestogo, movetime, depth, nodes, infinite and ponder.
+ Options: Hash (MB, alpha-beta table), Threads (Monte Carlo search), Search (AlphaBeta or MCTS),
+ Ponder.
+
+ usage: uci_engine
+ e.g.   cutechess-cli -engine cmd=uci_engine -engine cmd=uci_engine option.Search=MCTS -each tc=10+0.1
+*/
+
+namespace
+{
+	const int MAX_DEPTH = ChessSearch::MAX_PLY / 2;
+	const int SLICE_TIME = 1; // Milliseconds between two checks of the limits of an alpha-beta search.
+	const int MOVE_OVERHEAD = 30; // Milliseconds kept for the communication.
+	const int DEFAULT_MOVES_TO_GO = 30;
+	const int DEFAULT_HASH = 1; // MB, the table of ChessSearch::TABLE_BITS.
+	const int MAX_HASH = 1024;
+	const int MAX_THREADS = 256;
+
+	inline const int64_t now()
+	{
+		return std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	std::string moveText( const ChessMove move )
+	{
+		if ( move == ChessMovePicker::NO_MOVE )
+		{
+			return "0000";
+		}
+		const int from = ChessMovePicker::from( move );
+		const int to = ChessMovePicker::to( move );
+		return ChessGame::moveToString( CellNode( from / ChessBoard::SIZE, from % ChessBoard::SIZE ), CellNode( to / ChessBoard::SIZE, to % ChessBoard::SIZE ) );
+	}
+
+	// Table bits of ChessSearch for a size in MB (entries of 16 bytes).
+	const int tableBits( const int megabytes )
+	{
+		int bits = ChessSearch::TABLE_BITS;
+		while ( ( 2 << ( bits - ChessSearch::TABLE_BITS ) ) <= megabytes )
+		{
+			bits++;
+		}
+		return bits;
+	}
+}
+
+// Limits of a go command, 0 when not given.
+struct SearchLimits
+{
+	int depth;
+	uint64_t nodes;
+	int time; // Milliseconds for the move, from wtime / btime / movetime.
+	bool infinite; // Until stop, also when no limit is given.
+	bool ponder;
+};
+
+class UciEngine
+{
+public:
+	UciEngine();
+	~UciEngine();
+	void run();
+private:
+	void identify();
+	void setOption( std::istringstream& arguments );
+	void setPosition( std::istringstream& arguments );
+	void go( std::istringstream& arguments );
+	void stop();
+	void ponderHit();
+	void finishSearch();
+	void prepare();
+	void think( const ChessPosition position, const SearchLimits limits );
+	const ChessMove alphaBeta( const ChessPosition& position, const SearchLimits& limits );
+	const ChessMove monteCarlo( const ChessPosition& position, const SearchLimits& limits );
+	const bool timeIsOver( const SearchLimits& limits ) const;
+	void send( const std::string& line );
+private:
+	std::unique_ptr< ChessGame > m_game; // Position set by the position command.
+	std::unique_ptr< ChessSearch > m_search;
+	std::unique_ptr< ChessMCTS > m_mcts;
+	ChessRandom m_random;
+	int m_hash;
+	int m_threadsCount;
+	bool m_useMCTS;
+
+	// Running search.
+	std::thread m_thinking;
+	std::atomic< bool > m_stop;
+	std::atomic< bool > m_pondering;
+	std::atomic< int64_t > m_start; // Of the search, or of the ponderhit.
+	std::mutex m_mutex; // Output, and the wait for stop / ponderhit once the search is over.
+	std::condition_variable m_condition;
+};
+
+UciEngine::UciEngine() :
+	m_random( ChessRandom::entropySeed() ),
+	m_hash( DEFAULT_HASH ),
+	m_threadsCount( 1 ),
+	m_useMCTS( false ),
+	m_stop( false ),
+	m_pondering( false ),
+	m_start( 0 )
+{
+	std::cout.setstate( std::ios::badbit ); // The game prints its creation.
+	m_game.reset( new ChessGame( ChessGameSettings( false, 0 ) ) );
+	std::cout.clear();
+}
+
+UciEngine::~UciEngine()
+{
+	finishSearch();
+}
+
+// Until quit or the end of the input.
+void UciEngine::run()
+{
+	std::string line;
+	while ( std::getline( std::cin, line ) )
+	{
+		std::istringstream arguments( line );
+		std::string command;
+		arguments >> command;
+		if ( command == "uci" ) identify();
+		else if ( command == "isready" ) send( "readyok" );
+		else if ( command == "setoption" ) setOption( arguments );
+		else if ( command == "ucinewgame" )
+		{
+			finishSearch();
+			if ( m_search != nullptr ) m_search->clear();
+		}
+		else if ( command == "position" ) setPosition( arguments );
+		else if ( command == "go" ) go( arguments );
+		else if ( command == "stop" ) stop();
+		else if ( command == "ponderhit" ) ponderHit();
+		else if ( command == "quit" ) break;
+	}
+}
+
+void UciEngine::identify()
+{
+	send( "id name chess" );
+	send( "id author VgTajdd" );
+	send( "option name Hash type spin default " + std::to_string( DEFAULT_HASH ) + " min 1 max " + std::to_string( MAX_HASH ) );
+	send( "option name Threads type spin default 1 min 1 max " + std::to_string( MAX_THREADS ) );
+	send( "option name Search type combo default AlphaBeta var AlphaBeta var MCTS" );
+	send( "option name Ponder type check default false" );
+	send( "uciok" );
+}
+
+// setoption name <name> value <value>, the tables are allocated by the next search.
+void UciEngine::setOption( std::istringstream& arguments )
+{
+	std::string token, name, value;
+	arguments >> token >> name;
+	while ( arguments >> token && token != "value" )
+	{
+		name += " " + token;
+	}
+	arguments >> value;
+	finishSearch();
+	if ( name == "Hash" && !value.empty() )
+	{
+		m_hash = std::min( std::max( std::atoi( value.c_str() ), 1 ), MAX_HASH );
+		m_search.reset();
+	}
+	else if ( name == "Threads" && !value.empty() )
+	{
+		m_threadsCount = std::min( std::max( std::atoi( value.c_str() ), 1 ), MAX_THREADS );
+		m_mcts.reset();
+	}
+	else if ( name == "Search" )
+	{
+		m_useMCTS = value == "MCTS";
+	}
+}
+
+// position startpos|fen <FEN> [moves <move>...], the moves stop at the first illegal one.
+void UciEngine::setPosition( std::istringstream& arguments )
+{
+	finishSearch();
+	std::string token;
+	arguments >> token;
+	if ( token == "fen" )
+	{
+		std::string fen;
+		while ( arguments >> token && token != "moves" )
+		{
+			fen += ( fen.empty() ? "" : " " ) + token;
+		}
+		if ( !m_game->loadFEN( fen ) )
+		{
+			send( "info string invalid fen " + fen );
+			m_game->resetPosition();
+			return;
+		}
+	}
+	else
+	{
+		m_game->resetPosition();
+		arguments >> token;
+	}
+	if ( token != "moves" )
+	{
+		return;
+	}
+	CellNode from, to;
+	while ( arguments >> token )
+	{
+		if ( !m_game->parseMove( token, from, to ) || !m_game->playMove( from, to ) )
+		{
+			send( "info string illegal move " + token );
+			return;
+		}
+	}
+}
+
+void UciEngine::go( std::istringstream& arguments )
+{
+	finishSearch();
+	SearchLimits limits = { 0, 0, 0, false, false };
+	int times[2] = { 0, 0 };
+	int increments[2] = { 0, 0 };
+	int movesToGo = 0;
+	int moveTime = 0;
+	std::string token;
+	while ( arguments >> token )
+	{
+		if ( token == "wtime" ) arguments >> times[0];
+		else if ( token == "btime" ) arguments >> times[1];
+		else if ( token == "winc" ) arguments >> increments[0];
+		else if ( token == "binc" ) arguments >> increments[1];
+		else if ( token == "movestogo" ) arguments >> movesToGo;
+		else if ( token == "movetime" ) arguments >> moveTime;
+		else if ( token == "depth" ) arguments >> limits.depth;
+		else if ( token == "nodes" ) arguments >> limits.nodes;
+		else if ( token == "infinite" ) limits.infinite = true;
+		else if ( token == "ponder" ) limits.ponder = true;
+	}
+
+	ChessPosition position;
+	m_game->getPosition( position );
+	const int side = position.blackToMove ? 1 : 0;
+	if ( moveTime > 0 )
+	{
+		limits.time = moveTime;
+	}
+	else if ( times[side] > 0 )
+	{
+		const int budget = times[side] / ( movesToGo > 0 ? movesToGo : DEFAULT_MOVES_TO_GO ) + increments[side] * 3 / 4;
+		limits.time = std::max( std::min( budget, times[side] - MOVE_OVERHEAD ), 1 );
+	}
+	if ( limits.depth == 0 && limits.nodes == 0 && limits.time == 0 )
+	{
+		limits.infinite = true;
+	}
+
+	prepare();
+	m_stop.store( false );
+	m_pondering.store( limits.ponder );
+	m_start.store( now() );
+	m_thinking = std::thread( &UciEngine::think, this, position, limits );
+}
+
+void UciEngine::stop()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_stop.store( true );
+	}
+	m_condition.notify_all();
+}
+
+// The opponent played the expected move: the pondering search goes on with the time limits.
+void UciEngine::ponderHit()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_start.store( now() );
+		m_pondering.store( false );
+	}
+	m_condition.notify_all();
+}
+
+void UciEngine::finishSearch()
+{
+	if ( m_thinking.joinable() )
+	{
+		stop();
+		m_thinking.join();
+	}
+}
+
+void UciEngine::prepare()
+{
+	if ( m_search == nullptr )
+	{
+		m_search.reset( new ChessSearch( tableBits( m_hash ) ) );
+	}
+	if ( m_mcts == nullptr )
+	{
+		m_mcts.reset( new ChessMCTS( m_threadsCount ) );
+	}
+}
+
+// Search thread: the best move is sent once the search is over and, if infinite or pondering, stopped.
+void UciEngine::think( const ChessPosition position, const SearchLimits limits )
+{
+	ChessMove move = ChessMovePicker::NO_MOVE;
+	if ( position.kingSquare[position.blackToMove] != -1 )
+	{
+		move = m_useMCTS ? monteCarlo( position, limits ) : alphaBeta( position, limits );
+		if ( move == ChessMovePicker::NO_MOVE )
+		{
+			// Stopped before the first iteration, any move.
+			ChessMove moves[2 * ChessMovePicker::MAX_MOVES];
+			int count = 0;
+			ChessMovePicker::generate( position, true, moves, count );
+			ChessMovePicker::generate( position, false, moves, count );
+			move = count > 0 ? moves[0] : ChessMovePicker::NO_MOVE;
+		}
+	}
+	{
+		std::unique_lock< std::mutex > lock( m_mutex );
+		m_condition.wait( lock, [this, &limits]() { return m_stop.load() || ( !limits.infinite && !m_pondering.load() ); } );
+	}
+	send( "bestmove " + moveText( move ) );
+}
+
+/**
+ Iterative deepening in slices of SLICE_TIME: the time and pondering limits are checked between
+ slices, the stop flag and the nodes limit inside them. Each finished iteration is reported.
+*/
+const ChessMove UciEngine::alphaBeta( const ChessPosition& position, const SearchLimits& limits )
+{
+	const int64_t start = now();
+	const uint64_t startNodes = m_search->nodes();
+	m_search->start( position, limits.depth > 0 ? std::min( limits.depth, MAX_DEPTH ) : MAX_DEPTH );
+	int reportedDepth = 0;
+	int score = 0;
+	for ( ;; )
+	{
+		const bool over = m_search->resume( SLICE_TIME, &m_stop, limits.nodes > 0 ? startNodes + limits.nodes : 0 );
+		const ChessMove move = m_search->result( score );
+		if ( m_search->depth() > reportedDepth && move != ChessMovePicker::NO_MOVE )
+		{
+			reportedDepth = m_search->depth();
+			const uint64_t nodes = m_search->nodes() - startNodes;
+			const int64_t elapsed = std::max( now() - start, int64_t( 1 ) );
+			std::string scoreText;
+			if ( ChessSearch::isWinScore( score ) )
+			{
+				const int plies = ChessSearch::WIN_SCORE - std::abs( score );
+				scoreText = "mate " + std::to_string( score > 0 ? ( plies + 1 ) / 2 : -( plies / 2 ) );
+			}
+			else
+			{
+				scoreText = "cp " + std::to_string( score );
+			}
+			send( "info depth " + std::to_string( reportedDepth ) + " score " + scoreText + " nodes " + std::to_string( nodes ) +
+				  " nps " + std::to_string( nodes * 1000 / uint64_t( elapsed ) ) + " time " + std::to_string( elapsed ) + " pv " + moveText( move ) );
+		}
+		if ( over || m_stop.load() || ( limits.nodes > 0 && m_search->nodes() - startNodes >= limits.nodes ) || timeIsOver( limits ) )
+		{
+			return move;
+		}
+	}
+}
+
+/**
+ With a nodes limit, that many playouts on one thread. Otherwise every thread searches until the
+ stop flag, set by a clock thread when the time is over.
+*/
+const ChessMove UciEngine::monteCarlo( const ChessPosition& position, const SearchLimits& limits )
+{
+	const int64_t start = now();
+	ChessMove move = ChessMovePicker::NO_MOVE;
+	if ( limits.nodes > 0 )
+	{
+		move = m_mcts->search( position, int( std::min( limits.nodes, uint64_t( INT_MAX ) ) ), 0, m_random.next(), &m_stop );
+	}
+	else
+	{
+		std::atomic< bool > over( false );
+		std::thread clock( [this, &limits, &over]()
+		{
+			while ( !over.load() && !m_stop.load() && !timeIsOver( limits ) )
+			{
+				std::this_thread::sleep_for( std::chrono::milliseconds( SLICE_TIME ) );
+			}
+			if ( timeIsOver( limits ) )
+			{
+				m_stop.store( true );
+			}
+		} );
+		move = m_mcts->search( position, 0, INT_MAX, m_random.next(), &m_stop );
+		over.store( true );
+		clock.join();
+	}
+	const int64_t elapsed = std::max( now() - start, int64_t( 1 ) );
+	send( "info nodes " + std::to_string( m_mcts->playouts() ) + " nps " + std::to_string( m_mcts->playouts() * 1000 / uint64_t( elapsed ) ) +
+		  " time " + std::to_string( elapsed ) + " pv " + moveText( move ) );
+	return move;
+}
+
+// No time limit while pondering, the time starts at the ponderhit.
+const bool UciEngine::timeIsOver( const SearchLimits& limits ) const
+{
+	return !limits.infinite && !m_pondering.load() && limits.time > 0 && now() - m_start.load() >= limits.time;
+}
+
+void UciEngine::send( const std::string& line )
+{
+	std::lock_guard< std::mutex > lock( m_mutex );
+	std::cout << line << std::endl;
+}
+
+int main( int argc, char** argv )
+{
+	UciEngine engine;
+	engine.run();
+	return 0;
+}